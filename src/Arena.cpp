@@ -0,0 +1,194 @@
+//-----------------------------------------------------------------------------
+// Arena - Block allocator with bulk reset.
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "Arena.h"
+
+#include <algorithm>
+
+//-----------------------------------------------------------------------------
+Arena::Arena(size_t blockSize) :
+    m_blockSize(blockSize < 256 ? 256 : blockSize),
+    m_inUse(0),
+    m_used(0),
+    m_largeBytes(0),
+    m_allocs(0),
+    m_largeAllocs(0),
+    m_peakBytes(0)
+{ }
+
+//-----------------------------------------------------------------------------
+Arena::Arena(Arena&& other) :
+    m_blockSize(other.m_blockSize),
+    m_inUse(0),
+    m_used(0),
+    m_largeBytes(0),
+    m_allocs(0),
+    m_largeAllocs(0),
+    m_peakBytes(0)
+{
+    Swap(other);
+}
+
+//-----------------------------------------------------------------------------
+Arena& Arena::operator=(Arena&& other)
+{
+    if (this != &other)
+    {
+        Release();
+        Swap(other);
+    }
+    return *this;
+}
+
+//-----------------------------------------------------------------------------
+void Arena::Swap(Arena& other)
+{
+    std::swap(m_blockSize, other.m_blockSize);
+    m_blocks.swap(other.m_blocks);
+    std::swap(m_inUse, other.m_inUse);
+    std::swap(m_used, other.m_used);
+    m_large.swap(other.m_large);
+    std::swap(m_largeBytes, other.m_largeBytes);
+    std::swap(m_allocs, other.m_allocs);
+    std::swap(m_largeAllocs, other.m_largeAllocs);
+    std::swap(m_peakBytes, other.m_peakBytes);
+}
+
+//-----------------------------------------------------------------------------
+void* Arena::Alloc(size_t size, size_t align)
+{
+    m_allocs++;
+    if (size > m_blockSize / 4)
+        return AllocLarge(size);
+
+    size_t pos = (m_used + align - 1) & ~(align - 1);
+    if (m_inUse == 0 || pos + size > m_blockSize)
+    {
+        // Next block, reuse one kept by Rewind or Reset when available.
+        if (m_inUse == m_blocks.size())
+        {
+            LL_CHECK_HEAP();
+            m_blocks.push_back(std::unique_ptr<char[]>(new char[m_blockSize]));
+        }
+        m_inUse++;
+        pos = 0;
+    }
+
+    void* ptr = m_blocks[m_inUse - 1].get() + pos;
+    m_used = pos + size;
+    m_peakBytes = std::max(m_peakBytes, UsedBytes());
+    return ptr;
+}
+
+//-----------------------------------------------------------------------------
+void* Arena::AllocLarge(size_t size)
+{
+    LL_CHECK_HEAP();
+    Large large;
+    large.data.reset(new char[size]);
+    large.size = size;
+    m_large.push_back(std::move(large));
+    m_largeBytes += size;
+    m_largeAllocs++;
+    m_peakBytes = std::max(m_peakBytes, UsedBytes());
+    return m_large.back().data.get();
+}
+
+//-----------------------------------------------------------------------------
+char* Arena::StrDup(const char* str, size_t len)
+{
+    char* dup = (char*)Alloc(len + 1, 1);
+    memcpy(dup, str, len);
+    dup[len] = '\0';
+    return dup;
+}
+
+//-----------------------------------------------------------------------------
+Arena::Mark Arena::GetMark() const
+{
+    Mark mark;
+    mark.blocks = m_inUse;
+    mark.used = m_used;
+    mark.large = m_large.size();
+    return mark;
+}
+
+//-----------------------------------------------------------------------------
+void Arena::Rewind(const Mark& mark)
+{
+    m_inUse = mark.blocks;
+    m_used = mark.used;
+    while (m_large.size() > mark.large)
+    {
+        m_largeBytes -= m_large.back().size;
+        m_large.pop_back();
+    }
+}
+
+//-----------------------------------------------------------------------------
+void Arena::Reset()
+{
+    Mark empty = { 0, 0, 0 };
+    Rewind(empty);
+}
+
+//-----------------------------------------------------------------------------
+void Arena::Release()
+{
+    Reset();
+    m_blocks.clear();
+    m_large.clear();
+}
+
+//-----------------------------------------------------------------------------
+size_t Arena::UsedBytes() const
+{
+    size_t blockBytes = (m_inUse == 0) ? 0 : (m_inUse - 1) * m_blockSize + m_used;
+    return blockBytes + m_largeBytes;
+}
+
+//-----------------------------------------------------------------------------
+Arena::Stats Arena::GetStats() const
+{
+    Stats stats;
+    stats.allocs = m_allocs;
+    stats.largeAllocs = m_largeAllocs;
+    stats.usedBytes = UsedBytes();
+    stats.peakBytes = m_peakBytes;
+    stats.reservedBytes = m_blocks.size() * m_blockSize + m_largeBytes;
+    return stats;
+}
+
+//-----------------------------------------------------------------------------
+Arena& Arena::ThreadLocal()
+{
+    static thread_local Arena sArena(16 * 1024);
+    return sArena;
+}
@@ -0,0 +1,144 @@
+//-----------------------------------------------------------------------------
+// Arena - Block allocator with bulk reset.
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+#include <memory>
+
+#ifdef _DEBUG
+#include <crtdbg.h>
+#endif
+
+// Debug heap check, compiled out of release builds.
+#ifdef _DEBUG
+#define LL_CHECK_HEAP()     _CrtCheckMemory()
+#else
+#define LL_CHECK_HEAP()     ((void)0)
+#endif
+
+//-----------------------------------------------------------------------------
+// Block allocator for many small allocations with one owner.
+//
+// Memory is carved from blocks of blockSize and only given back in bulk,
+// by Rewind to a Mark, by Reset or when the arena is destroyed. Blocks are
+// kept by Rewind and Reset and reused for the next allocations. Requests
+// above a quarter block get their own allocation, freed the same way.
+//
+// An arena is not thread safe, use one per owner or ThreadLocal() for
+// short lived scratch space, usually with an ArenaScope.
+class Arena
+{
+public:
+    explicit Arena(size_t blockSize = 64 * 1024);
+    Arena(Arena&& other);
+    Arena& operator=(Arena&& other);
+    void Swap(Arena& other);
+
+    // Return size bytes aligned to align (a power of 2).
+    void* Alloc(size_t size, size_t align = sizeof(void*));
+
+    // Copy of len chars of str plus a nul.
+    char* StrDup(const char* str, size_t len);
+    char* StrDup(const char* str)
+    { return StrDup(str, strlen(str)); }
+
+    struct Mark
+    {
+        size_t  blocks;     // blocks in use
+        size_t  used;       // bytes used in last block
+        size_t  large;      // large allocations
+    };
+    Mark GetMark() const;
+    // Free everything allocated after mark.
+    void Rewind(const Mark& mark);
+    // Free all allocations, blocks are kept for reuse.
+    void Reset();
+    // Free all allocations and blocks.
+    void Release();
+
+    struct Stats
+    {
+        size_t  allocs;         // Alloc calls
+        size_t  largeAllocs;    // of those, given their own allocation
+        size_t  usedBytes;      // held by live allocations, with alignment and block tails
+        size_t  peakBytes;      // largest usedBytes
+        size_t  reservedBytes;  // blocks and large allocations owned
+    };
+    Stats GetStats() const;
+
+    // Scratch arena of the calling thread.
+    static Arena& ThreadLocal();
+
+private:
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+
+    void* AllocLarge(size_t size);
+    size_t UsedBytes() const;
+
+    struct Large
+    {
+        std::unique_ptr<char[]> data;
+        size_t  size;
+    };
+
+    size_t              m_blockSize;
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    size_t              m_inUse;        // blocks in use, last one is being filled
+    size_t              m_used;         // bytes used in last block in use
+    std::vector<Large>  m_large;
+    size_t              m_largeBytes;   // live large allocations
+    size_t              m_allocs;
+    size_t              m_largeAllocs;
+    size_t              m_peakBytes;
+};
+
+//-----------------------------------------------------------------------------
+// Rewind an arena to where it was when the scope started.
+class ArenaScope
+{
+public:
+    explicit ArenaScope(Arena& arena) :
+        m_arena(arena), m_mark(arena.GetMark())
+    { }
+
+    ~ArenaScope()
+    { m_arena.Rewind(m_mark); }
+
+private:
+    ArenaScope(const ArenaScope&);
+    ArenaScope& operator=(const ArenaScope&);
+
+    Arena&      m_arena;
+    Arena::Mark m_mark;
+};
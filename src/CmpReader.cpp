@@ -0,0 +1,186 @@
+//-----------------------------------------------------------------------------
+// CmpReader - Read same ranges of two files
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+
+#include <algorithm>
+#include <malloc.h>
+
+#include "CmpReader.h"
+#include "MemCompare.h"
+
+//-----------------------------------------------------------------------------
+CmpReader::CmpReader(const Handle& f1, const Handle& f2, LONGLONG fileSize, LONGLONG offset, bool map) :
+    m_f1(f1),
+    m_f2(f2),
+    m_fileSize(fileSize),
+    m_offset(offset),
+    m_pos(offset),
+    m_mapped(false),
+    m_buffer1(NULL),
+    m_buffer2(NULL),
+    m_error(0),
+    m_errorFile(0)
+{
+    m_mapped = map && m_map1.Open(f1, sMapBytes) && m_map2.Open(f2, sMapBytes);
+    if ( !m_mapped)
+    {
+        m_buffer1 = (BYTE*)_aligned_malloc(sReadBytes, 4096);
+        m_buffer2 = (BYTE*)_aligned_malloc(sReadBytes, 4096);
+    }
+}
+
+//-----------------------------------------------------------------------------
+CmpReader::~CmpReader()
+{
+    _aligned_free(m_buffer1);
+    _aligned_free(m_buffer2);
+}
+
+//-----------------------------------------------------------------------------
+HANDLE CmpReader::OpenRead(const char* filePath, bool& map)
+{
+    if (map)
+    {
+        HANDLE hFile = CreateFile(filePath, GENERIC_READ, FILE_SHARE_READ, 0,
+                OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+        if (hFile != INVALID_HANDLE_VALUE || GetLastError() != ERROR_SHARING_VIOLATION)
+            return hFile;
+        map = false;
+    }
+
+    return CreateFile(filePath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0,
+            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+}
+
+//-----------------------------------------------------------------------------
+// Record read failure of file 1 or 2, return false.
+bool CmpReader::SetError(int fileNum, DWORD error)
+{
+    m_error = (error != NO_ERROR) ? error : ERROR_READ_FAULT;
+    m_errorFile = fileNum;
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+bool CmpReader::ReadAt(LONGLONG pos, size_t maxLength, const BYTE*& data1, const BYTE*& data2, size_t& length)
+{
+    if (m_mapped)
+    {
+        SIZE_T length1 = (SIZE_T)std::min(LONGLONG(maxLength), m_fileSize - pos);
+        SIZE_T length2 = length1;
+        length = length1;
+        data1 = (const BYTE*)m_map1.MapView(pos, length1);
+        if (data1 == NULL)
+            return SetError(1, GetLastError());
+        data2 = (const BYTE*)m_map2.MapView(pos, length2);
+        if (data2 == NULL)
+            return SetError(2, GetLastError());
+        length = std::min(length, std::min(length1, length2));
+        return true;
+    }
+
+    if (m_buffer1 == NULL || m_buffer2 == NULL)
+        return SetError(1, ERROR_NOT_ENOUGH_MEMORY);
+
+    DWORD readLength = (DWORD)std::min(maxLength, size_t(sReadBytes));
+    LARGE_INTEGER fileOffset;
+    fileOffset.QuadPart = pos;
+    if (SetFilePointer(m_f1, fileOffset.LowPart, &fileOffset.HighPart, FILE_BEGIN) == INVALID_SET_FILE_POINTER &&
+        GetLastError() != NO_ERROR)
+        return SetError(1, GetLastError());
+    fileOffset.QuadPart = pos;
+    if (SetFilePointer(m_f2, fileOffset.LowPart, &fileOffset.HighPart, FILE_BEGIN) == INVALID_SET_FILE_POINTER &&
+        GetLastError() != NO_ERROR)
+        return SetError(2, GetLastError());
+
+    DWORD rlen1 = 0, rlen2 = 0;
+    if (ReadFile(m_f1, m_buffer1, readLength, &rlen1, 0) == 0)
+        return SetError(1, GetLastError());
+    if (ReadFile(m_f2, m_buffer2, readLength, &rlen2, 0) == 0)
+        return SetError(2, GetLastError());
+
+    // Short read, the file changed size since it was opened.
+    if (rlen1 == 0 || rlen1 < rlen2)
+        return SetError(1, ERROR_HANDLE_EOF);
+    if (rlen2 < rlen1)
+        return SetError(2, ERROR_HANDLE_EOF);
+
+    data1 = m_buffer1;
+    data2 = m_buffer2;
+    length = rlen1;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+bool CmpReader::Next(const BYTE*& data1, const BYTE*& data2, size_t& length)
+{
+    if (m_pos >= m_fileSize)
+        return false;
+
+    LONGLONG maxLength = std::min(LONGLONG(m_mapped ? sMapBytes : sReadBytes), m_fileSize - m_pos);
+    if ( !ReadAt(m_pos, (size_t)maxLength, data1, data2, length))
+        return false;
+
+    m_pos += length;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+bool CmpReader::SamplesEqual(unsigned blocks, LONGLONG& differAt)
+{
+    // Head first, then tail, then the blocks between them.
+    LONGLONG span = m_fileSize - m_offset - sSampleBytes;
+    for (unsigned block = 0; block != blocks + 2; block++)
+    {
+        unsigned part = (block == 0) ? 0 : (block == 1) ? blocks + 1 : block - 1;
+        LONGLONG pos = m_offset + span * part / (blocks + 1);
+
+        const BYTE* data1;
+        const BYTE* data2;
+        size_t length;
+
+        // Read errors are left for the full compare to report.
+        if ( !ReadAt(pos, sSampleBytes, data1, data2, length))
+        {
+            m_error = 0;
+            m_errorFile = 0;
+            return true;
+        }
+
+        size_t idx = MemCompare::FirstDiff(data1, data2, length);
+        if (idx != length)
+        {
+            differAt = pos + idx;
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,97 @@
+//-----------------------------------------------------------------------------
+// CmpReader - Read same ranges of two files
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+
+#include "Handle.h"
+#include "MemMapFile.h"
+
+//-----------------------------------------------------------------------------
+// Same ranges of two open files from offset up to fileSize. Files are
+// memory mapped in large windows when map is set, else (or if mapping
+// fails) read in large aligned buffers.
+//
+// A read error in a mapped view raises an exception instead of failing,
+// so only map handles from OpenRead with map still set, which nothing
+// else can write or truncate while they are open.
+class CmpReader
+{
+public:
+    static const SIZE_T sMapBytes    = 64 << 20;    // mapped window of each file
+    static const DWORD  sReadBytes   = 1 << 20;     // read buffer of each file
+    static const DWORD  sSampleBytes = 64 << 10;    // sampled block of each file
+
+    CmpReader(const Handle& f1, const Handle& f2, LONGLONG fileSize, LONGLONG offset, bool map);
+    ~CmpReader();
+
+    // Open file to read. With map set it is opened without write or delete
+    // sharing so it can be mapped, if it is already open for writing map is
+    // cleared and it is opened shared.
+    static HANDLE OpenRead(const char* filePath, bool& map);
+
+    // Next range of both files, return false at the end or on a read error.
+    bool Next(const BYTE*& data1, const BYTE*& data2, size_t& length);
+
+    // Read failure of Next, 0 if none, and the file (1 or 2) which failed.
+    DWORD Error() const
+    { return m_error; }
+    int ErrorFile() const
+    { return m_errorFile; }
+
+    // Return true if the files were read to the end.
+    bool AtEnd() const
+    { return m_pos >= m_fileSize; }
+
+    // Compare the head, tail and 'blocks' evenly spaced blocks between them,
+    // return false and the first sampled difference if a block differs.
+    bool SamplesEqual(unsigned blocks, LONGLONG& differAt);
+
+private:
+    CmpReader(const CmpReader&);
+    CmpReader& operator=(const CmpReader&);
+
+    bool ReadAt(LONGLONG pos, size_t maxLength, const BYTE*& data1, const BYTE*& data2, size_t& length);
+    bool SetError(int fileNum, DWORD error);
+
+    const Handle&   m_f1;
+    const Handle&   m_f2;
+    LONGLONG        m_fileSize;
+    LONGLONG        m_offset;
+    LONGLONG        m_pos;
+    bool            m_mapped;
+    MemMapFile      m_map1;
+    MemMapFile      m_map2;
+    BYTE*           m_buffer1;
+    BYTE*           m_buffer2;
+    DWORD           m_error;
+    int             m_errorFile;
+};
@@ -0,0 +1,582 @@
+//-----------------------------------------------------------------------------
+// DiffMap - Map of differences between two files
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "DiffMap.h"
+#include "CmpReader.h"
+#include "MemCompare.h"
+#include "WorkPool.h"
+#include "hash.h"
+
+static const LONGLONG sRegionBytes = 64 << 20;      // file part per task
+static const DWORD sChunkBytes = 1 << 20;           // read size of MapShifted
+static const DWORD sMinBlockBytes = 4096;
+static const ULONGLONG sMaxBlocks = 1 << 20;        // block table is at most 16MB
+static const DWORD sShareAll = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
+
+//-----------------------------------------------------------------------------
+static HANDLE OpenRead(const std::string& filePath)
+{
+    return CreateFile(filePath.c_str(), GENERIC_READ, sShareAll, 0,
+            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+}
+
+//-----------------------------------------------------------------------------
+static bool SeekFile(HANDLE hFile, LONGLONG pos)
+{
+    LARGE_INTEGER fileOffset;
+    fileOffset.QuadPart = pos;
+    return SetFilePointer(hFile, fileOffset.LowPart, &fileOffset.HighPart, FILE_BEGIN) != INVALID_SET_FILE_POINTER ||
+        GetLastError() == NO_ERROR;
+}
+
+//-----------------------------------------------------------------------------
+static DWORD ReadError()
+{
+    DWORD error = GetLastError();
+    return (error != NO_ERROR) ? error : ERROR_READ_FAULT;
+}
+
+//-----------------------------------------------------------------------------
+// rsync weak checksum, sumA is the sum of the bytes and sumB the sum of the
+// running sumA, both mod 2^16, so the window can roll a byte at a time.
+static void WeakSum(const BYTE* data, DWORD length, DWORD& sumA, DWORD& sumB)
+{
+    sumA = sumB = 0;
+    for (DWORD idx = 0; idx != length; idx++)
+    {
+        sumA += data[idx];
+        sumB += (length - idx) * data[idx];
+    }
+    sumA &= 0xffff;
+    sumB &= 0xffff;
+}
+
+//-----------------------------------------------------------------------------
+static ULONGLONG StrongSum(const BYTE* data, DWORD length)
+{
+    md5_state_t state;
+    md5_init(&state);
+    md5_append(&state, (const md5_byte_t *)data, (int)length);
+
+    md5_byte_t digest[16];
+    md5_finish(&state, digest);
+    ULONGLONG strong;
+    memcpy(&strong, digest, sizeof(strong));
+    return strong;
+}
+
+//-----------------------------------------------------------------------------
+// Region tasks of one map. The pool is shared by the maps of a run, so the
+// caller runs queued tasks until its own are done, WorkPool::Wait would also
+// wait for other maps. Without a pool or with one region they run inline.
+class RegionTasks
+{
+public:
+    RegionTasks(WorkPool* pool) :
+        m_pool(pool), m_remaining(0)
+    { }
+
+    void Add(WorkPool::Task_fn taskFn, void* data)
+    {
+        Entry entry = { taskFn, data, this };
+        m_entries.push_back(entry);
+    }
+
+    void Run()
+    {
+        if (m_pool == NULL || m_entries.size() <= 1)
+        {
+            for (size_t idx = 0; idx != m_entries.size(); idx++)
+                m_entries[idx].taskFn(m_entries[idx].data);
+        }
+        else
+        {
+            m_remaining = m_entries.size();
+            for (size_t idx = 0; idx != m_entries.size(); idx++)
+                m_pool->Submit(RunEntry, &m_entries[idx]);
+            while (m_remaining != 0)
+            {
+                if (!m_pool->RunOne())
+                    std::this_thread::yield();
+            }
+        }
+        m_entries.clear();
+    }
+
+private:
+    RegionTasks(const RegionTasks&);
+    RegionTasks& operator=(const RegionTasks&);
+
+    struct Entry
+    {
+        WorkPool::Task_fn   taskFn;
+        void*               data;
+        RegionTasks*        owner;
+    };
+
+    static void RunEntry(void* data)
+    {
+        const Entry& entry = *(const Entry*)data;
+        entry.taskFn(entry.data);
+        entry.owner->m_remaining--;     // last use of entry
+    }
+
+    WorkPool*           m_pool;
+    std::vector<Entry>  m_entries;
+    std::atomic<size_t> m_remaining;
+};
+
+//-----------------------------------------------------------------------------
+struct DiffMap::BlockLess
+{
+    bool operator()(const Block& left, const Block& right) const
+    {
+        if (left.weak != right.weak)
+            return left.weak < right.weak;
+        if (left.strong != right.strong)
+            return left.strong < right.strong;
+        return left.index < right.index;
+    }
+};
+
+//-----------------------------------------------------------------------------
+struct DiffMap::RangeTask
+{
+    const DiffMap*      diffMap;
+    LONGLONG            begin;
+    LONGLONG            end;
+    size_t              maxRanges;
+    std::vector<Range>  ranges;     // first maxRanges
+    Range               first;
+    Range               last;
+    ULONGLONG           rangeCnt;
+    ULONGLONG           diffBytes;
+    DWORD               error;
+
+    void Add(const Range& range)
+    {
+        if (rangeCnt++ == 0)
+            first = range;
+        last = range;
+        diffBytes += range.end - range.begin;
+        if (ranges.size() < maxRanges)
+            ranges.push_back(range);
+    }
+};
+
+struct DiffMap::BlockTask
+{
+    DiffMap*            diffMap;
+    LONGLONG            begin;      // block aligned
+    LONGLONG            end;
+    DWORD               error;
+};
+
+struct DiffMap::ShiftTask
+{
+    const DiffMap*      diffMap;
+    LONGLONG            begin;
+    LONGLONG            end;
+    ULONGLONG           sameBytes;
+    ULONGLONG           movedBytes;
+    ULONGLONG           newBytes;
+    DWORD               error;
+};
+
+//-----------------------------------------------------------------------------
+DiffMap::DiffMap(const char* filePath1, LONGLONG fileSize1, const char* filePath2, LONGLONG fileSize2, bool map) :
+    m_rangeCnt(0),
+    m_diffBytes(0),
+    m_blockBytes(0),
+    m_sameBytes(0),
+    m_movedBytes(0),
+    m_newBytes(0),
+    m_error(0),
+    m_filePath1(filePath1),
+    m_filePath2(filePath2),
+    m_fileSize1(fileSize1),
+    m_fileSize2(fileSize2),
+    m_map(map)
+{
+}
+
+//-----------------------------------------------------------------------------
+bool DiffMap::MapRanges(WorkPool* pool, size_t maxRanges)
+{
+    m_ranges.clear();
+    m_rangeCnt = m_diffBytes = 0;
+    m_error = 0;
+
+    LONGLONG sameSize = std::min(m_fileSize1, m_fileSize2);
+    std::vector<RangeTask> tasks((size_t)((sameSize + sRegionBytes - 1) / sRegionBytes));
+    RegionTasks regionTasks(pool);
+    for (size_t idx = 0; idx != tasks.size(); idx++)
+    {
+        RangeTask& task = tasks[idx];
+        task.diffMap = this;
+        task.begin = idx * sRegionBytes;
+        task.end = std::min(task.begin + sRegionBytes, sameSize);
+        task.maxRanges = maxRanges;
+        task.rangeCnt = task.diffBytes = 0;
+        task.error = 0;
+        regionTasks.Add(RunRanges, &task);
+    }
+    regionTasks.Run();
+
+    // Join regions in order, a range ending at a region end may continue
+    // in the next region.
+    Range last = { -1, -1 };
+    for (size_t idx = 0; idx != tasks.size(); idx++)
+    {
+        RangeTask& task = tasks[idx];
+        if (task.error != 0 && m_error == 0)
+            m_error = task.error;
+        if (task.rangeCnt == 0)
+            continue;
+
+        size_t from = 0;
+        m_rangeCnt += task.rangeCnt;
+        m_diffBytes += task.diffBytes;
+        if (last.end == task.first.begin)
+        {
+            m_rangeCnt--;
+            if ( !m_ranges.empty() && m_ranges.back().end == task.first.begin)
+            {
+                m_ranges.back().end = task.first.end;
+                from = 1;
+            }
+        }
+        for (size_t rangeIdx = from; rangeIdx < task.ranges.size() && m_ranges.size() < maxRanges; rangeIdx++)
+            m_ranges.push_back(task.ranges[rangeIdx]);
+        last = task.last;
+    }
+
+    if (m_fileSize1 != m_fileSize2)
+    {
+        Range tail = { sameSize, std::max(m_fileSize1, m_fileSize2) };
+        m_diffBytes += tail.end - tail.begin;
+        if (last.end == tail.begin)
+        {
+            if ( !m_ranges.empty() && m_ranges.back().end == tail.begin)
+                m_ranges.back().end = tail.end;
+        }
+        else
+        {
+            m_rangeCnt++;
+            if (m_ranges.size() < maxRanges)
+                m_ranges.push_back(tail);
+        }
+    }
+
+    return m_error == 0;
+}
+
+//-----------------------------------------------------------------------------
+void DiffMap::RunRanges(void* data)
+{
+    RangeTask& task = *(RangeTask*)data;
+    const DiffMap& diffMap = *task.diffMap;
+
+    bool map = diffMap.m_map;
+    Handle f1(CmpReader::OpenRead(diffMap.m_filePath1.c_str(), map));
+    Handle f2(CmpReader::OpenRead(diffMap.m_filePath2.c_str(), map));
+    if (f1.NotValid() || f2.NotValid())
+    {
+        task.error = ReadError();
+        return;
+    }
+
+    CmpReader reader(f1, f2, task.end, task.begin, map);
+    const BYTE* data1;
+    const BYTE* data2;
+    size_t length;
+
+    LONGLONG filePos = task.begin;
+    Range range;
+    bool inRange = false;
+    while (reader.Next(data1, data2, length))
+    {
+        size_t idx = 0;
+        while (idx != length)
+        {
+            if ( !inRange)
+            {
+                idx += MemCompare::FirstDiff(data1 + idx, data2 + idx, length - idx);
+                if (idx != length)
+                {
+                    range.begin = filePos + idx;
+                    inRange = true;
+                }
+            }
+            else
+            {
+                idx += MemCompare::FirstSame(data1 + idx, data2 + idx, length - idx);
+                if (idx != length)
+                {
+                    range.end = filePos + idx;
+                    task.Add(range);
+                    inRange = false;
+                }
+            }
+        }
+        filePos += length;
+    }
+
+    if (inRange)
+    {
+        range.end = filePos;
+        task.Add(range);
+    }
+    if (reader.Error() != 0)
+        task.error = reader.Error();
+}
+
+//-----------------------------------------------------------------------------
+bool DiffMap::MapShifted(WorkPool* pool)
+{
+    m_sameBytes = m_movedBytes = m_newBytes = 0;
+    m_error = 0;
+
+    m_blockBytes = sMinBlockBytes;
+    while ((ULONGLONG)m_fileSize1 / m_blockBytes > sMaxBlocks)
+        m_blockBytes *= 2;
+    m_blocks.resize((size_t)(m_fileSize1 / m_blockBytes));
+    LONGLONG blocksEnd = (LONGLONG)m_blocks.size() * m_blockBytes;
+    LONGLONG regionBytes = std::max(sRegionBytes, LONGLONG(m_blockBytes));
+
+    RegionTasks regionTasks(pool);
+
+    // Block table of the first file, a partial last block is not kept.
+    std::vector<BlockTask> blockTasks((size_t)((blocksEnd + regionBytes - 1) / regionBytes));
+    for (size_t idx = 0; idx != blockTasks.size(); idx++)
+    {
+        BlockTask& task = blockTasks[idx];
+        task.diffMap = this;
+        task.begin = idx * regionBytes;
+        task.end = std::min(task.begin + regionBytes, blocksEnd);
+        task.error = 0;
+        regionTasks.Add(RunBlocks, &task);
+    }
+    regionTasks.Run();
+    for (size_t idx = 0; idx != blockTasks.size() && m_error == 0; idx++)
+        m_error = blockTasks[idx].error;
+    if (m_error != 0)
+        return false;
+    std::sort(m_blocks.begin(), m_blocks.end(), BlockLess());   // at most sMaxBlocks
+
+    // Roll a block over the second file.
+    std::vector<ShiftTask> shiftTasks((size_t)((m_fileSize2 + regionBytes - 1) / regionBytes));
+    for (size_t idx = 0; idx != shiftTasks.size(); idx++)
+    {
+        ShiftTask& task = shiftTasks[idx];
+        task.diffMap = this;
+        task.begin = idx * regionBytes;
+        task.end = std::min(task.begin + regionBytes, m_fileSize2);
+        task.sameBytes = task.movedBytes = task.newBytes = 0;
+        task.error = 0;
+        regionTasks.Add(RunShift, &task);
+    }
+    regionTasks.Run();
+
+    for (size_t idx = 0; idx != shiftTasks.size(); idx++)
+    {
+        const ShiftTask& task = shiftTasks[idx];
+        if (task.error != 0 && m_error == 0)
+            m_error = task.error;
+        m_sameBytes += task.sameBytes;
+        m_movedBytes += task.movedBytes;
+        m_newBytes += task.newBytes;
+    }
+
+    m_blocks.clear();
+    return m_error == 0;
+}
+
+//-----------------------------------------------------------------------------
+void DiffMap::RunBlocks(void* data)
+{
+    BlockTask& task = *(BlockTask*)data;
+    DiffMap& diffMap = *task.diffMap;
+    const DWORD blockBytes = diffMap.m_blockBytes;
+
+    Handle f1(OpenRead(diffMap.m_filePath1));
+    if (f1.NotValid() || !SeekFile(f1, task.begin))
+    {
+        task.error = ReadError();
+        return;
+    }
+
+    // Both are powers of 2, so the buffer holds whole blocks.
+    std::vector<BYTE> buffer(std::max(sChunkBytes, blockBytes));
+    for (LONGLONG pos = task.begin; pos < task.end; )
+    {
+        DWORD readLen = (DWORD)std::min(LONGLONG(buffer.size()), task.end - pos);
+        DWORD rlen = 0;
+        if (ReadFile(f1, buffer.data(), readLen, &rlen, 0) == 0 || rlen != readLen)
+        {
+            task.error = ReadError();
+            return;
+        }
+
+        for (DWORD offset = 0; offset != readLen; offset += blockBytes, pos += blockBytes)
+        {
+            Block& block = diffMap.m_blocks[(size_t)(pos / blockBytes)];
+            DWORD sumA, sumB;
+            WeakSum(buffer.data() + offset, blockBytes, sumA, sumB);
+            block.weak = sumA | (sumB << 16);
+            block.index = (DWORD)(pos / blockBytes);
+            block.strong = StrongSum(buffer.data() + offset, blockBytes);
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+const DiffMap::Block* DiffMap::FindBlock(DWORD weak, const BYTE* data, LONGLONG pos) const
+{
+    Block key = { weak, 0, 0 };
+    std::vector<Block>::const_iterator iter = std::lower_bound(m_blocks.begin(), m_blocks.end(), key, BlockLess());
+    if (iter == m_blocks.end() || iter->weak != weak)
+        return NULL;
+
+    // Same weak checksum, only now is the strong hash worth computing.
+    key.strong = StrongSum(data, m_blockBytes);
+    iter = std::lower_bound(iter, m_blocks.end(), key, BlockLess());
+    if (iter == m_blocks.end() || iter->weak != weak || iter->strong != key.strong)
+        return NULL;
+
+    // Blocks with the same data are in index order, prefer the one at pos.
+    if (pos % m_blockBytes == 0 && pos / m_blockBytes <= 0xffffffff)
+    {
+        key.index = (DWORD)(pos / m_blockBytes);
+        std::vector<Block>::const_iterator same = std::lower_bound(iter, m_blocks.end(), key, BlockLess());
+        if (same != m_blocks.end() && same->weak == weak && same->strong == key.strong && same->index == key.index)
+            return &*same;
+    }
+    return &*iter;
+}
+
+//-----------------------------------------------------------------------------
+void DiffMap::RunShift(void* data)
+{
+    ShiftTask& task = *(ShiftTask*)data;
+    const DiffMap& diffMap = *task.diffMap;
+    const DWORD blockBytes = diffMap.m_blockBytes;
+
+    if (diffMap.m_blocks.empty())
+    {
+        task.newBytes = task.end - task.begin;
+        return;
+    }
+
+    Handle f2(OpenRead(diffMap.m_filePath2));
+    if (f2.NotValid() || !SeekFile(f2, task.begin))
+    {
+        task.error = ReadError();
+        return;
+    }
+
+    // A block starting in the region may end past it.
+    LONGLONG readEnd = std::min(task.end + blockBytes - 1, diffMap.m_fileSize2);
+    LONGLONG readPos = task.begin;
+    std::vector<BYTE> buffer(sChunkBytes + blockBytes);
+    size_t have = 0;        // bytes in buffer
+    size_t idx = 0;         // buffer offset of pos
+    DWORD sumA = 0, sumB = 0;
+    bool rolled = false;    // sumA and sumB are of the block at pos
+
+    for (LONGLONG pos = task.begin; pos < task.end; )
+    {
+        if (idx + blockBytes > have && readPos < readEnd)
+        {
+            memmove(buffer.data(), buffer.data() + idx, have - idx);
+            have -= idx;
+            idx = 0;
+
+            DWORD readLen = (DWORD)std::min(LONGLONG(buffer.size() - have), readEnd - readPos);
+            DWORD rlen = 0;
+            if (ReadFile(f2, buffer.data() + have, readLen, &rlen, 0) == 0 || rlen != readLen)
+            {
+                task.error = ReadError();
+                return;
+            }
+            have += rlen;
+            readPos += rlen;
+        }
+
+        if (idx + blockBytes > have)
+        {
+            // Less than a block left, it can not match.
+            task.newBytes += task.end - pos;
+            break;
+        }
+
+        const BYTE* block = buffer.data() + idx;
+        if ( !rolled)
+        {
+            WeakSum(block, blockBytes, sumA, sumB);
+            rolled = true;
+        }
+
+        const Block* match = diffMap.FindBlock(sumA | (sumB << 16), block, pos);
+        if (match != NULL)
+        {
+            ULONGLONG matchBytes = (ULONGLONG)std::min(LONGLONG(blockBytes), task.end - pos);
+            if ((LONGLONG)match->index * blockBytes == pos)
+                task.sameBytes += matchBytes;
+            else
+                task.movedBytes += matchBytes;
+            pos += blockBytes;
+            idx += blockBytes;
+            rolled = false;
+        }
+        else
+        {
+            task.newBytes++;
+            if (idx + blockBytes < have)
+            {
+                BYTE outByte = block[0];
+                BYTE inByte = block[blockBytes];
+                sumA = (sumA - outByte + inByte) & 0xffff;
+                sumB = (sumB - blockBytes * outByte + sumA) & 0xffff;
+            }
+            else
+            {
+                rolled = false;
+            }
+            pos++;
+            idx++;
+        }
+    }
+}
@@ -0,0 +1,107 @@
+//-----------------------------------------------------------------------------
+// DiffMap - Map of differences between two files
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+#include <string>
+#include <vector>
+
+class WorkPool;
+
+//-----------------------------------------------------------------------------
+// Where two files differ, to judge how much of a large file changed without
+// a dump of its bytes.
+//
+// MapRanges lists the byte ranges which differ at the same offset.
+// MapShifted also finds content of the second file anywhere in the first,
+// rsync style: the first file is split in blocks kept with a weak rolling
+// checksum and a strong hash, and a block sized window is rolled over the
+// second file. Both split the files in regions run on the given work pool,
+// NULL runs them on the calling thread.
+class DiffMap
+{
+public:
+    struct Range
+    {
+        LONGLONG    begin;
+        LONGLONG    end;        // one past the last differing byte
+    };
+
+    DiffMap(const char* filePath1, LONGLONG fileSize1, const char* filePath2, LONGLONG fileSize2, bool map);
+
+    // Ranges which differ at the same offset, keeps the first maxRanges.
+    // The tail of the longer file is a differing range.
+    bool MapRanges(WorkPool* pool, size_t maxRanges);
+
+    // Bytes of the second file found at the same offset, moved or not
+    // found in the first file. Counts are within a block at region edges.
+    bool MapShifted(WorkPool* pool);
+
+    std::vector<Range>  m_ranges;       // MapRanges result
+    ULONGLONG           m_rangeCnt;
+    ULONGLONG           m_diffBytes;
+
+    DWORD               m_blockBytes;   // MapShifted result
+    ULONGLONG           m_sameBytes;
+    ULONGLONG           m_movedBytes;
+    ULONGLONG           m_newBytes;
+
+    DWORD               m_error;        // first read failure, 0 if none
+
+private:
+    DiffMap(const DiffMap&);
+    DiffMap& operator=(const DiffMap&);
+
+    struct Block
+    {
+        DWORD       weak;
+        DWORD       index;      // block index in the first file
+        ULONGLONG   strong;
+    };
+    struct BlockLess;
+    struct RangeTask;
+    struct BlockTask;
+    struct ShiftTask;
+
+    static void RunRanges(void* data);
+    static void RunBlocks(void* data);
+    static void RunShift(void* data);
+
+    // Block of the first file with the data, the one at pos if several.
+    const Block* FindBlock(DWORD weak, const BYTE* data, LONGLONG pos) const;
+
+    std::string         m_filePath1;
+    std::string         m_filePath2;
+    LONGLONG            m_fileSize1;
+    LONGLONG            m_fileSize2;
+    bool                m_map;          // memory map files in MapRanges
+    std::vector<Block>  m_blocks;       // sorted by weak, strong, index
+};
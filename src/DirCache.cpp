@@ -0,0 +1,285 @@
+//-----------------------------------------------------------------------------
+// DirCache - Persistent snapshot of directory entries
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+
+#include "DirCache.h"
+#include "DirReader.h"
+
+// Snapshot file layout
+//      header   "LLDC" version dirCount
+//      per dir  WORD pathLen, path, Stamp, DWORD dataLen, encoded entries
+//      entry    attributes, 3 times, size, reserved0, WORD nameLen, name
+static const char sMagic[4] = { 'L', 'L', 'D', 'C' };
+static const DWORD sVersion = 1;
+static const char sCacheName[] = "llfile.dircache";
+
+static const size_t sEntryHead = sizeof(DWORD) + 3 * sizeof(FILETIME) + 3 * sizeof(DWORD) + sizeof(WORD);
+
+//-----------------------------------------------------------------------------
+template <typename TT>
+inline void Append(std::vector<BYTE>& data, const TT& value)
+{
+    const BYTE* pValue = (const BYTE*)&value;
+    data.insert(data.end(), pValue, pValue + sizeof(value));
+}
+
+//-----------------------------------------------------------------------------
+// Read value at offset and advance, false if past end.
+template <typename TT>
+inline bool Extract(const BYTE* pData, size_t dataLen, size_t& offset, TT& value)
+{
+    if (offset + sizeof(value) > dataLen)
+        return false;
+    memcpy(&value, pData + offset, sizeof(value));
+    offset += sizeof(value);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+DirCache::DirCache() :
+    m_dirty(false),
+    m_hits(0),
+    m_misses(0)
+{
+}
+
+//-----------------------------------------------------------------------------
+DirCache::~DirCache()
+{
+    Save();
+}
+
+//-----------------------------------------------------------------------------
+bool DirCache::Open(const char* cacheDir)
+{
+    std::string dir;
+    if (cacheDir != NULL && *cacheDir != '\0')
+    {
+        dir = cacheDir;
+    }
+    else
+    {
+        char tempDir[MAX_PATH];
+        DWORD len = GetTempPath(ARRAYSIZE(tempDir), tempDir);
+        if (len == 0 || len >= ARRAYSIZE(tempDir))
+            return false;
+        dir = tempDir;
+        dir += "llfile";
+    }
+
+    CreateDirectory(dir.c_str(), NULL);
+    if (dir.back() != '\\')
+        dir += '\\';
+    m_path = dir + sCacheName;
+
+    Load();
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// Index snapshot file, an unreadable or foreign file is treated as empty.
+bool DirCache::Load()
+{
+    m_dirs.clear();
+    if (!m_mapFile.Open(m_path.c_str()))
+        return false;
+
+    SIZE_T viewLen = 0;
+    const BYTE* pView = (const BYTE*)m_mapFile.MapView(0, viewLen);
+    if (pView == NULL)
+        return false;
+
+    size_t offset = 0;
+    char   magic[4];
+    DWORD  version = 0;
+    DWORD  dirCnt = 0;
+    if (!Extract(pView, viewLen, offset, magic) || memcmp(magic, sMagic, sizeof(magic)) != 0
+        || !Extract(pView, viewLen, offset, version) || version != sVersion
+        || !Extract(pView, viewLen, offset, dirCnt))
+        return false;
+
+    for (DWORD dirIdx = 0; dirIdx != dirCnt; dirIdx++)
+    {
+        WORD    pathLen;
+        Record  record;
+        if (!Extract(pView, viewLen, offset, pathLen) || offset + pathLen > viewLen)
+            break;
+        std::string dirPath((const char*)pView + offset, pathLen);
+        offset += pathLen;
+
+        if (!Extract(pView, viewLen, offset, record.stamp)
+            || !Extract(pView, viewLen, offset, record.dataLen)
+            || offset + record.dataLen > viewLen)
+            break;
+        record.pData = pView + offset;
+        offset += record.dataLen;
+
+        m_dirs[dirPath] = record;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+bool DirCache::Save()
+{
+    if (!IsOpen())
+        return false;
+
+    bool saved = !m_dirty;
+    if (m_dirty)
+    {
+        std::string tmpPath = m_path + ".tmp";
+        FILE* fout = NULL;
+        if (fopen_s(&fout, tmpPath.c_str(), "wb") == 0 && fout != NULL)
+        {
+            DWORD dirCnt = (DWORD)m_dirs.size();
+            bool ok = fwrite(sMagic, sizeof(sMagic), 1, fout) == 1
+                && fwrite(&sVersion, sizeof(sVersion), 1, fout) == 1
+                && fwrite(&dirCnt, sizeof(dirCnt), 1, fout) == 1;
+
+            RecordMap::const_iterator iter;
+            for (iter = m_dirs.begin(); ok && iter != m_dirs.end(); ++iter)
+            {
+                WORD pathLen = (WORD)iter->first.length();
+                const Record& record = iter->second;
+                ok = fwrite(&pathLen, sizeof(pathLen), 1, fout) == 1
+                    && fwrite(iter->first.c_str(), pathLen, 1, fout) == 1
+                    && fwrite(&record.stamp, sizeof(record.stamp), 1, fout) == 1
+                    && fwrite(&record.dataLen, sizeof(record.dataLen), 1, fout) == 1
+                    && (record.dataLen == 0 || fwrite(record.pData, record.dataLen, 1, fout) == 1);
+            }
+            ok = (fclose(fout) == 0) && ok;
+
+            // Records point into the mapped file, release it before replacing it.
+            m_dirs.clear();
+            m_mapFile.Close();
+            saved = ok && MoveFileEx(tmpPath.c_str(), m_path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+            if (!saved)
+                DeleteFile(tmpPath.c_str());
+        }
+    }
+
+    m_dirs.clear();
+    m_mapFile.Close();
+    m_path.clear();
+    m_dirty = false;
+    return saved;
+}
+
+//-----------------------------------------------------------------------------
+bool DirCache::GetStamp(const char* dirPath, Stamp& stamp)
+{
+    WIN32_FILE_ATTRIBUTE_DATA attrData;
+    if (!GetFileAttributesEx(DirReader::ExtendedPath(dirPath).c_str(), GetFileExInfoStandard, &attrData)
+        || (attrData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+        return false;
+
+    stamp.lastWrite = attrData.ftLastWriteTime;
+    stamp.creation  = attrData.ftCreationTime;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+bool DirCache::Find(const std::string& dirPath, const Stamp& stamp, std::vector<BYTE>& data)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    RecordMap::const_iterator iter = m_dirs.find(dirPath);
+    if (iter == m_dirs.end()
+        || CompareFileTime(&iter->second.stamp.lastWrite, &stamp.lastWrite) != 0
+        || CompareFileTime(&iter->second.stamp.creation, &stamp.creation) != 0)
+    {
+        m_misses++;
+        return false;
+    }
+
+    m_hits++;
+    data.assign(iter->second.pData, iter->second.pData + iter->second.dataLen);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+void DirCache::Store(const std::string& dirPath, const Stamp& stamp, const std::vector<BYTE>& data)
+{
+    if (dirPath.length() > 0xffff)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Record& record = m_dirs[dirPath];
+    record.stamp = stamp;
+    record.owned = data;
+    record.pData = record.owned.empty() ? NULL : &record.owned[0];
+    record.dataLen = (DWORD)record.owned.size();
+    m_dirty = true;
+}
+
+//-----------------------------------------------------------------------------
+void DirCache::Encode(const WIN32_FIND_DATA& fileData, std::vector<BYTE>& data)
+{
+    WORD nameLen = (WORD)strlen(fileData.cFileName);
+
+    Append(data, fileData.dwFileAttributes);
+    Append(data, fileData.ftCreationTime);
+    Append(data, fileData.ftLastAccessTime);
+    Append(data, fileData.ftLastWriteTime);
+    Append(data, fileData.nFileSizeHigh);
+    Append(data, fileData.nFileSizeLow);
+    Append(data, fileData.dwReserved0);
+    Append(data, nameLen);
+    data.insert(data.end(), (const BYTE*)fileData.cFileName, (const BYTE*)fileData.cFileName + nameLen);
+}
+
+//-----------------------------------------------------------------------------
+bool DirCache::Decode(const std::vector<BYTE>& data, size_t& offset, WIN32_FIND_DATA& fileData)
+{
+    if (offset + sEntryHead > data.size())
+        return false;
+
+    const BYTE* pData = &data[0];
+    WORD nameLen;
+    Extract(pData, data.size(), offset, fileData.dwFileAttributes);
+    Extract(pData, data.size(), offset, fileData.ftCreationTime);
+    Extract(pData, data.size(), offset, fileData.ftLastAccessTime);
+    Extract(pData, data.size(), offset, fileData.ftLastWriteTime);
+    Extract(pData, data.size(), offset, fileData.nFileSizeHigh);
+    Extract(pData, data.size(), offset, fileData.nFileSizeLow);
+    Extract(pData, data.size(), offset, fileData.dwReserved0);
+    Extract(pData, data.size(), offset, nameLen);
+    if (nameLen >= ARRAYSIZE(fileData.cFileName) || offset + nameLen > data.size())
+        return false;
+
+    memcpy(fileData.cFileName, pData + offset, nameLen);
+    fileData.cFileName[nameLen] = '\0';
+    fileData.cAlternateFileName[0] = '\0';
+    fileData.dwReserved1 = 0;
+    offset += nameLen;
+    return true;
+}
@@ -0,0 +1,112 @@
+//-----------------------------------------------------------------------------
+// DirCache - Persistent snapshot of directory entries
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <unordered_map>
+
+#include "MemMapFile.h"
+
+//-----------------------------------------------------------------------------
+// Snapshot of directory entries kept in a file between runs.
+//
+// Each directory is stored with a stamp (its last write and creation time).
+// The last write time of a directory changes when an entry is added, removed
+// or renamed, so a directory whose stamp still matches is replayed from the
+// snapshot instead of being read again. Size and time changes of a file do not
+// touch its directory, so replayed file details can be older than the disk.
+//
+// The snapshot file is memory mapped on Open and rewritten by Save.
+// Find and Store may be called from several scan threads.
+class DirCache
+{
+public:
+    struct Stamp
+    {
+        FILETIME    lastWrite;
+        FILETIME    creation;
+    };
+
+    DirCache();
+    ~DirCache();
+
+    // Load snapshot from cacheDir, created if missing. NULL or "" uses %TEMP%\llfile.
+    bool Open(const char* cacheDir);
+    // Write snapshot back if anything changed, cache is closed afterwards.
+    bool Save();
+    bool IsOpen() const
+    { return !m_path.empty(); }
+
+    // Get stamp of directory, dirPath may end with a slash.
+    static bool GetStamp(const char* dirPath, Stamp& stamp);
+
+    // Return true and copy encoded entries to data if snapshot of dirPath matches stamp.
+    bool Find(const std::string& dirPath, const Stamp& stamp, std::vector<BYTE>& data);
+    // Replace snapshot of dirPath.
+    void Store(const std::string& dirPath, const Stamp& stamp, const std::vector<BYTE>& data);
+
+    // Compact entry encoding used by Find and Store.
+    static void Encode(const WIN32_FIND_DATA& fileData, std::vector<BYTE>& data);
+    static bool Decode(const std::vector<BYTE>& data, size_t& offset, WIN32_FIND_DATA& fileData);
+
+    unsigned Hits() const
+    { return m_hits; }
+    unsigned Misses() const
+    { return m_misses; }
+    size_t Size() const
+    { return m_dirs.size(); }
+
+private:
+    DirCache(const DirCache&);
+    DirCache& operator=(const DirCache&);
+
+    struct Record
+    {
+        Stamp       stamp;
+        const BYTE* pData;          // entries in mapped snapshot, or &owned[0]
+        DWORD       dataLen;
+        std::vector<BYTE> owned;    // entries stored this run
+    };
+    typedef std::unordered_map<std::string, Record> RecordMap;
+
+    bool Load();
+
+    std::string     m_path;         // snapshot file
+    MemMapFile      m_mapFile;
+    RecordMap       m_dirs;
+    std::mutex      m_mutex;
+    bool            m_dirty;
+    unsigned        m_hits;
+    unsigned        m_misses;
+};
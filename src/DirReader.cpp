@@ -0,0 +1,324 @@
+//-----------------------------------------------------------------------------
+// DirReader - Read directory entries in large batches.
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include <string>
+#include <memory>
+
+#include "DirReader.h"
+
+DirReader::Method DirReader::sMethod = DirReader::eDirInfo;
+std::atomic<ULONGLONG> DirReader::sSysCalls(0);
+
+static const DWORD sNoEntry = (DWORD)-1;
+static const size_t sBatchSize = 64 * 1024;
+
+// Batch buffers are recycled per thread, one is in use per open directory level.
+// The list owns the idle buffers, so they are freed when the thread exits.
+typedef std::vector<std::unique_ptr<std::vector<BYTE>>> BufferList;
+static thread_local BufferList sFreeBuffers;
+static const size_t sMaxFreeBuffers = 64;
+
+//-----------------------------------------------------------------------------
+static std::vector<BYTE>* GetBuffer()
+{
+    if (!sFreeBuffers.empty())
+    {
+        std::vector<BYTE>* pBuffer = sFreeBuffers.back().release();
+        sFreeBuffers.pop_back();
+        return pBuffer;
+    }
+    return new std::vector<BYTE>(sBatchSize);
+}
+
+//-----------------------------------------------------------------------------
+static void FreeBuffer(std::vector<BYTE>* pBuffer)
+{
+    std::unique_ptr<std::vector<BYTE>> buffer(pBuffer);
+    if (sFreeBuffers.size() < sMaxFreeBuffers)
+        sFreeBuffers.push_back(std::move(buffer));
+}
+
+//-----------------------------------------------------------------------------
+inline FILETIME ToFileTime(const LARGE_INTEGER& time)
+{
+    FILETIME fileTime;
+    fileTime.dwLowDateTime  = time.LowPart;
+    fileTime.dwHighDateTime = (DWORD)time.HighPart;
+    return fileTime;
+}
+
+//-----------------------------------------------------------------------------
+DirReader::DirReader() :
+    m_method(sMethod),
+    m_handle(INVALID_HANDLE_VALUE),
+    m_error(0),
+    m_nameError(0),
+    m_haveFirst(false),
+    m_buffer(NULL),
+    m_offset(sNoEntry),
+    m_cache(NULL),
+    m_replay(false),
+    m_cacheOffset(0)
+{
+}
+
+//-----------------------------------------------------------------------------
+DirReader::~DirReader()
+{
+    Close();
+}
+
+//-----------------------------------------------------------------------------
+// Paths of MAX_PATH or more need the \\?\ prefix, which only takes a full path.
+std::string DirReader::ExtendedPath(const char* path)
+{
+    if (strlen(path) < MAX_PATH || strncmp(path, "\\\\?\\", 4) == 0)
+        return path;
+
+    DWORD fullLen = GetFullPathName(path, 0, NULL, NULL);
+    std::string fullPath(fullLen, '\0');
+    fullLen = GetFullPathName(path, fullLen, &fullPath[0], NULL);
+    if (fullLen == 0 || fullLen >= fullPath.length())
+        return path;
+    fullPath.resize(fullLen);
+
+    if (fullPath.compare(0, 2, "\\\\") == 0)
+        return "\\\\?\\UNC" + fullPath.substr(1);     // \\host\share => \\?\UNC\host\share
+    return "\\\\?\\" + fullPath;
+}
+
+//-----------------------------------------------------------------------------
+bool DirReader::Open(const char* pSearchPath, DirCache* pCache)
+{
+    Close();
+    m_error = 0;
+    m_nameError = 0;
+
+    size_t searchLen = strlen(pSearchPath);
+    if (pCache != NULL && searchLen != 0 && pSearchPath[searchLen-1] == '*')
+    {
+        // Directory stamp is taken before reading so a change while reading is not missed.
+        m_cacheDir.assign(pSearchPath, searchLen - 1);
+        sSysCalls++;
+        if (DirCache::GetStamp(m_cacheDir.c_str(), m_stamp))
+        {
+            if (pCache->Find(m_cacheDir, m_stamp, m_cacheData))
+            {
+                m_replay = true;
+                m_cacheOffset = 0;
+                return true;
+            }
+            m_cache = pCache;
+            m_cacheData.clear();
+        }
+    }
+
+    std::string extPath = ExtendedPath(pSearchPath);
+    const char* searchPath = extPath.c_str();
+    size_t len = extPath.length();
+    if (sMethod != eDirInfo || len < 2 || searchPath[len-1] != '*' || searchPath[len-2] != '\\')
+        return OpenFind(searchPath, (sMethod == eFindFile) ? eFindFile : eFindEx);
+
+    // Open directory, keep trailing slash so "c:\" opens the root.
+    std::string dirPath(searchPath, len - 1);
+    sSysCalls++;
+    m_handle = CreateFile(dirPath.c_str(), FILE_LIST_DIRECTORY,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+
+    if (m_handle != INVALID_HANDLE_VALUE)
+    {
+        m_method = eDirInfo;
+        m_buffer = GetBuffer();
+        if (ReadBatch())
+            return true;
+
+        DWORD error = m_error;
+        Close();
+        if (error == ERROR_NO_MORE_FILES)
+        {
+            // Empty (root) directory, FindFirstFile reports it as not found.
+            m_error = ERROR_FILE_NOT_FOUND;
+            return false;
+        }
+    }
+
+    // Access limited or file system does not support batch query.
+    return OpenFind(searchPath, eFindEx);
+}
+
+//-----------------------------------------------------------------------------
+bool DirReader::OpenFind(const char* searchPath, Method method)
+{
+    m_method = method;
+    sSysCalls++;
+    if (method == eFindEx)
+        m_handle = FindFirstFileEx(searchPath, FindExInfoBasic, &m_first,
+            FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+    else
+        m_handle = FindFirstFile(searchPath, &m_first);
+
+    if (m_handle == INVALID_HANDLE_VALUE)
+    {
+        m_error = GetLastError();
+        return false;
+    }
+
+    m_haveFirst = true;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+bool DirReader::ReadBatch()
+{
+    m_offset = sNoEntry;
+    sSysCalls++;
+    if (!GetFileInformationByHandleEx(m_handle, FileFullDirectoryInfo,
+            &(*m_buffer)[0], (DWORD)m_buffer->size()))
+    {
+        m_error = GetLastError();
+        return false;
+    }
+
+    m_offset = 0;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+bool DirReader::Next(WIN32_FIND_DATA& fileData)
+{
+    if (m_replay)
+    {
+        if (DirCache::Decode(m_cacheData, m_cacheOffset, fileData))
+            return true;
+        m_error = ERROR_NO_MORE_FILES;
+        m_replay = false;
+        return false;
+    }
+
+    bool found = ReadNext(fileData);
+    if (m_cache != NULL)
+    {
+        // Snapshot only directories read to the end.
+        if (found)
+            DirCache::Encode(fileData, m_cacheData);
+        else if (m_error == ERROR_NO_MORE_FILES)
+            m_cache->Store(m_cacheDir, m_stamp, m_cacheData);
+        if (!found)
+            m_cache = NULL;
+    }
+    return found;
+}
+
+//-----------------------------------------------------------------------------
+bool DirReader::ReadNext(WIN32_FIND_DATA& fileData)
+{
+    if (m_handle == INVALID_HANDLE_VALUE)
+        return false;
+
+    if (m_method != eDirInfo)
+    {
+        if (m_haveFirst)
+        {
+            fileData = m_first;
+            m_haveFirst = false;
+            return true;
+        }
+        sSysCalls++;
+        if (FindNextFile(m_handle, &fileData) != 0)
+            return true;
+        m_error = GetLastError();
+        return false;
+    }
+
+    // Names which do not convert to the ANSI code page are skipped, an empty
+    // name would look like a subdirectory and be scanned again. The directory
+    // then ends with the conversion error instead of ERROR_NO_MORE_FILES.
+    const FILE_FULL_DIR_INFO* pInfo;
+    for (;;)
+    {
+        if (m_offset == sNoEntry && !ReadBatch())
+        {
+            if (m_error == ERROR_NO_MORE_FILES && m_nameError != 0)
+                m_error = m_nameError;
+            return false;
+        }
+
+        pInfo = (const FILE_FULL_DIR_INFO*)(&(*m_buffer)[0] + m_offset);
+        m_offset = (pInfo->NextEntryOffset != 0) ? m_offset + pInfo->NextEntryOffset : sNoEntry;
+
+        int nameLen = WideCharToMultiByte(CP_ACP, 0,
+            pInfo->FileName, (int)(pInfo->FileNameLength / sizeof(WCHAR)),
+            fileData.cFileName, ARRAYSIZE(fileData.cFileName) - 1, NULL, NULL);
+        if (nameLen > 0)
+        {
+            fileData.cFileName[nameLen] = '\0';
+            break;
+        }
+        m_nameError = GetLastError();
+    }
+
+    fileData.dwFileAttributes = pInfo->FileAttributes;
+    fileData.ftCreationTime   = ToFileTime(pInfo->CreationTime);
+    fileData.ftLastAccessTime = ToFileTime(pInfo->LastAccessTime);
+    fileData.ftLastWriteTime  = ToFileTime(pInfo->LastWriteTime);
+    fileData.nFileSizeHigh    = (DWORD)pInfo->EndOfFile.HighPart;
+    fileData.nFileSizeLow     = pInfo->EndOfFile.LowPart;
+    // EaSize holds the reparse tag for reparse points, same as FindFirstFile.
+    fileData.dwReserved0 = (pInfo->FileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) ? pInfo->EaSize : 0;
+    fileData.dwReserved1 = 0;
+    fileData.cAlternateFileName[0] = '\0';
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+void DirReader::Close()
+{
+    m_cache = NULL;
+    m_replay = false;
+    if (m_handle != INVALID_HANDLE_VALUE)
+    {
+        sSysCalls++;
+        if (m_method == eDirInfo)
+            CloseHandle(m_handle);
+        else
+            FindClose(m_handle);
+        m_handle = INVALID_HANDLE_VALUE;
+    }
+
+    if (m_buffer != NULL)
+    {
+        FreeBuffer(m_buffer);
+        m_buffer = NULL;
+    }
+
+    m_haveFirst = false;
+    m_offset = sNoEntry;
+}
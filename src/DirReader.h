@@ -0,0 +1,108 @@
+//-----------------------------------------------------------------------------
+// DirReader - Read directory entries in large batches.
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+#include <vector>
+#include <string>
+#include <atomic>
+
+#include "DirCache.h"
+
+//-----------------------------------------------------------------------------
+// Read all entries of one directory.
+//
+// eDirInfo  - Open the directory once and pull entries in large batches with
+//             GetFileInformationByHandleEx(FileFullDirectoryInfo). Attributes,
+//             size and times come with each batch, no per-entry call or short name.
+// eFindEx   - FindFirstFileEx(FindExInfoBasic, FIND_FIRST_EX_LARGE_FETCH).
+// eFindFile - FindFirstFile/FindNextFile (original behavior).
+//
+// eDirInfo falls back to eFindEx if the file system rejects the batch query.
+class DirReader
+{
+public:
+    enum Method { eFindFile, eFindEx, eDirInfo };
+    static Method sMethod;
+
+    DirReader();
+    ~DirReader();
+
+    // searchPath is directory followed by \* (same as FindFirstFile).
+    // Return false if directory can not be read, see Error().
+    // With pCache, entries are replayed from its snapshot if the directory
+    // has not changed, else the entries read are stored to it.
+    bool Open(const char* searchPath, DirCache* pCache = NULL);
+
+    // Return next entry, false at end or error, see Error().
+    bool Next(WIN32_FIND_DATA& fileData);
+
+    // Directory system calls made by all readers (open, read, close), for benchmarks.
+    static ULONGLONG SysCalls()
+    { return sSysCalls; }
+
+    // Last error, ERROR_NO_MORE_FILES after all entries read, or the name
+    // conversion error if an entry was skipped.
+    DWORD Error() const
+    { return m_error; }
+
+    void Close();
+
+    // Return path usable beyond MAX_PATH (\\?\ prefix) if path is that long.
+    static std::string ExtendedPath(const char* path);
+
+private:
+    DirReader(const DirReader&);
+    DirReader& operator=(const DirReader&);
+
+    bool OpenFind(const char* searchPath, Method method);
+    bool ReadBatch();
+    bool ReadNext(WIN32_FIND_DATA& fileData);
+
+    static std::atomic<ULONGLONG> sSysCalls;
+
+    Method      m_method;
+    HANDLE      m_handle;
+    DWORD       m_error;
+    DWORD       m_nameError;        // last entry name which did not convert, 0 if none
+    bool        m_haveFirst;        // FindFirstFile entry not yet returned
+    WIN32_FIND_DATA m_first;
+
+    std::vector<BYTE>* m_buffer;    // eDirInfo batch buffer, reused across readers
+    DWORD       m_offset;           // offset of next entry in m_buffer, or sNoEntry
+
+    DirCache*   m_cache;            // Store entries read to m_cache, NULL if not
+    bool        m_replay;           // Entries come from m_cacheData
+    std::string m_cacheDir;
+    std::vector<BYTE> m_cacheData;  // DirCache encoded entries
+    size_t      m_cacheOffset;
+    DirCache::Stamp m_stamp;        // m_cacheDir when opened
+};
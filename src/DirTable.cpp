@@ -0,0 +1,132 @@
+//-----------------------------------------------------------------------------
+// DirTable - Directory paths stored once as (parent, name).
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include <string.h>
+#include "DirTable.h"
+
+//-----------------------------------------------------------------------------
+DirTable::DirTable() :
+    m_lastId(sNoDir)
+{
+}
+
+//-----------------------------------------------------------------------------
+unsigned DirTable::Add(const char* dirPath)
+{
+    if (m_lastId != sNoDir && m_lastPath == dirPath)
+        return m_lastId;
+
+    unsigned dirId = sNoDir;
+    const char* pName = dirPath;
+    for (;;)
+    {
+        const char* pSlash = strchr(pName, '\\');
+        size_t nameLen = (pSlash != NULL) ? pSlash - pName : strlen(pName);
+        dirId = AddChild(dirId, pName, nameLen);
+        if (pSlash == NULL)
+            break;
+        pName = pSlash + 1;
+    }
+
+    m_lastPath = dirPath;
+    m_lastId = dirId;
+    return dirId;
+}
+
+//-----------------------------------------------------------------------------
+unsigned DirTable::AddChild(unsigned parent, const char* name, size_t nameLen)
+{
+    m_key.assign((const char*)&parent, sizeof(parent));
+    m_key.append(name, nameLen);
+
+    Lookup::const_iterator iter = m_lookup.find(m_key);
+    if (iter != m_lookup.end())
+        return iter->second;
+
+    Node node;
+    node.parent  = parent;
+    node.nameOff = (unsigned)m_names.size();
+    node.nameLen = (unsigned)nameLen;
+    m_names.insert(m_names.end(), name, name + nameLen);
+    m_names.push_back('\0');
+
+    unsigned dirId = (unsigned)m_nodes.size();
+    m_nodes.push_back(node);
+    m_lookup[m_key] = dirId;
+    return dirId;
+}
+
+//-----------------------------------------------------------------------------
+const char* DirTable::GetPath(unsigned dirId, std::string& path) const
+{
+    size_t pathLen = 0;
+    for (unsigned id = dirId; id != sNoDir; id = m_nodes[id].parent)
+        pathLen += m_nodes[id].nameLen + 1;
+
+    path.resize(pathLen == 0 ? 0 : pathLen - 1);
+    for (unsigned id = dirId; id != sNoDir; id = m_nodes[id].parent)
+    {
+        const Node& node = m_nodes[id];
+        pathLen -= node.nameLen + 1;
+        if (pathLen != 0)
+            path[pathLen - 1] = '\\';
+        if (node.nameLen != 0)
+            memcpy(&path[pathLen], &m_names[node.nameOff], node.nameLen);
+    }
+    return path.c_str();
+}
+
+//-----------------------------------------------------------------------------
+size_t DirTable::Bytes() const
+{
+    // Lookup keys hold the name again plus the parent id.
+    return m_nodes.size() * (sizeof(Node) + sizeof(Lookup::value_type) + sizeof(void*) + sizeof(unsigned))
+        + m_names.size() * 2;
+}
+
+//-----------------------------------------------------------------------------
+void DirTable::Clear()
+{
+    m_nodes.clear();
+    m_names.clear();
+    m_lookup.clear();
+    m_lastPath.clear();
+    m_lastId = sNoDir;
+}
+
+//-----------------------------------------------------------------------------
+void DirTable::Swap(DirTable& other)
+{
+    m_nodes.swap(other.m_nodes);
+    m_names.swap(other.m_names);
+    m_lookup.swap(other.m_lookup);
+    m_lastPath.swap(other.m_lastPath);
+    std::swap(m_lastId, other.m_lastId);
+}
@@ -0,0 +1,90 @@
+//-----------------------------------------------------------------------------
+// DirTable - Directory paths stored once as (parent, name).
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+//-----------------------------------------------------------------------------
+// Table of directory paths, each directory is stored once as its parent id
+// plus its own name, so entries only need a 32-bit dir id.
+//
+// Paths are split on '\' and joined back exactly, so GetPath returns the
+// same string given to Add. Full paths are only built on request, into a
+// buffer supplied by the caller.
+class DirTable
+{
+public:
+    static const unsigned sNoDir = unsigned(-1);
+
+    DirTable();
+
+    // Return id of dirPath, adding it and any missing parents.
+    unsigned Add(const char* dirPath);
+
+    // Set path to full path of dirId and return path.c_str().
+    const char* GetPath(unsigned dirId, std::string& path) const;
+
+    unsigned Parent(unsigned dirId) const
+    { return m_nodes[dirId].parent; }
+    const char* Name(unsigned dirId) const
+    { return &m_names[m_nodes[dirId].nameOff]; }
+
+    // Approximate memory used by the table.
+    size_t Bytes() const;
+    size_t Size() const
+    { return m_nodes.size(); }
+
+    void Clear();
+    void Swap(DirTable& other);
+
+private:
+    unsigned AddChild(unsigned parent, const char* name, size_t nameLen);
+
+    struct Node
+    {
+        unsigned    parent;
+        unsigned    nameOff;    // nul terminated name in m_names
+        unsigned    nameLen;
+    };
+    typedef std::unordered_map<std::string, unsigned> Lookup;   // parent id + name
+
+    std::vector<Node>   m_nodes;
+    std::vector<char>   m_names;
+    Lookup              m_lookup;
+    std::string         m_key;
+
+    // Consecutive Add calls are usually for the same directory.
+    std::string         m_lastPath;
+    unsigned            m_lastId;
+};
@@ -0,0 +1,115 @@
+//-----------------------------------------------------------------------------
+// FileEntry - Compact directory entry record.
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "FileEntry.h"
+
+//-----------------------------------------------------------------------------
+void FileEntryList::Add(const FileEntry& entry)
+{
+    m_entries.push_back(entry);
+    m_entries.back().name = m_names.StrDup(entry.name, entry.nameLen);
+}
+
+//-----------------------------------------------------------------------------
+void FileEntryList::KeepLast()
+{
+    if (m_entries.empty())
+        return;
+
+    FileEntry last = m_entries.back();
+    Arena names(256);
+    last.name = names.StrDup(last.name, last.nameLen);
+    m_entries.assign(1, last);
+    m_entries.shrink_to_fit();
+    m_names.Swap(names);
+}
+
+//-----------------------------------------------------------------------------
+void FileEntryList::Clear()
+{
+    m_entries.clear();
+    m_names.Reset();
+}
+
+#ifdef _WIN32
+//-----------------------------------------------------------------------------
+inline uint64_t ToValue(DWORD high, DWORD low)
+{
+    return ((uint64_t)high << 32) | low;
+}
+
+//-----------------------------------------------------------------------------
+inline FILETIME ToFileTime(uint64_t value)
+{
+    FILETIME fileTime;
+    fileTime.dwLowDateTime  = (DWORD)value;
+    fileTime.dwHighDateTime = (DWORD)(value >> 32);
+    return fileTime;
+}
+
+//-----------------------------------------------------------------------------
+void ToFileEntry(const WIN32_FIND_DATA& findData, FileEntry& entry)
+{
+    entry.name = findData.cFileName;
+    entry.nameLen = (uint16_t)strlen(findData.cFileName);
+    entry.attributes = findData.dwFileAttributes;
+    entry.reparseTag = (findData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) ? findData.dwReserved0 : 0;
+    if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+        entry.type = FileEntry::eDir;
+    else if (entry.reparseTag != 0 && IsReparseTagNameSurrogate(entry.reparseTag))
+        entry.type = FileEntry::eLink;
+    else if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DEVICE) != 0)
+        entry.type = FileEntry::eOther;
+    else
+        entry.type = FileEntry::eFile;
+    entry.size  = ToValue(findData.nFileSizeHigh, findData.nFileSizeLow);
+    entry.ctime = ToValue(findData.ftCreationTime.dwHighDateTime, findData.ftCreationTime.dwLowDateTime);
+    entry.atime = ToValue(findData.ftLastAccessTime.dwHighDateTime, findData.ftLastAccessTime.dwLowDateTime);
+    entry.mtime = ToValue(findData.ftLastWriteTime.dwHighDateTime, findData.ftLastWriteTime.dwLowDateTime);
+    entry.fileId = 0;
+}
+
+//-----------------------------------------------------------------------------
+void ToFindData(const FileEntry& entry, WIN32_FIND_DATA& findData)
+{
+    findData.dwFileAttributes = entry.attributes;
+    findData.ftCreationTime   = ToFileTime(entry.ctime);
+    findData.ftLastAccessTime = ToFileTime(entry.atime);
+    findData.ftLastWriteTime  = ToFileTime(entry.mtime);
+    findData.nFileSizeHigh    = (DWORD)(entry.size >> 32);
+    findData.nFileSizeLow     = (DWORD)entry.size;
+    findData.dwReserved0      = entry.reparseTag;
+    findData.dwReserved1      = 0;
+    size_t nameLen = (entry.nameLen < ARRAYSIZE(findData.cFileName)) ? entry.nameLen : ARRAYSIZE(findData.cFileName) - 1;
+    memcpy(findData.cFileName, entry.name, nameLen);
+    findData.cFileName[nameLen] = '\0';
+    findData.cAlternateFileName[0] = '\0';
+}
+#endif
@@ -0,0 +1,104 @@
+//-----------------------------------------------------------------------------
+// FileEntry - Compact directory entry record.
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "Arena.h"
+
+//-----------------------------------------------------------------------------
+// Compact, platform neutral directory entry.
+//
+// Holds what a scan reads for an entry without the MAX_PATH name buffers of
+// WIN32_FIND_DATA. The name is a view, kept by whoever owns the entry (a
+// FileEntryList, a FIND_DATA being read or a sort arena). Times are in
+// FILETIME units, 100ns since 1601.
+struct FileEntry
+{
+    enum Type { eFile, eDir, eLink, eOther };
+
+    const char* name;           // nul terminated
+    uint16_t    nameLen;
+    uint8_t     type;           // Type, eLink for file links, eDir for all directories
+    uint32_t    attributes;     // FILE_ATTRIBUTE_ bits
+    uint32_t    reparseTag;     // if attributes has FILE_ATTRIBUTE_REPARSE_POINT
+    uint64_t    size;
+    uint64_t    ctime;
+    uint64_t    atime;
+    uint64_t    mtime;
+    uint64_t    fileId;         // 0 if unknown
+
+    bool IsDir() const
+    { return type == eDir; }
+    // "." and ".." entries.
+    bool IsDots() const
+    { return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')); }
+};
+
+//-----------------------------------------------------------------------------
+// Entries of one directory, names are copied once to an arena.
+class FileEntryList
+{
+public:
+    // Small blocks, most directories have few entries.
+    FileEntryList() : m_names(4 * 1024)
+    { }
+
+    size_t Size() const
+    { return m_entries.size(); }
+    bool Empty() const
+    { return m_entries.empty(); }
+    const FileEntry& operator[](size_t idx) const
+    { return m_entries[idx]; }
+    const FileEntry& Back() const
+    { return m_entries.back(); }
+
+    // Add copy of entry and its name.
+    void Add(const FileEntry& entry);
+    // Keep only the last entry.
+    void KeepLast();
+    void Clear();
+
+private:
+    std::vector<FileEntry>  m_entries;
+    Arena                   m_names;
+};
+
+#ifdef _WIN32
+#include <windows.h>
+
+// Entry of findData, name views findData.cFileName.
+void ToFileEntry(const WIN32_FIND_DATA& findData, FileEntry& entry);
+
+// Fill findData for code still using WIN32_FIND_DATA, name is truncated to MAX_PATH.
+void ToFindData(const FileEntry& entry, WIN32_FIND_DATA& findData);
+#endif
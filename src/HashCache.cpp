@@ -0,0 +1,275 @@
+//-----------------------------------------------------------------------------
+// HashCache - Persistent file content hashes
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <vector>
+
+#include "HashCache.h"
+
+// Cache file layout
+//      header   "LLHC" version slotCount usedCount
+//      slots    slotCount records of Key and digest, empty if key.used is 0
+static const char sMagic[4] = { 'L', 'L', 'H', 'C' };
+static const DWORD sVersion = 1;
+static const char sCacheName[] = "llfile.hashcache";
+static const DWORD sMinSlots = 1024;
+
+struct CacheHeader
+{
+    char    magic[4];
+    DWORD   version;
+    DWORD   slotCnt;
+    DWORD   used;
+};
+
+//-----------------------------------------------------------------------------
+HashCache::HashCache() :
+    m_slots(NULL),
+    m_slotCnt(0),
+    m_used(0),
+    m_hits(0),
+    m_misses(0)
+{
+}
+
+//-----------------------------------------------------------------------------
+HashCache::~HashCache()
+{
+    Save();
+}
+
+//-----------------------------------------------------------------------------
+bool HashCache::Open(const char* cacheDir)
+{
+    std::string dir;
+    if (cacheDir != NULL && *cacheDir != '\0')
+    {
+        dir = cacheDir;
+    }
+    else
+    {
+        char tempDir[MAX_PATH];
+        DWORD len = GetTempPath(ARRAYSIZE(tempDir), tempDir);
+        if (len == 0 || len >= ARRAYSIZE(tempDir))
+            return false;
+        dir = tempDir;
+        dir += "llfile";
+    }
+
+    CreateDirectory(dir.c_str(), NULL);
+    if (dir.back() != '\\')
+        dir += '\\';
+    m_path = dir + sCacheName;
+
+    Load();
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// Map cache table, an unreadable or foreign file is treated as empty.
+bool HashCache::Load()
+{
+    m_slots = NULL;
+    m_slotCnt = m_used = 0;
+    if (!m_mapFile.Open(m_path.c_str()))
+        return false;
+
+    SIZE_T viewLen = 0;
+    const BYTE* pView = (const BYTE*)m_mapFile.MapView(0, viewLen);
+    if (pView == NULL || viewLen < sizeof(CacheHeader))
+        return false;
+
+    CacheHeader header;
+    memcpy(&header, pView, sizeof(header));
+    if (memcmp(header.magic, sMagic, sizeof(sMagic)) != 0
+        || header.version != sVersion
+        || header.slotCnt == 0
+        || (header.slotCnt & (header.slotCnt - 1)) != 0
+        || header.used > header.slotCnt / 2
+        || viewLen < sizeof(header) + (ULONGLONG)header.slotCnt * sizeof(Record))
+        return false;
+
+    m_slots = (const Record*)(pView + sizeof(header));
+    m_slotCnt = header.slotCnt;
+    m_used = header.used;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+bool HashCache::Save()
+{
+    if (!IsOpen())
+        return false;
+
+    bool saved = m_added.empty();
+    if (!m_added.empty())
+    {
+        // New table at most half full, hashes stored this run replace
+        // mapped ones of the same file.
+        DWORD slotCnt = sMinSlots;
+        while (slotCnt / 2 < m_used + m_added.size())
+            slotCnt *= 2;
+
+        std::vector<Record> slots(slotCnt);
+        memset(slots.data(), 0, slotCnt * sizeof(Record));
+        DWORD used = 0;
+
+        RecordMap::const_iterator iter;
+        for (iter = m_added.begin(); iter != m_added.end(); ++iter)
+        {
+            slots[(size_t)(Probe(slots.data(), slotCnt, iter->first) - slots.data())] = iter->second;
+            used++;
+        }
+        for (DWORD slot = 0; slot != m_slotCnt && used < slotCnt / 2; slot++)
+        {
+            const Record& record = m_slots[slot];
+            if (record.key.used == 0)
+                continue;
+            Record& newRecord = slots[(size_t)(Probe(slots.data(), slotCnt, record.key) - slots.data())];
+            if (newRecord.key.used == 0)
+            {
+                newRecord = record;
+                used++;
+            }
+        }
+
+        std::string tmpPath = m_path + ".tmp";
+        FILE* fout = NULL;
+        if (fopen_s(&fout, tmpPath.c_str(), "wb") == 0 && fout != NULL)
+        {
+            CacheHeader header;
+            memcpy(header.magic, sMagic, sizeof(sMagic));
+            header.version = sVersion;
+            header.slotCnt = slotCnt;
+            header.used = used;
+            bool ok = fwrite(&header, sizeof(header), 1, fout) == 1
+                && fwrite(slots.data(), sizeof(Record), slotCnt, fout) == slotCnt;
+            ok = (fclose(fout) == 0) && ok;
+
+            // Release the mapped table before replacing it.
+            m_slots = NULL;
+            m_mapFile.Close();
+            saved = ok && MoveFileEx(tmpPath.c_str(), m_path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+            if (!saved)
+                DeleteFile(tmpPath.c_str());
+        }
+    }
+
+    m_added.clear();
+    m_slots = NULL;
+    m_slotCnt = m_used = 0;
+    m_mapFile.Close();
+    m_path.clear();
+    return saved;
+}
+
+//-----------------------------------------------------------------------------
+bool HashCache::GetKey(HANDLE hFile, ULONGLONG maxBytes, Key& key)
+{
+    BY_HANDLE_FILE_INFORMATION fileInfo;
+    if (!GetFileInformationByHandle(hFile, &fileInfo))
+        return false;
+
+    key.fileId = ((ULONGLONG)fileInfo.nFileIndexHigh << 32) | fileInfo.nFileIndexLow;
+    key.volume = fileInfo.dwVolumeSerialNumber;
+    key.used = 1;
+    key.maxBytes = maxBytes;
+    key.size = ((ULONGLONG)fileInfo.nFileSizeHigh << 32) | fileInfo.nFileSizeLow;
+    key.lastWrite = fileInfo.ftLastWriteTime;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+bool HashCache::Find(const Key& key, BYTE digest[sDigestBytes])
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const Record* pRecord = NULL;
+    RecordMap::const_iterator iter = m_added.find(key);
+    if (iter != m_added.end())
+        pRecord = &iter->second;
+    else if (m_slots != NULL)
+        pRecord = Probe(m_slots, m_slotCnt, key);
+
+    if (pRecord == NULL
+        || pRecord->key.used == 0
+        || pRecord->key.size != key.size
+        || CompareFileTime(&pRecord->key.lastWrite, &key.lastWrite) != 0)
+    {
+        m_misses++;
+        return false;
+    }
+
+    m_hits++;
+    memcpy(digest, pRecord->digest, sDigestBytes);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+void HashCache::Store(const Key& key, const BYTE digest[sDigestBytes])
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Record& record = m_added[key];
+    record.key = key;
+    memcpy(record.digest, digest, sDigestBytes);
+}
+
+//-----------------------------------------------------------------------------
+// FNV-1a of the file identity.
+ULONGLONG HashCache::Hash(const Key& key)
+{
+    ULONGLONG values[3] = { key.fileId, key.volume, key.maxBytes };
+    const BYTE* pByte = (const BYTE*)values;
+    ULONGLONG hash = 14695981039346656037ULL;
+    for (unsigned idx = 0; idx != sizeof(values); idx++)
+        hash = (hash ^ pByte[idx]) * 1099511628211ULL;
+    return hash;
+}
+
+//-----------------------------------------------------------------------------
+bool HashCache::SameFile(const Key& left, const Key& right)
+{
+    return left.fileId == right.fileId && left.volume == right.volume && left.maxBytes == right.maxBytes;
+}
+
+//-----------------------------------------------------------------------------
+// Slot of key, or the empty slot ending its probe run. Tables are written
+// at most half full, NULL is only returned for a damaged table.
+const HashCache::Record* HashCache::Probe(const Record* pSlots, DWORD slotCnt, const Key& key)
+{
+    DWORD mask = slotCnt - 1;
+    DWORD slot = (DWORD)Hash(key) & mask;
+    for (DWORD probe = 0; probe != slotCnt; probe++)
+    {
+        if (pSlots[slot].key.used == 0 || SameFile(pSlots[slot].key, key))
+            return &pSlots[slot];
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
@@ -0,0 +1,129 @@
+//-----------------------------------------------------------------------------
+// HashCache - Persistent file content hashes
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <windows.h>
+#include <string>
+#include <mutex>
+#include <unordered_map>
+
+#include "MemMapFile.h"
+
+//-----------------------------------------------------------------------------
+// Content hashes of files kept in a file between runs.
+//
+// A hash is found by file identity (volume serial and file id) and the
+// number of bytes hashed, and is only used while the file size and last
+// write time still match. Looking up an unchanged file costs a metadata
+// read instead of reading its data.
+//
+// The cache file is an open addressing table which is memory mapped on Open
+// and probed in place. Hashes stored during a run are kept in memory and
+// merged into a new table by Save.
+// Find and Store may be called from several compare threads.
+class HashCache
+{
+public:
+    static const unsigned sDigestBytes = 16;
+
+    struct Key
+    {
+        ULONGLONG   fileId;
+        DWORD       volume;
+        DWORD       used;       // non-zero in an occupied table slot
+        ULONGLONG   maxBytes;   // hash of at most maxBytes of the file
+        ULONGLONG   size;
+        FILETIME    lastWrite;
+    };
+
+    HashCache();
+    ~HashCache();
+
+    // Load cache from cacheDir, created if missing. NULL or "" uses %TEMP%\llfile.
+    bool Open(const char* cacheDir);
+    // Write cache back if anything changed, cache is closed afterwards.
+    bool Save();
+    bool IsOpen() const
+    { return !m_path.empty(); }
+
+    // Get key of an open file for a hash of at most maxBytes of it.
+    static bool GetKey(HANDLE hFile, ULONGLONG maxBytes, Key& key);
+
+    // Return true and copy the digest if a hash of the unchanged file is cached.
+    bool Find(const Key& key, BYTE digest[sDigestBytes]);
+    // Replace hash of the file.
+    void Store(const Key& key, const BYTE digest[sDigestBytes]);
+
+    unsigned Hits() const
+    { return m_hits; }
+    unsigned Misses() const
+    { return m_misses; }
+    size_t Size() const
+    { return m_used + m_added.size(); }
+
+private:
+    HashCache(const HashCache&);
+    HashCache& operator=(const HashCache&);
+
+    struct Record
+    {
+        Key         key;
+        BYTE        digest[sDigestBytes];
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const
+        { return (size_t)HashCache::Hash(key); }
+    };
+    struct KeyEqual
+    {
+        bool operator()(const Key& left, const Key& right) const
+        { return HashCache::SameFile(left, right); }
+    };
+    typedef std::unordered_map<Key, Record, KeyHash, KeyEqual> RecordMap;
+
+    static ULONGLONG Hash(const Key& key);
+    static bool SameFile(const Key& left, const Key& right);
+    static const Record* Probe(const Record* pSlots, DWORD slotCnt, const Key& key);
+
+    bool Load();
+
+    std::string     m_path;         // cache file
+    MemMapFile      m_mapFile;
+    const Record*   m_slots;        // table in mapped file
+    DWORD           m_slotCnt;      // power of 2
+    DWORD           m_used;         // occupied slots
+    RecordMap       m_added;        // hashes stored this run
+    std::mutex      m_mutex;
+    unsigned        m_hits;
+    unsigned        m_misses;
+};
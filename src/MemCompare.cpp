@@ -0,0 +1,321 @@
+//-----------------------------------------------------------------------------
+// MemCompare - Find and count differing bytes of two buffers.
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "MemCompare.h"
+
+#include <string.h>
+#include <algorithm>
+
+// SSE2 is part of x64 and of the default x86 target.
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define MEMCMP_SSE2
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define MEMCMP_AVX2_FN      // intrinsics are usable without /arch:AVX2
+#else
+#include <cpuid.h>
+#define MEMCMP_AVX2_FN      __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace MemCompare
+{
+
+typedef unsigned char Byte;
+typedef size_t (*Kernel_fn)(const Byte* data1, const Byte* data2, size_t length);
+
+//-----------------------------------------------------------------------------
+// 8 bytes at a time, also used for the tails of the vector kernels.
+static size_t FirstDiffScalar(const Byte* data1, const Byte* data2, size_t length)
+{
+    size_t pos = 0;
+    for (; pos + 8 <= length; pos += 8)
+    {
+        unsigned long long value1, value2;
+        memcpy(&value1, data1 + pos, 8);
+        memcpy(&value2, data2 + pos, 8);
+        if (value1 != value2)
+            break;
+    }
+    while (pos < length && data1[pos] == data2[pos])
+        pos++;
+    return pos;
+}
+
+//-----------------------------------------------------------------------------
+static size_t CountDiffScalar(const Byte* data1, const Byte* data2, size_t length)
+{
+    const unsigned long long sLow7 = 0x7f7f7f7f7f7f7f7fULL;
+    const unsigned long long sOnes = 0x0101010101010101ULL;
+    size_t count = 0;
+    size_t pos = 0;
+    for (; pos + 8 <= length; pos += 8)
+    {
+        unsigned long long value1, value2;
+        memcpy(&value1, data1 + pos, 8);
+        memcpy(&value2, data2 + pos, 8);
+        unsigned long long diff = value1 ^ value2;
+        // High bit of each byte is set if the byte is not 0, then add them up.
+        unsigned long long nonZero = (((diff & sLow7) + sLow7) | diff) >> 7 & sOnes;
+        count += (size_t)((nonZero * sOnes) >> 56);
+    }
+    for (; pos < length; pos++)
+        count += (data1[pos] != data2[pos]);
+    return count;
+}
+
+#ifdef MEMCMP_SSE2
+//-----------------------------------------------------------------------------
+// Index of lowest set bit, mask is not 0.
+static inline unsigned LowBit(unsigned mask)
+{
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward(&idx, mask);
+    return idx;
+#else
+    return (unsigned)__builtin_ctz(mask);
+#endif
+}
+
+//-----------------------------------------------------------------------------
+static size_t FirstDiffSse2(const Byte* data1, const Byte* data2, size_t length)
+{
+    size_t pos = 0;
+    for (; pos + 64 <= length; pos += 64)
+    {
+        const __m128i* ptr1 = (const __m128i*)(data1 + pos);
+        const __m128i* ptr2 = (const __m128i*)(data2 + pos);
+        __m128i equal = _mm_and_si128(
+            _mm_and_si128(
+                _mm_cmpeq_epi8(_mm_loadu_si128(ptr1 + 0), _mm_loadu_si128(ptr2 + 0)),
+                _mm_cmpeq_epi8(_mm_loadu_si128(ptr1 + 1), _mm_loadu_si128(ptr2 + 1))),
+            _mm_and_si128(
+                _mm_cmpeq_epi8(_mm_loadu_si128(ptr1 + 2), _mm_loadu_si128(ptr2 + 2)),
+                _mm_cmpeq_epi8(_mm_loadu_si128(ptr1 + 3), _mm_loadu_si128(ptr2 + 3))));
+        if (_mm_movemask_epi8(equal) != 0xffff)
+            break;
+    }
+    for (; pos + 16 <= length; pos += 16)
+    {
+        unsigned mask = 0xffff ^ (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(
+            _mm_loadu_si128((const __m128i*)(data1 + pos)),
+            _mm_loadu_si128((const __m128i*)(data2 + pos))));
+        if (mask != 0)
+            return pos + LowBit(mask);
+    }
+    return pos + FirstDiffScalar(data1 + pos, data2 + pos, length - pos);
+}
+
+//-----------------------------------------------------------------------------
+// Equal bytes are counted in byte lanes (cmpeq is -1) for up to 255 vectors,
+// then summed with sad.
+static size_t CountDiffSse2(const Byte* data1, const Byte* data2, size_t length)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t equalCnt = 0;
+    size_t pos = 0;
+    while (pos + 16 <= length)
+    {
+        size_t blockEnd = pos + std::min(length - pos, size_t(255 * 16));
+        __m128i counts = zero;
+        for (; pos + 16 <= blockEnd; pos += 16)
+        {
+            counts = _mm_sub_epi8(counts, _mm_cmpeq_epi8(
+                _mm_loadu_si128((const __m128i*)(data1 + pos)),
+                _mm_loadu_si128((const __m128i*)(data2 + pos))));
+        }
+        __m128i sums = _mm_sad_epu8(counts, zero);
+        equalCnt += (size_t)_mm_cvtsi128_si32(sums) + (size_t)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+    }
+    return (pos - equalCnt) + CountDiffScalar(data1 + pos, data2 + pos, length - pos);
+}
+
+//-----------------------------------------------------------------------------
+MEMCMP_AVX2_FN
+static size_t FirstDiffAvx2(const Byte* data1, const Byte* data2, size_t length)
+{
+    size_t pos = 0;
+    for (; pos + 128 <= length; pos += 128)
+    {
+        const __m256i* ptr1 = (const __m256i*)(data1 + pos);
+        const __m256i* ptr2 = (const __m256i*)(data2 + pos);
+        __m256i equal = _mm256_and_si256(
+            _mm256_and_si256(
+                _mm256_cmpeq_epi8(_mm256_loadu_si256(ptr1 + 0), _mm256_loadu_si256(ptr2 + 0)),
+                _mm256_cmpeq_epi8(_mm256_loadu_si256(ptr1 + 1), _mm256_loadu_si256(ptr2 + 1))),
+            _mm256_and_si256(
+                _mm256_cmpeq_epi8(_mm256_loadu_si256(ptr1 + 2), _mm256_loadu_si256(ptr2 + 2)),
+                _mm256_cmpeq_epi8(_mm256_loadu_si256(ptr1 + 3), _mm256_loadu_si256(ptr2 + 3))));
+        if (_mm256_movemask_epi8(equal) != -1)
+            break;
+    }
+    for (; pos + 32 <= length; pos += 32)
+    {
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+            _mm256_loadu_si256((const __m256i*)(data1 + pos)),
+            _mm256_loadu_si256((const __m256i*)(data2 + pos))));
+        if (mask != 0)
+        {
+            _mm256_zeroupper();
+            return pos + LowBit(mask);
+        }
+    }
+    _mm256_zeroupper();
+    return pos + FirstDiffSse2(data1 + pos, data2 + pos, length - pos);
+}
+
+//-----------------------------------------------------------------------------
+MEMCMP_AVX2_FN
+static size_t CountDiffAvx2(const Byte* data1, const Byte* data2, size_t length)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    size_t equalCnt = 0;
+    size_t pos = 0;
+    while (pos + 32 <= length)
+    {
+        size_t blockEnd = pos + std::min(length - pos, size_t(255 * 32));
+        __m256i counts = zero;
+        for (; pos + 32 <= blockEnd; pos += 32)
+        {
+            counts = _mm256_sub_epi8(counts, _mm256_cmpeq_epi8(
+                _mm256_loadu_si256((const __m256i*)(data1 + pos)),
+                _mm256_loadu_si256((const __m256i*)(data2 + pos))));
+        }
+        __m256i sums = _mm256_sad_epu8(counts, zero);
+        __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+        equalCnt += (size_t)_mm_cvtsi128_si32(sum) + (size_t)_mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+    }
+    _mm256_zeroupper();
+    return (pos - equalCnt) + CountDiffSse2(data1 + pos, data2 + pos, length - pos);
+}
+
+//-----------------------------------------------------------------------------
+// True if the cpu has AVX2 and the os saves the ymm registers.
+static bool HasAvx2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    const int sOsXSave = 1 << 27;
+    const int sAvx = 1 << 28;
+    if ((info[2] & sOsXSave) == 0 || (info[2] & sAvx) == 0 || (_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+//-----------------------------------------------------------------------------
+struct Kernels
+{
+    Kernel_fn   firstDiff;
+    Kernel_fn   countDiff;
+    const char* name;
+};
+
+static Kernels ChooseKernels()
+{
+    Kernels kernels = { FirstDiffScalar, CountDiffScalar, "scalar" };
+#ifdef MEMCMP_SSE2
+    if (HasAvx2())
+    {
+        kernels.firstDiff = FirstDiffAvx2;
+        kernels.countDiff = CountDiffAvx2;
+        kernels.name = "avx2";
+    }
+    else
+    {
+        kernels.firstDiff = FirstDiffSse2;
+        kernels.countDiff = CountDiffSse2;
+        kernels.name = "sse2";
+    }
+#endif
+    return kernels;
+}
+
+static const Kernels& GetKernels()
+{
+    static const Kernels sKernels = ChooseKernels();
+    return sKernels;
+}
+
+//-----------------------------------------------------------------------------
+size_t FirstDiff(const void* data1, const void* data2, size_t length)
+{
+    return GetKernels().firstDiff((const Byte*)data1, (const Byte*)data2, length);
+}
+
+//-----------------------------------------------------------------------------
+size_t CountDiff(const void* data1, const void* data2, size_t length)
+{
+    return GetKernels().countDiff((const Byte*)data1, (const Byte*)data2, length);
+}
+
+//-----------------------------------------------------------------------------
+// Runs of differences are mostly short, 8 bytes at a time is enough.
+size_t FirstSame(const void* data1, const void* data2, size_t length)
+{
+    const unsigned long long sLow7 = 0x7f7f7f7f7f7f7f7fULL;
+    const unsigned long long sOnes = 0x0101010101010101ULL;
+    const Byte* bytes1 = (const Byte*)data1;
+    const Byte* bytes2 = (const Byte*)data2;
+    size_t pos = 0;
+    for (; pos + 8 <= length; pos += 8)
+    {
+        unsigned long long value1, value2;
+        memcpy(&value1, bytes1 + pos, 8);
+        memcpy(&value2, bytes2 + pos, 8);
+        unsigned long long diff = value1 ^ value2;
+        unsigned long long nonZero = (((diff & sLow7) + sLow7) | diff) >> 7 & sOnes;
+        if (nonZero != sOnes)
+            break;
+    }
+    while (pos < length && bytes1[pos] != bytes2[pos])
+        pos++;
+    return pos;
+}
+
+//-----------------------------------------------------------------------------
+const char* KernelName()
+{
+    return GetKernels().name;
+}
+
+}
@@ -0,0 +1,56 @@
+//-----------------------------------------------------------------------------
+// MemCompare - Find and count differing bytes of two buffers.
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <stddef.h>
+
+//-----------------------------------------------------------------------------
+// Byte compare kernels for file compares.
+//
+// FirstDiff stops at the first differing byte, CountDiff counts all of
+// them, so a verbose compare (histogram of differences) reads the data at
+// nearly the same speed as a quick one. Both use AVX2 when the cpu and os
+// support it, else SSE2, else 8 bytes at a time. The choice is made once,
+// on first use.
+namespace MemCompare
+{
+    // Offset of the first byte which differs, length if none.
+    size_t FirstDiff(const void* data1, const void* data2, size_t length);
+
+    // Number of bytes which differ.
+    size_t CountDiff(const void* data1, const void* data2, size_t length);
+
+    // Offset of the first byte which is the same, length if none.
+    size_t FirstSame(const void* data1, const void* data2, size_t length);
+
+    // Name of the kernel in use, "avx2", "sse2" or "scalar".
+    const char* KernelName();
+}
@@ -53,10 +53,7 @@ bool MemMapFile::Open(const char* fileName, SIZE_T minViewLength)
 {
 	Close();
 
-	m_minViewLength = minViewLength;
-	::GetSystemInfo(&m_sysInfo);
-
-	m_hFile = ::CreateFile(
+	Handle hFile = ::CreateFile(
 		    fileName,
 		    GENERIC_READ,
 		    FILE_SHARE_READ,
@@ -65,6 +62,19 @@ bool MemMapFile::Open(const char* fileName, SIZE_T minViewLength)
 		    FILE_ATTRIBUTE_NORMAL,
 		    NULL);
 
+	return Open(hFile, minViewLength);
+}
+
+//=================================================================================================
+bool MemMapFile::Open(const Handle& hFile, SIZE_T minViewLength)
+{
+	Close();
+
+	m_minViewLength = minViewLength;
+	::GetSystemInfo(&m_sysInfo);
+
+	m_hFile = hFile;
+
 	bool ok = false;
 	m_fileSize = 0;
 	LARGE_INTEGER fileSize;
@@ -74,7 +84,7 @@ bool MemMapFile::Open(const char* fileName, SIZE_T minViewLength)
 		// Store the file size.		
 		m_fileSize = fileSize.QuadPart;
 
-		m_hFileMapping = ::CreateFileMappingW(
+		HANDLE hFileMapping = ::CreateFileMappingW(
 			    m_hFile,
 			    NULL,
 			    PAGE_READONLY,
@@ -82,6 +92,8 @@ bool MemMapFile::Open(const char* fileName, SIZE_T minViewLength)
 			    0,
 			    NULL);
 
+		// Mapping returns NULL on failure, empty files can not be mapped.
+		m_hFileMapping = (hFileMapping != NULL) ? hFileMapping : INVALID_HANDLE_VALUE;
         ok = m_hFileMapping.IsValid();
 	}
 
@@ -189,6 +201,7 @@ void* MemMapFile::MapView(unsigned __int64 viewOffset, SIZE_T& viewLength)
 				m_viewOffset = offset;
 				m_viewLength = mbi.RegionSize > 0 ? mbi.RegionSize : viewLength;
 				pChar = &m_view[viewOffset - offset];
+				viewLength -= (SIZE_T)(viewOffset - offset);
 			}
 		}
 	}
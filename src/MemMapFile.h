@@ -61,7 +61,11 @@ public:
 	~MemMapFile(void);
 
 	bool Open(const char* fileName, SIZE_T minViewLength = MinViewLength);
+	// Map a file already open for reading, the handle is duplicated.
+	bool Open(const Handle& hFile, SIZE_T minViewLength = MinViewLength);
 	void Close();
 
+	// Return view of file at viewOffset, viewLength is set to the bytes
+	// available at the returned pointer (0 maps to the end of the file).
 	void* MapView(unsigned __int64 viewOffset, SIZE_T& viewLength);
 };
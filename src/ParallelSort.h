@@ -0,0 +1,214 @@
+//-----------------------------------------------------------------------------
+// ParallelSort - Stable sort in sorted runs merged in parallel.
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include "WorkPool.h"
+
+//-----------------------------------------------------------------------------
+// Stable sort of items in parallel.
+//
+// items is cut in one run per thread, the runs are sorted with std::stable_sort
+// on a WorkPool and then merged pairwise until one run is left. Every merge
+// round is split in pieces of equal output size (merge path), so all threads
+// stay busy up to the last merge. Equal items keep their order, same result
+// as std::stable_sort.
+//
+// Each task works with its own copy of less, a comparator holding scratch
+// buffers is safe if copies do not share them. Small inputs are sorted on
+// the calling thread.
+//
+//      ParallelSort(order, RowLess(dirSort, sortBy));
+template <typename TT, typename Less>
+void ParallelSort(std::vector<TT>& items, const Less& less, unsigned threads = 0);
+
+//-----------------------------------------------------------------------------
+// Implementation
+
+namespace ParallelSortImpl
+{
+    // Below this many items per thread the pool costs more than it saves.
+    const size_t sMinRunItems = 16 * 1024;
+
+    template <typename TT, typename Less>
+    struct Task
+    {
+        Task(const Less& _less) : less(_less)
+        { }
+
+        // Sort [first, last).
+        static void SortRun(void* data)
+        {
+            Task* pTask = (Task*)data;
+            std::stable_sort(pTask->first1, pTask->last1, pTask->less);
+        }
+
+        // Merge [first1, last1) and [first2, last2) to out.
+        static void MergeRuns(void* data)
+        {
+            Task* pTask = (Task*)data;
+            std::merge(pTask->first1, pTask->last1, pTask->first2, pTask->last2, pTask->out, pTask->less);
+        }
+
+        TT*     first1;
+        TT*     last1;
+        TT*     first2;
+        TT*     last2;
+        TT*     out;
+        Less    less;
+    };
+
+    // Number of items of a which are among the first diag items of the stable
+    // merge of a and b, a wins ties.
+    template <typename TT, typename Less>
+    size_t MergeSplit(const TT* a, size_t aLen, const TT* b, size_t bLen, size_t diag, const Less& less)
+    {
+        size_t lo = (diag > bLen) ? diag - bLen : 0;
+        size_t hi = (diag < aLen) ? diag : aLen;
+        while (lo < hi)
+        {
+            size_t aIdx = lo + (hi - lo) / 2;
+            size_t bIdx = diag - aIdx;
+            if (bIdx != 0 && !less(b[bIdx - 1], a[aIdx]))
+                lo = aIdx + 1;      // a[aIdx] merges before b[bIdx-1]
+            else
+                hi = aIdx;
+        }
+        return lo;
+    }
+}
+
+//-----------------------------------------------------------------------------
+template <typename TT, typename Less>
+void ParallelSort(std::vector<TT>& items, const Less& less, unsigned threads)
+{
+    using namespace ParallelSortImpl;
+    typedef Task<TT, Less> SortTask;
+
+    if (threads == 0)
+        threads = WorkPool::DefaultThreads();
+    size_t count = items.size();
+    if (threads > count / sMinRunItems)
+        threads = (unsigned)(count / sMinRunItems);
+    if (threads < 2)
+    {
+        std::stable_sort(items.begin(), items.end(), less);
+        return;
+    }
+
+    WorkPool workPool(threads);
+    std::vector<SortTask> tasks;
+    tasks.reserve(threads);
+
+    // Sorted runs, run n is [bounds[n], bounds[n+1]).
+    std::vector<size_t> bounds;
+    for (unsigned run = 0; run != threads; run++)
+        bounds.push_back(count * run / threads);
+    bounds.push_back(count);
+
+    TT* pItems = &items[0];
+    for (unsigned run = 0; run != threads; run++)
+    {
+        tasks.push_back(SortTask(less));
+        tasks.back().first1 = pItems + bounds[run];
+        tasks.back().last1 = pItems + bounds[run + 1];
+    }
+    for (unsigned run = 0; run != threads; run++)
+        workPool.Submit(SortTask::SortRun, &tasks[run]);
+    workPool.Wait();
+
+    // Merge rounds alternate between items and other.
+    std::vector<TT> other(count);
+    TT* pFrom = pItems;
+    TT* pTo = &other[0];
+    while (bounds.size() > 2)
+    {
+        size_t runs = bounds.size() - 1;
+        size_t pairs = runs / 2;
+        size_t piecesPerPair = (threads + pairs - 1) / pairs;
+        tasks.clear();
+        tasks.reserve(pairs * piecesPerPair + 1);
+
+        std::vector<size_t> merged;
+        for (size_t pair = 0; pair != pairs; pair++)
+        {
+            size_t aBeg = bounds[pair * 2];
+            size_t bBeg = bounds[pair * 2 + 1];
+            size_t bEnd = bounds[pair * 2 + 2];
+            const TT* a = pFrom + aBeg;
+            const TT* b = pFrom + bBeg;
+            size_t aLen = bBeg - aBeg;
+            size_t bLen = bEnd - bBeg;
+
+            size_t aSplit = 0;
+            for (size_t piece = 0; piece != piecesPerPair; piece++)
+            {
+                size_t diag = (aLen + bLen) * (piece + 1) / piecesPerPair;
+                size_t aNext = MergeSplit(a, aLen, b, bLen, diag, less);
+                size_t diagBeg = (aLen + bLen) * piece / piecesPerPair;
+                tasks.push_back(SortTask(less));
+                SortTask& task = tasks.back();
+                task.first1 = pFrom + aBeg + aSplit;
+                task.last1 = pFrom + aBeg + aNext;
+                task.first2 = pFrom + bBeg + (diagBeg - aSplit);
+                task.last2 = pFrom + bBeg + (diag - aNext);
+                task.out = pTo + aBeg + diagBeg;
+                aSplit = aNext;
+            }
+            merged.push_back(aBeg);
+        }
+
+        if (runs % 2 != 0)
+        {
+            // Odd run is moved as is, merged with nothing.
+            tasks.push_back(SortTask(less));
+            SortTask& task = tasks.back();
+            task.first1 = pFrom + bounds[runs - 1];
+            task.last1 = pFrom + count;
+            task.first2 = task.last2 = task.last1;
+            task.out = pTo + bounds[runs - 1];
+            merged.push_back(bounds[runs - 1]);
+        }
+        merged.push_back(count);
+
+        for (size_t taskIdx = 0; taskIdx != tasks.size(); taskIdx++)
+            workPool.Submit(SortTask::MergeRuns, &tasks[taskIdx]);
+        workPool.Wait();
+
+        bounds.swap(merged);
+        std::swap(pFrom, pTo);
+    }
+
+    if (pFrom != pItems)
+        items.swap(other);
+}
@@ -0,0 +1,234 @@
+//-----------------------------------------------------------------------------
+// ScanStream - Pull entries of a directory scan in batches.
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "ScanStream.h"
+
+//-----------------------------------------------------------------------------
+ScanBatch::ScanBatch() :
+    m_arena(8 * 1024)
+{ }
+
+//-----------------------------------------------------------------------------
+void ScanBatch::Clear()
+{
+    m_entries.clear();
+    m_dirs.clear();
+    m_arena.Reset();
+    m_infos.clear();
+}
+
+//-----------------------------------------------------------------------------
+void ScanBatch::Add(
+    const char* pDir,
+    const WIN32_FIND_DATA& fileData,
+    int depth,
+    const DirectoryScan::FileInfo* pFileInfo)
+{
+    if (m_dirs.empty() || strcmp(m_dirs.back(), pDir) != 0)
+        m_dirs.push_back(m_arena.StrDup(pDir));
+
+    Entry entry;
+    entry.dirIdx = (unsigned)m_dirs.size() - 1;
+    entry.depth = depth;
+    entry.infoIdx = -1;
+    if (pFileInfo != NULL)
+    {
+        entry.infoIdx = (int)m_infos.size();
+        m_infos.push_back(*pFileInfo);
+    }
+
+    ToFileEntry(fileData, entry.file);
+    entry.file.name = m_arena.StrDup(entry.file.name, entry.file.nameLen);
+    m_entries.push_back(entry);
+}
+
+//-----------------------------------------------------------------------------
+void ScanBatch::Get(size_t idx, ScanEntry& entry) const
+{
+    const Entry& item = m_entries[idx];
+    entry.pDir = m_dirs[item.dirIdx];
+    entry.file = item.file;
+    entry.depth = item.depth;
+    entry.pFileInfo = (item.infoIdx < 0) ? NULL : &m_infos[item.infoIdx];
+}
+
+//-----------------------------------------------------------------------------
+ScanStream::ScanStream(const DirectoryScan& dirScan, unsigned batchSize, unsigned maxBatches) :
+    m_scan(dirScan),
+    m_disableWow64(dirScan.m_disableWow64Redirection),
+    m_batchSize(batchSize != 0 ? batchSize : 1),
+    m_maxBatches(maxBatches != 0 ? maxBatches : 1),
+    m_done(false),
+    m_aborted(false),
+    m_fileCnt(0)
+{
+    // Copy reports to this stream, redirection is set per thread in Produce.
+    m_scan.m_add_cb = AddCb;
+    m_scan.m_cb_data = this;
+    m_scan.m_streamBatch = 0;
+    m_scan.m_disableWow64Redirection = false;
+    m_scan.m_abort = false;
+}
+
+//-----------------------------------------------------------------------------
+ScanStream::~ScanStream()
+{
+    Abort();
+    Wait();
+}
+
+//-----------------------------------------------------------------------------
+void ScanStream::Start(int depth)
+{
+    m_thread = std::thread(&ScanStream::Produce, this, depth);
+}
+
+//-----------------------------------------------------------------------------
+void ScanStream::Produce(int depth)
+{
+    PVOID oldWow64Redirection = NULL;
+    if (m_disableWow64)
+        Wow64DisableWow64FsRedirection(&oldWow64Redirection);
+
+    size_t fileCnt = m_scan.GetFilesInDirectory(depth);
+    Push();
+
+    if (m_disableWow64)
+        Wow64RevertWow64FsRedirection(oldWow64Redirection);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_fileCnt = fileCnt;
+    m_done = true;
+    m_notEmpty.notify_all();
+}
+
+//-----------------------------------------------------------------------------
+int ScanStream::AddCb(void* cbData, const char* pDir, const WIN32_FIND_DATA* pFileData, int depth)
+{
+    ScanStream* pStream = (ScanStream*)cbData;
+    pStream->m_fill.Add(pDir, *pFileData, depth, pStream->m_scan.m_fileInfo);
+    if (pStream->m_fill.Size() >= pStream->m_batchSize)
+        pStream->Push();
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Queue filled batch, wait while the consumer is maxBatches behind.
+void ScanStream::Push()
+{
+    if (m_fill.Size() == 0)
+        return;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_aborted && m_ready.size() >= m_maxBatches)
+        m_notFull.wait(lock);
+
+    if (m_aborted)
+    {
+        m_fill.Clear();
+        return;
+    }
+
+    m_ready.push_back(ScanBatch());
+    std::swap(m_ready.back(), m_fill);
+    if (!m_spare.empty())
+    {
+        std::swap(m_fill, m_spare.back());
+        m_spare.pop_back();
+    }
+    m_notEmpty.notify_one();
+}
+
+//-----------------------------------------------------------------------------
+bool ScanStream::Next(ScanBatch& batch)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_aborted && !m_done && m_ready.empty())
+        m_notEmpty.wait(lock);
+
+    if (m_aborted || m_ready.empty())
+        return false;
+
+    // Hand the caller's previous batch back to the producer for reuse.
+    std::swap(batch, m_ready.front());
+    m_ready.front().Clear();
+    m_spare.push_back(ScanBatch());
+    std::swap(m_spare.back(), m_ready.front());
+    m_ready.pop_front();
+    m_notFull.notify_one();
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+void ScanStream::Abort()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_aborted = true;
+    m_scan.m_abort = true;
+    m_notFull.notify_all();
+    m_notEmpty.notify_all();
+}
+
+//-----------------------------------------------------------------------------
+size_t ScanStream::Wait()
+{
+    if (m_thread.joinable())
+        m_thread.join();
+    return m_fileCnt;
+}
+
+//-----------------------------------------------------------------------------
+size_t ScanStream::Dispatch(DirectoryScan& dirScan, int depth)
+{
+    ScanStream stream(dirScan, dirScan.m_streamBatch);
+    stream.Start(depth);
+
+    ScanBatch batch;
+    ScanEntry entry;
+    WIN32_FIND_DATA fileData;
+    while (!dirScan.m_abort && stream.Next(batch))
+    {
+        for (size_t idx = 0; idx != batch.Size() && !dirScan.m_abort; idx++)
+        {
+            batch.Get(idx, entry);
+            dirScan.m_fileInfo = entry.pFileInfo;
+            if (dirScan.m_add_cb)
+            {
+                ToFindData(entry.file, fileData);
+                dirScan.m_add_cb(dirScan.m_cb_data, entry.pDir, &fileData, entry.depth);
+            }
+        }
+    }
+    dirScan.m_fileInfo = NULL;
+
+    if (dirScan.m_abort)
+        stream.Abort();
+    return stream.Wait();
+}
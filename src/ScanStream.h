@@ -0,0 +1,146 @@
+//-----------------------------------------------------------------------------
+// ScanStream - Pull entries of a directory scan in batches.
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "dirscan.h"
+#include "Arena.h"
+#include "FileEntry.h"
+
+//-----------------------------------------------------------------------------
+// One entry of a ScanBatch, same arguments DirectoryScan passes to m_add_cb.
+struct ScanEntry
+{
+    const char*     pDir;           // valid while the batch is not reused
+    FileEntry       file;           // name valid while the batch is not reused
+    int             depth;          // 0...n is directory depth, -n end-of nth directory
+    const DirectoryScan::FileInfo* pFileInfo;   // NULL if not prefetched
+};
+
+//-----------------------------------------------------------------------------
+// Compact block of scan entries.
+//
+// Entries are stored as FileEntry records, their names and the directory
+// paths (once for consecutive entries of the same directory) in an arena
+// that Clear resets, so a reused batch keeps its blocks.
+class ScanBatch
+{
+public:
+    ScanBatch();
+
+    size_t Size() const
+    { return m_entries.size(); }
+
+    void Clear();
+    void Add(const char* pDir, const WIN32_FIND_DATA& fileData, int depth,
+        const DirectoryScan::FileInfo* pFileInfo);
+    void Get(size_t idx, ScanEntry& entry) const;
+
+private:
+    struct Entry
+    {
+        unsigned    dirIdx;         // m_dirs
+        int         depth;
+        int         infoIdx;        // m_infos, -1 if none
+        FileEntry   file;           // name in m_arena
+    };
+
+    std::vector<Entry>       m_entries;
+    std::vector<const char*> m_dirs;    // in m_arena
+    Arena                    m_arena;
+    std::vector<DirectoryScan::FileInfo> m_infos;
+};
+
+//-----------------------------------------------------------------------------
+// Pull style directory scan.
+//
+// The scan runs on a producer thread using a copy of the DirectoryScan settings,
+// so its m_scanMode, m_prefetchInfo and m_dirCache all apply. Entries are
+// queued in batches of batchSize, the producer waits when maxBatches are
+// queued so a slow consumer holds the scan back.
+//
+//      ScanStream stream(dirScan);
+//      stream.Start();
+//      ScanBatch batch;
+//      while (stream.Next(batch))
+//          ...
+//      size_t fileCnt = stream.Wait();
+class ScanStream
+{
+public:
+    ScanStream(const DirectoryScan& dirScan, unsigned batchSize = 256, unsigned maxBatches = 4);
+    ~ScanStream();
+
+    void Start(int depth = 0);
+
+    // Replace batch with next block of entries, false when scan is done.
+    bool Next(ScanBatch& batch);
+
+    // Stop producer, Next returns false.
+    void Abort();
+
+    // Wait for producer to finish, return file count as GetFilesInDirectory.
+    size_t Wait();
+
+    // Run dirScan through a stream and pass entries to its m_add_cb on the calling thread.
+    static size_t Dispatch(DirectoryScan& dirScan, int depth = 0);
+
+private:
+    ScanStream(const ScanStream&);
+    ScanStream& operator=(const ScanStream&);
+
+    static int AddCb(void* cbData, const char* pDir, const WIN32_FIND_DATA* pFileData, int depth);
+    void Produce(int depth);
+    void Push();
+
+    DirectoryScan       m_scan;
+    bool                m_disableWow64;
+    unsigned            m_batchSize;
+    unsigned            m_maxBatches;
+
+    ScanBatch           m_fill;         // producer batch being filled
+    std::deque<ScanBatch> m_ready;      // filled, waiting for Next
+    std::vector<ScanBatch> m_spare;     // returned by Next, reused by producer
+
+    std::mutex          m_mutex;
+    std::condition_variable m_notFull;
+    std::condition_variable m_notEmpty;
+    bool                m_done;
+    bool                m_aborted;
+    size_t              m_fileCnt;
+    std::thread         m_thread;
+};
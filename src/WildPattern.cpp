@@ -0,0 +1,520 @@
+//-----------------------------------------------------------------------------
+// WildPattern - Compiled wildcard (glob) pattern matcher.
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include <ctype.h>
+#include <deque>
+
+#include "WildPattern.h"
+
+bool WildPattern::sIgnoreCase = true;
+
+// Case fold table.
+struct FoldTable
+{
+    FoldTable()
+    {
+        for (unsigned idx = 0; idx != 256; idx++)
+            fold[idx] = (char)tolower(idx);
+    }
+    char fold[256];
+};
+static const FoldTable sFold;
+
+inline char Fold(char c)
+{ return sFold.fold[(unsigned char)c]; }
+
+//-----------------------------------------------------------------------------
+WildPattern::WildPattern() :
+    m_minLen(0),
+    m_ignoreCase(sIgnoreCase)
+{
+    Compile("*", sIgnoreCase);
+}
+
+//-----------------------------------------------------------------------------
+WildPattern::WildPattern(const char* pattern, bool ignoreCase)
+{
+    Compile(pattern, ignoreCase);
+}
+
+//-----------------------------------------------------------------------------
+WildPattern::WildPattern(const std::string& pattern, bool ignoreCase)
+{
+    Compile(pattern.c_str(), ignoreCase);
+}
+
+//-----------------------------------------------------------------------------
+void WildPattern::Compile(const char* pattern, bool ignoreCase)
+{
+    m_pattern = pattern;
+    m_ignoreCase = ignoreCase;
+    m_text.clear();
+    m_segments.clear();
+    m_minLen = 0;
+
+    const unsigned sNoLit = (unsigned)-1;
+    Segment seg = { 0, 0, 0, sNoLit, false };
+    for (unsigned wildOff = 0; ; wildOff++)
+    {
+        char c = pattern[wildOff];
+        if (c == '*' || c == '\0')
+        {
+            seg.len = (unsigned)m_text.length() - seg.off;
+            if (seg.litIdx == sNoLit)
+                seg.litIdx = seg.len;
+            m_segments.push_back(seg);
+            m_minLen += seg.len;
+            if (c == '\0')
+                break;
+
+            seg.off = (unsigned)m_text.length();
+            seg.wildOff = wildOff + 1;
+            seg.litIdx = sNoLit;
+            seg.hasAny = false;
+            continue;
+        }
+
+        if (c == '?')
+            seg.hasAny = true;
+        else if (seg.litIdx == sNoLit)
+            seg.litIdx = (unsigned)m_text.length() - seg.off;
+        m_text += ignoreCase ? Fold(c) : c;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Return true if segment matches str (which has at least seg.len chars).
+bool WildPattern::MatchAt(const Segment& seg, const char* str) const
+{
+    const char* pWild = m_text.c_str() + seg.off;
+    unsigned idx = seg.litIdx;      // chars before litIdx are all '?'
+
+    if (m_ignoreCase)
+    {
+        for (; idx != seg.len; idx++)
+        {
+            if (pWild[idx] != '?' && Fold(str[idx]) != pWild[idx])
+                return false;
+        }
+    }
+    else if (!seg.hasAny)
+    {
+        return memcmp(str + idx, pWild + idx, seg.len - idx) == 0;
+    }
+    else
+    {
+        for (; idx != seg.len; idx++)
+        {
+            if (pWild[idx] != '?' && str[idx] != pWild[idx])
+                return false;
+        }
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// Return offset of first match of segment starting in [from, last], else npos.
+size_t WildPattern::Find(const Segment& seg, const char* str, size_t from, size_t last) const
+{
+    if (from > last)
+        return std::string::npos;
+    if (seg.litIdx == seg.len)
+        return from;        // empty or all '?'
+
+    char lit = m_text[seg.off + seg.litIdx];
+    bool anyCase = m_ignoreCase && Fold(lit) != (char)toupper((unsigned char)lit);
+
+    for (size_t pos = from; pos <= last; pos++)
+    {
+        // Skip ahead to next candidate for the first literal character.
+        const char* pScan = str + pos + seg.litIdx;
+        size_t scanLen = last - pos + 1;
+        const char* pFound;
+        if (!anyCase)
+        {
+            pFound = (const char*)memchr(pScan, lit, scanLen);
+        }
+        else
+        {
+            pFound = NULL;
+            for (size_t idx = 0; idx != scanLen; idx++)
+            {
+                if (Fold(pScan[idx]) == lit)
+                {
+                    pFound = pScan + idx;
+                    break;
+                }
+            }
+        }
+
+        if (pFound == NULL)
+            break;
+        pos = (pFound - str) - seg.litIdx;
+        if (MatchAt(seg, str + pos))
+            return pos;
+    }
+
+    return std::string::npos;
+}
+
+//-----------------------------------------------------------------------------
+void WildPattern::AddAny(const Segment& seg, size_t strOff, std::vector<PatInfo>& patInfoLst) const
+{
+    if (!seg.hasAny)
+        return;
+
+    for (unsigned idx = 0; idx != seg.len; idx++)
+    {
+        if (m_text[seg.off + idx] == '?')
+        {
+            PatInfo patInfo;
+            patInfo.rawLen  = 1;
+            patInfo.rawOff  = (unsigned)(strOff + idx);
+            patInfo.wildOff = seg.wildOff + idx;
+            patInfoLst.push_back(patInfo);
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+bool WildPattern::Match(const char* str, size_t strLen) const
+{
+    return Match(str, strLen, NULL);
+}
+
+//-----------------------------------------------------------------------------
+bool WildPattern::Capture(const char* str, std::vector<PatInfo>& patInfoLst) const
+{
+    size_t lstSz = patInfoLst.size();
+    if (Match(str, strlen(str), &patInfoLst))
+        return true;
+    patInfoLst.resize(lstSz);
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+bool WildPattern::Match(const char* str, size_t strLen, std::vector<PatInfo>* pPatInfoLst) const
+{
+    if (strLen < m_minLen)
+        return false;
+
+    const Segment& first = m_segments.front();
+    if (m_segments.size() == 1)
+    {
+        if (strLen != first.len || !MatchAt(first, str))
+            return false;
+        if (pPatInfoLst)
+            AddAny(first, 0, *pPatInfoLst);
+        return true;
+    }
+
+    // Anchored prefix and suffix.
+    const Segment& last = m_segments.back();
+    size_t endOff = strLen - last.len;
+    if (!MatchAt(first, str) || !MatchAt(last, str + endOff))
+        return false;
+
+    if (pPatInfoLst)
+        AddAny(first, 0, *pPatInfoLst);
+
+    // Middle segments, leftmost match leaves the most room for the rest.
+    size_t strOff = first.len;
+    for (unsigned segIdx = 1; segIdx != m_segments.size(); segIdx++)
+    {
+        const Segment& seg = m_segments[segIdx];
+        size_t segOff = endOff;
+        if (segIdx + 1 != m_segments.size())
+        {
+            if (strOff + seg.len > endOff)
+                return false;
+            segOff = Find(seg, str, strOff, endOff - seg.len);
+            if (segOff == std::string::npos)
+                return false;
+        }
+
+        if (pPatInfoLst)
+        {
+            PatInfo patInfo;
+            patInfo.rawLen  = (unsigned)(segOff - strOff);
+            patInfo.rawOff  = (unsigned)strOff;
+            patInfo.wildOff = seg.wildOff - 1;
+            pPatInfoLst->push_back(patInfo);
+            AddAny(seg, segOff, *pPatInfoLst);
+        }
+        strOff = segOff + seg.len;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+WildPatternSet::WildPatternSet() :
+    m_matchAll(false),
+    m_ignoreCase(WildPattern::sIgnoreCase)
+{
+    Clear();
+}
+
+//-----------------------------------------------------------------------------
+void WildPatternSet::Clear()
+{
+    m_patterns.clear();
+    for (unsigned kind = 0; kind != eKeyKinds; kind++)
+        m_keys[kind].clear();
+    m_nodes.clear();
+    Node root = { std::vector<std::pair<char, unsigned> >(), 0, false, false };
+    m_nodes.push_back(root);
+    m_general.clear();
+    m_matchAll = false;
+}
+
+//-----------------------------------------------------------------------------
+void WildPatternSet::Add(const std::string& pattern, bool ignoreCase)
+{
+    if (m_patterns.empty())
+        m_ignoreCase = ignoreCase;
+
+    unsigned patIdx = (unsigned)m_patterns.size();
+    m_patterns.push_back(WildPattern(pattern, ignoreCase));
+
+    // Indexed keys share one case setting, '?' needs the full matcher.
+    if (ignoreCase != m_ignoreCase || pattern.find('?') != std::string::npos)
+    {
+        m_general.push_back(patIdx);
+        return;
+    }
+
+    std::string key;
+    unsigned starCnt = 0;
+    for (unsigned idx = 0; idx != pattern.length(); idx++)
+    {
+        if (pattern[idx] == '*')
+            starCnt++;
+        else
+            key += ignoreCase ? Fold(pattern[idx]) : pattern[idx];
+    }
+
+    bool leadStar  = !pattern.empty() && pattern[0] == '*';
+    bool trailStar = !pattern.empty() && pattern[pattern.length()-1] == '*';
+
+    if (starCnt == 0)
+        AddKey(eExact, key);
+    else if (key.empty())
+        m_matchAll = true;
+    else if (starCnt == 1 && leadStar)
+        AddKey(eSuffix, key);
+    else if (starCnt == 1 && trailStar)
+        AddKey(ePrefix, key);
+    else if (starCnt == 2 && leadStar && trailStar)
+        AddContains(key);
+    else
+        m_general.push_back(patIdx);
+}
+
+//-----------------------------------------------------------------------------
+// FNV-1a hash of str, case folded if keys ignore case.
+unsigned WildPatternSet::Hash(const char* str, size_t len) const
+{
+    unsigned hash = 2166136261u;
+    if (m_ignoreCase)
+    {
+        for (size_t idx = 0; idx != len; idx++)
+            hash = (hash ^ (unsigned char)Fold(str[idx])) * 16777619u;
+    }
+    else
+    {
+        for (size_t idx = 0; idx != len; idx++)
+            hash = (hash ^ (unsigned char)str[idx]) * 16777619u;
+    }
+    return hash;
+}
+
+//-----------------------------------------------------------------------------
+bool WildPatternSet::SameKey(const std::string& key, const char* str) const
+{
+    if (!m_ignoreCase)
+        return memcmp(key.c_str(), str, key.length()) == 0;
+
+    for (size_t idx = 0; idx != key.length(); idx++)
+    {
+        if (key[idx] != Fold(str[idx]))
+            return false;
+    }
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+void WildPatternSet::AddKey(KeyKind kind, const std::string& key)
+{
+    KeySetList& keySets = m_keys[kind];
+    unsigned setIdx = 0;
+    while (setIdx != keySets.size() && keySets[setIdx].len != key.length())
+        setIdx++;
+
+    if (setIdx == keySets.size())
+    {
+        keySets.push_back(KeySet());
+        keySets.back().len = (unsigned)key.length();
+    }
+
+    keySets[setIdx].keys.insert(std::make_pair(Hash(key.c_str(), key.length()), key));
+}
+
+//-----------------------------------------------------------------------------
+// Return true if str (at least keySet.len chars) starts with a key in keySet.
+bool WildPatternSet::FindKey(const KeySet& keySet, const char* str) const
+{
+    auto range = keySet.keys.equal_range(Hash(str, keySet.len));
+    for (auto iter = range.first; iter != range.second; ++iter)
+    {
+        if (SameKey(iter->second, str))
+            return true;
+    }
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+// Return trie child of state on c, 0 if none (root is never a child).
+unsigned WildPatternSet::Next(unsigned state, char c) const
+{
+    const std::vector<std::pair<char, unsigned> >& next = m_nodes[state].next;
+    for (unsigned idx = 0; idx != next.size(); idx++)
+    {
+        if (next[idx].first == c)
+            return next[idx].second;
+    }
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Automaton transition, follow fail links until a child on c is found.
+unsigned WildPatternSet::Child(unsigned state, char c) const
+{
+    for (;;)
+    {
+        unsigned child = Next(state, c);
+        if (child != 0 || state == 0)
+            return child;
+        state = m_nodes[state].fail;
+    }
+}
+
+//-----------------------------------------------------------------------------
+void WildPatternSet::AddContains(const std::string& key)
+{
+    unsigned state = 0;
+    for (size_t idx = 0; idx != key.length(); idx++)
+    {
+        unsigned child = Next(state, key[idx]);
+        if (child == 0)
+        {
+            child = (unsigned)m_nodes.size();
+            Node node = { std::vector<std::pair<char, unsigned> >(), 0, false, false };
+            m_nodes.push_back(node);
+            m_nodes[state].next.push_back(std::make_pair(key[idx], child));
+        }
+        state = child;
+    }
+    m_nodes[state].keyEnd = true;
+
+    // Rebuild fail links breadth first, lists are short so just redo them all.
+    std::deque<unsigned> queue;
+    m_nodes[0].out = m_nodes[0].keyEnd;
+    queue.push_back(0);
+    while (!queue.empty())
+    {
+        unsigned parent = queue.front();
+        queue.pop_front();
+
+        const std::vector<std::pair<char, unsigned> >& next = m_nodes[parent].next;
+        for (unsigned idx = 0; idx != next.size(); idx++)
+        {
+            unsigned child = next[idx].second;
+            Node& node = m_nodes[child];
+            node.fail = (parent == 0) ? 0 : Child(m_nodes[parent].fail, next[idx].first);
+            node.out = node.keyEnd || m_nodes[node.fail].out;
+            queue.push_back(child);
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+bool WildPatternSet::MatchContains(const char* str, size_t strLen) const
+{
+    unsigned state = 0;
+    for (size_t idx = 0; idx != strLen; idx++)
+    {
+        state = Child(state, m_ignoreCase ? Fold(str[idx]) : str[idx]);
+        if (m_nodes[state].out)
+            return true;
+    }
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+bool WildPatternSet::Match(const char* str, size_t strLen) const
+{
+    if (m_matchAll)
+        return true;
+
+    const KeySetList& exact = m_keys[eExact];
+    for (unsigned setIdx = 0; setIdx != exact.size(); setIdx++)
+    {
+        if (exact[setIdx].len == strLen && FindKey(exact[setIdx], str))
+            return true;
+    }
+
+    const KeySetList& prefix = m_keys[ePrefix];
+    for (unsigned setIdx = 0; setIdx != prefix.size(); setIdx++)
+    {
+        if (prefix[setIdx].len <= strLen && FindKey(prefix[setIdx], str))
+            return true;
+    }
+
+    const KeySetList& suffix = m_keys[eSuffix];
+    for (unsigned setIdx = 0; setIdx != suffix.size(); setIdx++)
+    {
+        unsigned len = suffix[setIdx].len;
+        if (len <= strLen && FindKey(suffix[setIdx], str + strLen - len))
+            return true;
+    }
+
+    if (m_nodes.size() > 1 && MatchContains(str, strLen))
+        return true;
+
+    for (unsigned genIdx = 0; genIdx != m_general.size(); genIdx++)
+    {
+        if (m_patterns[m_general[genIdx]].Match(str, strLen))
+            return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,174 @@
+//-----------------------------------------------------------------------------
+// WildPattern - Compiled wildcard (glob) pattern matcher.
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <string.h>
+
+// Wildcard match position, one per '*' or '?' in pattern.
+struct PatInfo
+{
+    unsigned  rawLen;
+    unsigned  rawOff;
+    unsigned  wildOff;
+};
+
+//-----------------------------------------------------------------------------
+// Wildcard pattern compiled once and matched many times.
+// Patterns supported:
+//          ?        ; any single character
+//          *        ; zero or more characters
+//
+// The pattern is split on '*' into literal segments ('?' matches any char).
+// First segment must match as a prefix, last segment as a suffix and the
+// segments between are found left to right (memchr on a literal character),
+// so matching is iterative with no backtracking across '*'.
+// Case sensitivity is fixed when the pattern is compiled.
+class WildPattern
+{
+public:
+    WildPattern();
+    WildPattern(const char* pattern, bool ignoreCase = sIgnoreCase);
+    WildPattern(const std::string& pattern, bool ignoreCase = sIgnoreCase);
+
+    void Compile(const char* pattern, bool ignoreCase = sIgnoreCase);
+
+    bool Match(const char* str) const
+    { return Match(str, strlen(str)); }
+    bool Match(const char* str, size_t strLen) const;
+
+    // Match and append position of each '*' and '?' to patInfoLst.
+    bool Capture(const char* str, std::vector<PatInfo>& patInfoLst) const;
+
+    const std::string& Pattern() const
+    { return m_pattern; }
+    bool IgnoreCase() const
+    { return m_ignoreCase; }
+
+    // True if pattern is "*" and matches everything.
+    bool MatchAll() const
+    { return m_segments.size() == 2 && m_segments[0].len == 0 && m_segments[1].len == 0; }
+
+    // Default case sensitivity for new patterns.
+    static bool sIgnoreCase;
+
+private:
+    struct Segment
+    {
+        unsigned    off;        // offset in m_text
+        unsigned    len;
+        unsigned    wildOff;    // offset in original pattern
+        unsigned    litIdx;     // index of first literal (non '?') char, len if none
+        bool        hasAny;     // contains '?'
+    };
+
+    bool MatchAt(const Segment& seg, const char* str) const;
+    size_t Find(const Segment& seg, const char* str, size_t from, size_t last) const;
+    bool Match(const char* str, size_t strLen, std::vector<PatInfo>* pPatInfoLst) const;
+    void AddAny(const Segment& seg, size_t strOff, std::vector<PatInfo>& patInfoLst) const;
+
+    std::string             m_pattern;
+    std::string             m_text;         // Segment text, case folded if m_ignoreCase
+    std::vector<Segment>    m_segments;     // One more than number of '*'
+    size_t                  m_minLen;       // Sum of segment lengths
+    bool                    m_ignoreCase;
+};
+
+//-----------------------------------------------------------------------------
+// Set of wildcard patterns matched in a single pass.
+//
+// Patterns are sorted into indexes as they are added:
+//          name     ; exact   - hash of whole string
+//          name*    ; prefix  - hash of leading chars, one probe per key length
+//          *.ext    ; suffix  - hash of trailing chars, one probe per key length
+//          *name*   ; contains - Aho-Corasick automaton, one scan of string
+// Anything else (embedded '?' or several '*') falls back to its WildPattern.
+// Cost of Match depends on the number of distinct key lengths and leftover
+// patterns, not on the total number of patterns.
+class WildPatternSet
+{
+public:
+    WildPatternSet();
+
+    void Add(const std::string& pattern, bool ignoreCase = WildPattern::sIgnoreCase);
+    void Clear();
+
+    bool Empty() const
+    { return m_patterns.empty(); }
+    size_t Size() const
+    { return m_patterns.size(); }
+    const WildPattern& operator[](size_t idx) const
+    { return m_patterns[idx]; }
+
+    // Return true if str matches any pattern.
+    bool Match(const char* str) const
+    { return Match(str, strlen(str)); }
+    bool Match(const char* str, size_t strLen) const;
+
+private:
+    enum KeyKind { eExact, ePrefix, eSuffix, eKeyKinds };
+
+    // Literal keys of one length, keyed by hash of (folded) key.
+    struct KeySet
+    {
+        unsigned    len;
+        std::unordered_multimap<unsigned, std::string> keys;
+    };
+    typedef std::vector<KeySet> KeySetList;
+
+    // Aho-Corasick trie node, transitions kept sparse.
+    struct Node
+    {
+        std::vector<std::pair<char, unsigned> > next;
+        unsigned    fail;
+        bool        keyEnd; // a key ends here
+        bool        out;    // a key ends here or at a fail ancestor
+    };
+
+    unsigned Hash(const char* str, size_t len) const;
+    bool SameKey(const std::string& key, const char* str) const;
+    void AddKey(KeyKind kind, const std::string& key);
+    bool FindKey(const KeySet& keySet, const char* str) const;
+
+    unsigned Next(unsigned state, char c) const;
+    unsigned Child(unsigned state, char c) const;
+    void AddContains(const std::string& key);
+    bool MatchContains(const char* str, size_t strLen) const;
+
+    std::vector<WildPattern>    m_patterns;
+    KeySetList                  m_keys[eKeyKinds];
+    std::vector<Node>           m_nodes;        // contains automaton, [0] is root
+    std::vector<unsigned>       m_general;      // index of patterns not in an index
+    bool                        m_matchAll;
+    bool                        m_ignoreCase;   // Case of indexed keys, set by first pattern
+};
@@ -0,0 +1,189 @@
+//-----------------------------------------------------------------------------
+// WorkPool - Work-stealing thread pool used by parallel directory scan.
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "WorkPool.h"
+
+// Identify the pool and queue owned by the current thread.
+static thread_local WorkPool* sPool = NULL;
+static thread_local unsigned  sQueueIdx = 0;
+
+//-----------------------------------------------------------------------------
+unsigned WorkPool::DefaultThreads()
+{
+    unsigned threads = std::thread::hardware_concurrency();
+    return (threads != 0) ? threads : 1;
+}
+
+//-----------------------------------------------------------------------------
+WorkPool::WorkPool(unsigned threads) :
+    m_queued(0),
+    m_pending(0),
+    m_nextQueue(0),
+    m_stop(false)
+{
+    if (threads == 0)
+        threads = DefaultThreads();
+
+    for (unsigned idx = 0; idx != threads; idx++)
+        m_queues.push_back(new TaskQueue());
+    for (unsigned idx = 0; idx != threads; idx++)
+        m_workers.push_back(std::thread(&WorkPool::WorkerMain, this, idx));
+}
+
+//-----------------------------------------------------------------------------
+WorkPool::~WorkPool()
+{
+    Wait();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+
+    for (unsigned idx = 0; idx != m_workers.size(); idx++)
+        m_workers[idx].join();
+    for (unsigned idx = 0; idx != m_queues.size(); idx++)
+        delete m_queues[idx];
+}
+
+//-----------------------------------------------------------------------------
+void WorkPool::Submit(Task_fn taskFn, void* data)
+{
+    Task task = { taskFn, data };
+    unsigned idx = (sPool == this) ? sQueueIdx : (m_nextQueue++ % m_queues.size());
+
+    m_pending++;
+    {
+        std::lock_guard<std::mutex> lock(m_queues[idx]->mutex);
+        m_queues[idx]->tasks.push_back(task);
+    }
+    m_queued++;
+
+    // Grab the pool lock so a worker about to sleep can not miss the wakeup.
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+    }
+    m_wake.notify_one();
+}
+
+//-----------------------------------------------------------------------------
+// Pop newest task from our own queue, else steal oldest task from another queue.
+bool WorkPool::Pop(unsigned idx, Task& task)
+{
+    unsigned cnt = (unsigned)m_queues.size();
+
+    if (sPool == this)
+    {
+        TaskQueue& own = *m_queues[idx];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            m_queued--;
+            return true;
+        }
+    }
+
+    for (unsigned off = 1; off <= cnt; off++)
+    {
+        TaskQueue& other = *m_queues[(idx + off) % cnt];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (!other.tasks.empty())
+        {
+            task = other.tasks.front();
+            other.tasks.pop_front();
+            m_queued--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+void WorkPool::Run(const Task& task)
+{
+    task.taskFn(task.data);
+
+    if (--m_pending == 0)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_wake.notify_all();
+    }
+}
+
+//-----------------------------------------------------------------------------
+bool WorkPool::RunOne()
+{
+    Task task;
+    if (!Pop((sPool == this) ? sQueueIdx : 0, task))
+        return false;
+    Run(task);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+void WorkPool::Wait()
+{
+    while (m_pending != 0)
+    {
+        if (RunOne())
+            continue;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_wake.wait(lock, [this] { return m_pending == 0 || m_queued != 0; });
+    }
+}
+
+//-----------------------------------------------------------------------------
+void WorkPool::WorkerMain(unsigned idx)
+{
+    sPool = this;
+    sQueueIdx = idx;
+
+    for (;;)
+    {
+        Task task;
+        if (Pop(idx, task))
+        {
+            Run(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_wake.wait(lock, [this] { return m_stop || m_queued != 0; });
+        if (m_stop && m_queued == 0)
+            break;
+    }
+
+    sPool = NULL;
+}
@@ -0,0 +1,98 @@
+//-----------------------------------------------------------------------------
+// WorkPool - Work-stealing thread pool used by parallel directory scan.
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+//-----------------------------------------------------------------------------
+// Work-stealing thread pool.
+//
+// Each worker owns a task queue. Tasks submitted from a worker go to its own
+// queue and are popped LIFO (depth first, warm caches). Idle workers steal
+// FIFO from the other queues, so the oldest (largest) subtrees migrate.
+// Tasks submitted from a non-worker thread are spread round-robin.
+class WorkPool
+{
+public:
+    typedef void (*Task_fn)(void* data);
+
+    // threads=0 uses one worker per hardware thread.
+    WorkPool(unsigned threads = 0);
+    ~WorkPool();
+
+    void Submit(Task_fn taskFn, void* data);
+
+    // Run one queued task on the calling thread, return false if none queued.
+    bool RunOne();
+
+    // Wait for all submitted tasks to finish, calling thread helps run tasks.
+    void Wait();
+
+    unsigned Size() const
+    { return (unsigned)m_workers.size(); }
+
+    // Default worker count.
+    static unsigned DefaultThreads();
+
+private:
+    WorkPool(const WorkPool&);
+    WorkPool& operator=(const WorkPool&);
+
+    struct Task
+    {
+        Task_fn  taskFn;
+        void*    data;
+    };
+
+    struct TaskQueue
+    {
+        std::mutex       mutex;
+        std::deque<Task> tasks;
+    };
+
+    void WorkerMain(unsigned idx);
+    bool Pop(unsigned idx, Task& task);
+    void Run(const Task& task);
+
+    std::vector<TaskQueue*>     m_queues;
+    std::vector<std::thread>    m_workers;
+    std::mutex                  m_mutex;
+    std::condition_variable     m_wake;
+    std::atomic<unsigned>       m_queued;       // tasks sitting in queues
+    std::atomic<unsigned>       m_pending;      // tasks submitted but not finished
+    std::atomic<unsigned>       m_nextQueue;
+    bool                        m_stop;
+};
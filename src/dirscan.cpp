@@ -29,9 +29,20 @@
 //-----------------------------------------------------------------------------
 
 #include <iostream>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <deque>
 
 #include "dirscan.h"
 #include "llmsg.h"
+#include "WorkPool.h"
+#include "ScanStream.h"
+#include "DirReader.h"
+#include "Handle.h"
+#include "Arena.h"
+#include "FileEntry.h"
 // #include "llsupport.h"
 // #include "llpath.h"
 
@@ -41,7 +52,6 @@
 //
 static char sDirChr = '\\';     // Same as LLPath::sDirChr();
 static char sDirSlash[] = "\\";   // Same as LLPath::sDirSlash
-bool (*DirectoryScan::ChrCmp)(char c1, char c2) = DirectoryScan::NCaseChrCmp;
 
 //-----------------------------------------------------------------------------
 // Remove duplicate characters.
@@ -57,171 +67,28 @@ static void RemoveDup(char* inStr, char dupChr)
 }
 
 //-----------------------------------------------------------------------------
-// Simple wildcard matcher, used by directory file scanner.
-// Patterns supported:
-//          ?        ; any single character
-//          *        ; zero or more characters
-
-static bool WildCompare(const char* wildStr, int wildOff, const char* rawStr, int rawOff)
-{
-    const char EOS = '\0';
-    while (wildStr[wildOff])
-    {
-        if (rawStr[rawOff] == EOS)
-            return (wildStr[wildOff] == '*');
-
-        if (wildStr[wildOff] == '*')
-        {
-            if (wildStr[wildOff + 1] == EOS)
-                return true;
-
-            do
-            {
-                // Find match with char after '*'
-                while (rawStr[rawOff] &&
-                    !DirectoryScan::ChrCmp(rawStr[rawOff], wildStr[wildOff+1]))
-                    rawOff++;
-                if (rawStr[rawOff] &&
-                    WildCompare(wildStr, wildOff + 1, rawStr, rawOff))
-                        return true;
-                if (rawStr[rawOff])
-                    ++rawOff;
-            } while (rawStr[rawOff]);
-
-            if (rawStr[rawOff] == EOS)
-                return (wildStr[wildOff+1] == '*');
-        }
-        else if (wildStr[wildOff] == '?')
-        {
-            if (rawStr[rawOff] == EOS)
-                return false;
-            rawOff++;
-        }
-        else
-        {
-            if ( !DirectoryScan::ChrCmp(rawStr[rawOff], wildStr[wildOff]))
-                return false;
-            if (wildStr[wildOff] == EOS)
-                return true;
-            ++rawOff;
-        }
-
-        ++wildOff;
-    }
-
-    return (wildStr[wildOff] == rawStr[rawOff]);
-}
-
-//-----------------------------------------------------------------------------
-// Simple wildcard matcher, used by directory file scanner.
-// Patterns supported:
-//          ?        ; any single character
-//          *        ; zero or more characters
-
 bool WildCompare(
         const char* wildStr,
         const char* rawStr,
         PatInfo& patInfo,
         std::vector<PatInfo>& patInfoLst)
 {
-    const char EOS = '\0';
-    // patInfo.rawLen = 0;
+    size_t lstSz = patInfoLst.size();
+    if (!WildPattern(wildStr + patInfo.wildOff).Capture(rawStr + patInfo.rawOff, patInfoLst))
+        return false;
 
-    while (wildStr[patInfo.wildOff])
+    for (size_t idx = lstSz; idx != patInfoLst.size(); idx++)
     {
-        if (rawStr[patInfo.rawOff] == EOS)
-        {
-            if (wildStr[patInfo.wildOff] == '*')
-            {
-                patInfo.rawLen = 0;
-                patInfoLst.push_back(patInfo);
-                return true;
-            }
-            return false;
-        }
-
-        if (wildStr[patInfo.wildOff] == '*')
-        {
-            if (wildStr[patInfo.wildOff + 1] == EOS)
-            {
-                patInfo.rawLen = strlen(rawStr + patInfo.rawOff);
-                patInfoLst.push_back(patInfo);
-                return true;
-            }
-
-            unsigned lstSz = patInfoLst.size();
-            patInfo.rawLen = 0;
-            patInfoLst.push_back(patInfo);
-
-            do
-            {
-                // Find match with char after '*'
-                while (rawStr[patInfo.rawOff] &&
-                    !DirectoryScan::ChrCmp(rawStr[patInfo.rawOff], wildStr[patInfo.wildOff+1]))
-                {
-                    patInfo.rawOff++;
-                    patInfo.rawLen++;
-                }
-
-                PatInfo patInfo2(patInfo);
-                patInfo2.wildOff++;
-                if (rawStr[patInfo.rawOff] &&
-                    WildCompare(wildStr, rawStr, patInfo2, patInfoLst))
-                {
-                    patInfoLst[lstSz].rawLen = patInfo.rawLen;
-                    return true;
-                }
-                patInfoLst.resize(lstSz+1);
-
-                if (rawStr[patInfo.rawOff])
-                    ++patInfo.rawOff;
-            } while (rawStr[patInfo.rawOff]);
-
-            patInfoLst.resize(lstSz);
-
-            if (rawStr[patInfo.rawOff] == EOS)
-            {
-                if (wildStr[patInfo.wildOff+1] == '*')
-                {
-                    patInfo.rawLen = 0;
-                    patInfoLst.push_back(patInfo);
-                    return true;
-                }
-                return false;
-            }
-        }
-        else if (wildStr[patInfo.wildOff] == '?')
-        {
-            if (rawStr[patInfo.rawOff] == EOS)
-                return false;
-
-            patInfo.rawLen = 1;
-            patInfoLst.push_back(patInfo);
-            patInfo.rawOff++;
-            // patInfo.rawLen++;
-        }
-        else
-        {
-            if ( !DirectoryScan::ChrCmp(rawStr[patInfo.rawOff], wildStr[patInfo.wildOff]))
-                return false;
-            if (wildStr[patInfo.wildOff] == EOS)
-                return true;
-
-            patInfo.rawOff++;
-            // patInfo.rawLen++;
-        }
-
-        patInfo.wildOff++;
-        // patInfo.rawLen++;
+        patInfoLst[idx].rawOff  += patInfo.rawOff;
+        patInfoLst[idx].wildOff += patInfo.wildOff;
     }
-
-    return (wildStr[patInfo.wildOff] == rawStr[patInfo.rawOff]);
+    return true;
 }
 
 //-----------------------------------------------------------------------------
 bool PatternMatch(const std::string& pattern, const char* str)
 {
-    return WildCompare(pattern.c_str(), 0, str, 0);
+    return WildPattern(pattern).Match(str);
 }
 
 //-----------------------------------------------------------------------------
@@ -236,9 +103,15 @@ DirectoryScan::DirectoryScan() :
     m_add_cb(0),
     m_cb_data(0),
     m_filesFirst(false),
-    m_entryType(eFilesDir)
+    m_entryType(eFilesDir),
+    m_scanMode(eScanSerial),
+    m_threads(0),
+    m_maxAheadDirs(1024),
+    m_streamBatch(0),
+    m_prefetchInfo(false),
+    m_fileInfo(NULL),
+    m_dirCache(NULL)
 {
-    m_dir[0] = '\0';
 }
 
 //-----------------------------------------------------------------------------
@@ -251,6 +124,11 @@ DirectoryScan::~DirectoryScan()
 //-----------------------------------------------------------------------------
 size_t DirectoryScan::GetFilesInDirectory(int depth)
 {
+    if (m_streamBatch != 0)
+        return ScanStream::Dispatch(*this, depth);
+    if (m_scanMode != eScanSerial || m_prefetchInfo)
+        return GetFilesInDirectoryParallel(depth);
+
     if (m_filesFirst)
     {
         bool recurse = m_recurse;
@@ -273,6 +151,69 @@ size_t DirectoryScan::GetFilesInDirectory(int depth)
     return GetFilesInDirectory2(depth);
 }
 
+//-----------------------------------------------------------------------------
+// Return true if subdirectory name in pDir should not be scanned.
+bool DirectoryScan::PruneDir(const char* pDir, const char* name) const
+{
+    if (!m_onlyDirs.Empty() && !m_onlyDirs.Match(name))
+        return true;
+    if (m_pruneDirs.Empty())
+        return false;
+
+    // Same path FilterDir builds, with a trailing slash so "*\name\*" matches.
+    // Built in the calling thread's scratch arena, scan workers call this too.
+    Arena& arena = Arena::ThreadLocal();
+    ArenaScope scope(arena);
+    size_t dirLen = strlen(pDir);
+    size_t nameLen = strlen(name);
+    char* path = (char*)arena.Alloc(dirLen + nameLen + 3, 1);
+    size_t pathLen = dirLen;
+    memcpy(path, pDir, dirLen);
+    if (pathLen == 0 || path[pathLen-1] != sDirChr)
+        path[pathLen++] = sDirChr;
+    memcpy(path + pathLen, name, nameLen);
+    pathLen += nameLen;
+    path[pathLen++] = sDirChr;
+    path[pathLen] = '\0';
+    return m_pruneDirs.Match(path, pathLen);
+}
+
+//-----------------------------------------------------------------------------
+// Return search path "dir\*" of dir, duplicate slashes are removed from both.
+static std::string DirSearch(std::string& dir)
+{
+    size_t dirLen = dir.length();
+    dir += "\\*";
+    RemoveDup(&dir[1], '\\');      // Okay for \\ to appear in front, remove others.
+    dir.resize(strlen(dir.c_str()));
+
+    std::string search(dir);
+    if (dir.length() > dirLen)
+        dir.resize(dirLen);
+    return search;
+}
+
+//-----------------------------------------------------------------------------
+// One open directory on the GetFilesInDirectory2 stack.
+struct ScanFrame
+{
+    DirReader       dirReader;
+    WIN32_FIND_DATA fileData;
+    size_t          dirLen;         // length of this directory's path in m_dir
+    int             depth;
+    DirectoryScan::EntryType entryType;
+};
+
+//-----------------------------------------------------------------------------
+// Open dirScan.m_dir for frame, m_dir is left holding the directory path.
+static bool OpenFrame(DirectoryScan& dirScan, ScanFrame& frame)
+{
+    dirScan.m_entryType = frame.entryType;
+    bool opened = frame.dirReader.Open(DirSearch(dirScan.m_dir).c_str(), dirScan.m_dirCache);
+    frame.dirLen = dirScan.m_dir.length();
+    return opened;
+}
+
 //-----------------------------------------------------------------------------
 //  When a 32-bit application reads from one of these folders on a 64-bit OS:
 //
@@ -292,19 +233,17 @@ size_t DirectoryScan::GetFilesInDirectory(int depth)
 //
 size_t DirectoryScan::GetFilesInDirectory2(int depth)
 {
-    WIN32_FIND_DATA FileData;    // Data structure describes the file found
-    HANDLE  hSearch;             // Search handle returned by FindFirstFile
-    bool    is_more = true;
+    // Directories are walked with an explicit stack, one frame per open directory.
+    // m_dir holds the path of the top frame, it grows on the way down and is
+    // truncated back to the parent's length on the way out.
+    std::deque<ScanFrame> stack;
     size_t  fileCnt = 0;
-    size_t  dirLen = strlen(m_dir);
-
-    strcat_s(m_dir, ARRAYSIZE(m_dir), "\\*");
-    RemoveDup(m_dir+1, '\\');      // Okay for \\ to appear in front, remove others.
-
-    // Start searching for folder (directories), starting with srcdir directory.
 
-    hSearch = FindFirstFile(m_dir, &FileData);
-    if (hSearch == INVALID_HANDLE_VALUE)
+    stack.emplace_back();
+    stack.back().dirLen = m_dir.length();
+    stack.back().depth = depth;
+    stack.back().entryType = m_entryType;
+    if (!OpenFrame(*this, stack.back()))
     {
         // No files found
         if (depth == 0)
@@ -314,81 +253,745 @@ size_t DirectoryScan::GetFilesInDirectory2(int depth)
         return 0;
     }
 
-    m_dir[dirLen] = '\0';
-    while (is_more && !m_abort)
+    while (!stack.empty())
     {
-        if ((FileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+        ScanFrame& frame = stack.back();
+        WIN32_FIND_DATA& FileData = frame.fileData;
+        depth = frame.depth;
+
+        if (!m_abort && frame.dirReader.Next(FileData))
         {
-            if (m_skipJunction && (FileData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0)
+            if ((FileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+            {
+                if (m_skipJunction && (FileData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0)
+                    continue;
+
+                if (m_entryType != eFile &&
+                   (FileData.cFileName[0] != '.' ||  isalnum(FileData.cFileName[1])))
+                {
+                    if (m_recurse || depth < (int)m_dirFilters.size())
+                    {
+                        int newDepth = depth + 1;
+                        if ((int)m_dirFilters.size() < newDepth
+                            || m_dirMatch[depth].Match(FileData.cFileName))
+                        {
+                            if ((m_entryType == eDir || m_entryType == eFilesDir) &&
+                                m_add_cb && depth >= (int)m_dirFilters.size())
+                                m_add_cb(m_cb_data, m_dir.c_str(), &FileData, depth);
+
+                            if (depth >= (int)m_dirFilters.size() && PruneDir(m_dir.c_str(), FileData.cFileName))
+                                continue;
+
+                            // Descend, in files first mode each directory is read twice,
+                            // files only and then directories.
+                            m_dir += sDirChr;
+                            m_dir += FileData.cFileName;
+                            stack.emplace_back();
+                            ScanFrame& child = stack.back();
+                            child.dirLen = m_dir.length();
+                            child.depth = newDepth;
+                            child.entryType = m_filesFirst ? eFile : eFilesDir;
+                            if (!OpenFrame(*this, child))
+                            {
+                                stack.pop_back();
+                                m_dir.resize(frame.dirLen);
+                                m_entryType = frame.entryType;
+                            }
+                        }
+                    }
+                    else if (m_fileMatch.Match(FileData.cFileName))
+                    {
+                        if (m_add_cb)
+                            m_add_cb(m_cb_data, m_dir.c_str(), &FileData, depth);
+                    }
+                }
+            }
+            else
             {
-                is_more = (FindNextFile(hSearch, &FileData) != 0) ? true : false;
+                if (m_entryType != eDir)
+                {
+                    ++fileCnt;
+                    if (m_fileMatch.Match(FileData.cFileName))
+                    {
+                        if (m_add_cb && depth >= (int)m_dirFilters.size())
+                            m_add_cb(m_cb_data, m_dir.c_str(), &FileData, depth);
+                    }
+                }
+            }
+            continue;
+        }
+
+        // Close directory before calling callback incase client wants to delete dir.
+        DWORD err = frame.dirReader.Error();
+        frame.dirReader.Close();
+
+        if (err != ERROR_NO_MORE_FILES && !m_abort)
+        {
+            LLMsg::PresentError(err, "DirScan ", "\n");
+        }
+
+        if (m_entryType != eFile)
+        {
+            // Set attribute for end-of-directory
+            FileData.dwFileAttributes = FILE_ATTRIBUTE_DIRECTORY;
+            FileData.cFileName[0] = '\0';
+            int dirDepth = -1 - depth;
+
+            // dirDepth is positive while walking down into directories and negative when
+            // walking back out.
+            //      del command will delete directories on the way out.
+            if (m_recurse || dirDepth >= 0 || m_addAllDepths)
+            if (m_add_cb && (m_dirFilters.size() == 0 || depth >= (int)m_dirFilters.size() || m_addAllDepths))
+                m_add_cb(m_cb_data, m_dir.c_str(), &FileData, dirDepth);
+        }
+        else if (stack.size() != 1 && m_recurse)
+        {
+            // Files first, second pass over subdirectory for directories.
+            frame.entryType = eDir;
+            if (OpenFrame(*this, frame))
+                continue;
+        }
+
+        stack.pop_back();
+        if (!stack.empty())
+        {
+            m_dir.resize(stack.back().dirLen);
+            m_entryType = stack.back().entryType;
+        }
+    }
+
+    return fileCnt;
+}
+
+//=================================================================================================
+// Parallel scan
+//
+// Directories are read (FindFirstFile/FindNextFile) by WorkPool tasks into ScanNode lists.
+//
+// eScanParallel - The calling thread replays the nodes in the same depth first order and
+//   with the same filtering as GetFilesInDirectory2, so m_add_cb sees identical calls.
+//   Workers read ahead of the replay, limited to m_maxAheadDirs unconsumed directories.
+//   If the replay reaches a directory which is not read yet it reads it inline.
+//
+// eScanUnordered - Each task reads a directory, reports its entries and queues its
+//   subdirectories. Callbacks are serialized by a lock. A directory's end-of-directory
+//   callback is made after all of its subdirectories have completed.
+//
+// m_prefetchInfo - After a directory is read its per-entry handle information is fetched
+//   by the pool in chunks, the reading thread works on chunks too. With eScanSerial
+//   the replay is used without read ahead, so only the prefetch runs in parallel.
+
+struct ParallelScan;
+
+struct ScanNode
+{
+    enum State { eQueued, eRunning, eReady };
+
+    ScanNode(const std::string& _search, int _depth, ParallelScan* _scan, ScanNode* _parent) :
+        search(_search),
+        depth(_depth),
+        found(false),
+        readAhead(false),
+        error(ERROR_NO_MORE_FILES),
+        state(eQueued),
+        refs(1),
+        pending(1),
+        scan(_scan),
+        parent(_parent)
+    { }
+
+    void Release()
+    {
+        if (--refs == 0)
+            delete this;
+    }
+
+    std::string     search;         // Directory path with "\*" appended
+    int             depth;
+    bool            found;          // FindFirstFile succeeded
+    bool            readAhead;      // Subdirectories have been queued
+    DWORD           error;          // Error which ended FindNextFile loop
+    FileEntryList   entries;
+    std::vector<DirectoryScan::FileInfo> infos;     // m_prefetchInfo
+
+    std::atomic<int>        state;
+    std::atomic<int>        refs;
+    std::atomic<unsigned>   pending;    // eScanUnordered, self plus incomplete subdirectories
+    ParallelScan*           scan;
+    ScanNode*               parent;
+};
+
+struct ParallelScan
+{
+    ParallelScan(DirectoryScan& _dirScan) :
+        dirScan(_dirScan),
+        recurse(_dirScan.m_recurse),
+        filesFirst(_dirScan.m_filesFirst),
+        done(false),
+        fileCnt(0),
+        pool(_dirScan.m_threads)
+    { }
+
+    DirectoryScan&  dirScan;
+    bool            recurse;
+    bool            filesFirst;
+    volatile bool   done;
+
+    // eScanParallel directories read ahead, keyed by search path.
+    std::mutex      mutex;
+    std::condition_variable ready;
+    std::unordered_map<std::string, ScanNode*> ahead;
+
+    // eScanUnordered
+    std::mutex      cbMutex;
+    std::atomic<size_t> fileCnt;
+
+    // Last member, so workers are joined before the rest is destroyed.
+    WorkPool        pool;
+};
+
+static thread_local bool sWow64Disabled = false;
+
+//-----------------------------------------------------------------------------
+// Build search path of a subdirectory, same as GetFilesInDirectory2 does in m_dir.
+static std::string SubDirSearch(const std::string& search, const char* name)
+{
+    std::string subSearch(search, 0, search.length() - 1);  // remove '*'
+    subSearch += name;
+    subSearch += "\\*";
+    RemoveDup(&subSearch[1], '\\');
+    subSearch.resize(strlen(subSearch.c_str()));
+    return subSearch;
+}
+
+//-----------------------------------------------------------------------------
+// Read all entries of one directory.
+static void ReadDir(ScanNode* node)
+{
+    DirectoryScan& dirScan = node->scan->dirScan;
+
+    // Redirection state is per thread.
+    if (dirScan.m_disableWow64Redirection && !sWow64Disabled)
+    {
+        PVOID oldWow64Redirection;
+        Wow64DisableWow64FsRedirection(&oldWow64Redirection);
+        sWow64Disabled = true;
+    }
+
+    WIN32_FIND_DATA FileData;
+    DirReader dirReader;
+    if (!dirReader.Open(node->search.c_str(), dirScan.m_dirCache))
+        return;
+
+    FileEntry entry;
+    while (!dirScan.m_abort && dirReader.Next(FileData))
+    {
+        ToFileEntry(FileData, entry);
+        node->entries.Add(entry);
+    }
+    node->found = !node->entries.Empty();
+
+    node->error = dirScan.m_abort ? ERROR_NO_MORE_FILES : dirReader.Error();
+}
+
+//-----------------------------------------------------------------------------
+// Chunks of one directory's handle information, shared by the pool tasks helping fetch it.
+struct InfoBatch
+{
+    InfoBatch(ScanNode* _node, unsigned _chunks, int _refs) :
+        node(_node),
+        dir(_node->search, 0, _node->search.length() - 1),
+        chunks(_chunks),
+        next(0),
+        done(0),
+        refs(_refs)
+    { }
+
+    void Release()
+    {
+        if (--refs == 0)
+            delete this;
+    }
+
+    ScanNode*       node;
+    std::string     dir;            // Directory path with trailing slash
+    unsigned        chunks;
+    std::atomic<unsigned> next;     // Next chunk to claim
+    std::atomic<unsigned> done;     // Chunks completed
+    std::atomic<int> refs;
+    std::mutex      mutex;
+    std::condition_variable finished;
+};
+
+static const unsigned sInfoChunk = 32;
+
+//-----------------------------------------------------------------------------
+static void FetchInfoChunks(InfoBatch* batch)
+{
+    ScanNode* node = batch->node;
+    std::string path;
+    unsigned chunk;
+
+    while ((chunk = batch->next++) < batch->chunks)
+    {
+        unsigned endIdx = min((chunk + 1) * sInfoChunk, (unsigned)node->entries.Size());
+        for (unsigned idx = chunk * sInfoChunk; idx < endIdx; idx++)
+        {
+            const FileEntry& entry = node->entries[idx];
+            DirectoryScan::FileInfo& fileInfo = node->infos[idx];
+            fileInfo.valid = false;
+            if (entry.name[0] == '.' && !isalnum(entry.name[1]))
                 continue;
+
+            path = batch->dir;
+            path += entry.name;
+            Handle fileHnd =
+                CreateFile(DirReader::ExtendedPath(path.c_str()).c_str(), FILE_READ_ATTRIBUTES, 7, 0, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, 0);
+            if (fileHnd.IsValid())
+                fileInfo.valid = (GetFileInformationByHandle(fileHnd, &fileInfo.info) != 0);
+        }
+
+        if (++batch->done == batch->chunks)
+        {
+            std::lock_guard<std::mutex> lock(batch->mutex);
+            batch->finished.notify_all();
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+static void FetchInfoTask(void* data)
+{
+    InfoBatch* batch = (InfoBatch*)data;
+    FetchInfoChunks(batch);
+    batch->Release();
+}
+
+//-----------------------------------------------------------------------------
+// Fetch handle information for all entries of node, spread over the pool.
+static void PrefetchInfo(ScanNode* node)
+{
+    ParallelScan& scan = *node->scan;
+    if (!scan.dirScan.m_prefetchInfo || !node->found || node->infos.size() == node->entries.Size())
+        return;
+
+    node->infos.resize(node->entries.Size());
+    unsigned chunks  = ((unsigned)node->entries.Size() + sInfoChunk - 1) / sInfoChunk;
+    unsigned helpers = min(chunks - 1, scan.pool.Size());
+    InfoBatch* batch = new InfoBatch(node, chunks, 1 + helpers);
+
+    for (unsigned idx = 0; idx != helpers; idx++)
+        scan.pool.Submit(FetchInfoTask, batch);
+
+    FetchInfoChunks(batch);
+    {
+        std::unique_lock<std::mutex> lock(batch->mutex);
+        batch->finished.wait(lock, [batch] { return batch->done == batch->chunks; });
+    }
+    batch->Release();
+}
+
+//-----------------------------------------------------------------------------
+// Return true if GetFilesInDirectory2 would descend into this entry.
+static bool IsScanDir(const ParallelScan& scan, const FileEntry& entry, int depth)
+{
+    const DirectoryScan& dirScan = scan.dirScan;
+    int nFilters = (int)dirScan.m_dirFilters.size();
+
+    return (entry.attributes & FILE_ATTRIBUTE_DIRECTORY) != 0
+        && !(dirScan.m_skipJunction && (entry.attributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0)
+        && (entry.name[0] != '.' || isalnum(entry.name[1]))
+        && (scan.recurse || depth < nFilters)
+        && (nFilters < depth + 1 || dirScan.m_dirMatch[depth].Match(entry.name, entry.nameLen));
+}
+
+//-----------------------------------------------------------------------------
+// Pass entry to m_add_cb, which still takes a WIN32_FIND_DATA.
+static int AddEntry(DirectoryScan& dirScan, const char* pDir, const FileEntry& entry, int depth)
+{
+    WIN32_FIND_DATA FileData;
+    ToFindData(entry, FileData);
+    return dirScan.m_add_cb(dirScan.m_cb_data, pDir, &FileData, depth);
+}
+
+//-----------------------------------------------------------------------------
+// Return true if scan directory entry is not descended into, see DirectoryScan::PruneDir.
+static bool IsPruned(const ParallelScan& scan, const std::string& search, const FileEntry& entry, int depth)
+{
+    const DirectoryScan& dirScan = scan.dirScan;
+    if (depth < (int)dirScan.m_dirFilters.size()
+        || (dirScan.m_pruneDirs.Empty() && dirScan.m_onlyDirs.Empty()))
+        return false;
+
+    Arena& arena = Arena::ThreadLocal();
+    ArenaScope scope(arena);
+    const char* dir = arena.StrDup(search.c_str(), search.length() - 2);    // remove "\*"
+    return dirScan.PruneDir(dir, entry.name);
+}
+
+static void ReadAheadTask(void* data);
+
+//-----------------------------------------------------------------------------
+// Queue subdirectories of node in scan order, while under m_maxAheadDirs.
+static void ReadAhead(ScanNode* node)
+{
+    ParallelScan& scan = *node->scan;
+    if (!node->found || (scan.filesFirst && !scan.recurse) || scan.dirScan.m_scanMode == DirectoryScan::eScanSerial)
+    {
+        node->readAhead = true;
+        return;
+    }
+
+    std::vector<ScanNode*> subDirs;
+    bool complete = true;
+    {
+        std::lock_guard<std::mutex> lock(scan.mutex);
+        for (unsigned idx = 0; idx != node->entries.Size() && !scan.done; idx++)
+        {
+            const FileEntry& entry = node->entries[idx];
+            if (!IsScanDir(scan, entry, node->depth)
+                || IsPruned(scan, node->search, entry, node->depth))
+                continue;
+
+            if (scan.ahead.size() >= scan.dirScan.m_maxAheadDirs)
+            {
+                complete = false;
+                break;
+            }
+
+            std::string subSearch = SubDirSearch(node->search, entry.name);
+            if (scan.ahead.count(subSearch) == 0)
+            {
+                ScanNode* subNode = new ScanNode(subSearch, node->depth + 1, &scan, NULL);
+                subNode->refs = 2;      // ahead map + task
+                scan.ahead[subSearch] = subNode;
+                subDirs.push_back(subNode);
             }
+        }
+    }
+
+    // Queue in reverse so the worker's LIFO pop returns the first subdirectory next.
+    for (unsigned idx = (unsigned)subDirs.size(); idx != 0; idx--)
+        scan.pool.Submit(ReadAheadTask, subDirs[idx-1]);
+
+    node->readAhead = complete;
+}
+
+//-----------------------------------------------------------------------------
+static void ReadAheadTask(void* data)
+{
+    ScanNode* node = (ScanNode*)data;
+    ParallelScan& scan = *node->scan;
+
+    int expected = ScanNode::eQueued;
+    if (node->state.compare_exchange_strong(expected, ScanNode::eRunning))
+    {
+        ReadDir(node);
+        if (!scan.done)
+            ReadAhead(node);
+        PrefetchInfo(node);
+
+        {
+            std::lock_guard<std::mutex> lock(scan.mutex);
+            node->state = ScanNode::eReady;
+        }
+        scan.ready.notify_all();
+    }
+
+    node->Release();
+}
+
+//-----------------------------------------------------------------------------
+// Get directory read ahead by a worker or read it now.
+static ScanNode* TakeDir(ParallelScan& scan, const std::string& search, int depth)
+{
+    ScanNode* node = NULL;
+    {
+        std::unique_lock<std::mutex> lock(scan.mutex);
+        std::unordered_map<std::string, ScanNode*>::iterator iter = scan.ahead.find(search);
+        if (iter != scan.ahead.end())
+        {
+            node = iter->second;
+            scan.ahead.erase(iter);
+
+            int expected = ScanNode::eQueued;
+            if (!node->state.compare_exchange_strong(expected, ScanNode::eRunning))
+            {
+                scan.ready.wait(lock, [node] { return node->state == ScanNode::eReady; });
+                return node;
+            }
+        }
+    }
+
+    if (node == NULL)
+        node = new ScanNode(search, depth, &scan, NULL);
+    ReadDir(node);
+    node->state = ScanNode::eReady;
+    return node;
+}
+
+static size_t ScanOrdered(ParallelScan& scan, int depth);
+
+//-----------------------------------------------------------------------------
+// Same logic as GetFilesInDirectory2, reading entries from node.
+static size_t ReplayDir(ParallelScan& scan, ScanNode* node, int depth)
+{
+    DirectoryScan& dirScan = scan.dirScan;
+    std::string& m_dir = dirScan.m_dir;
+    size_t  fileCnt = 0;
+    size_t  dirLen = m_dir.length();
+    int     nFilters = (int)dirScan.m_dirFilters.size();
+
+    for (unsigned idx = 0; idx != node->entries.Size() && !dirScan.m_abort; idx++)
+    {
+        const FileEntry& entry = node->entries[idx];
+        dirScan.m_fileInfo = node->infos.empty() ? NULL : &node->infos[idx];
 
-            if (m_entryType != eFile &&
-               (FileData.cFileName[0] != '.' ||  isalnum(FileData.cFileName[1])))
+        if ((entry.attributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+        {
+            if (dirScan.m_skipJunction && (entry.attributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0)
+                continue;
+
+            if (dirScan.m_entryType != DirectoryScan::eFile &&
+               (entry.name[0] != '.' ||  isalnum(entry.name[1])))
             {
-                if (m_recurse || depth < (int)m_dirFilters.size())
+                if (dirScan.m_recurse || depth < nFilters)
                 {
                     int newDepth = depth + 1;
-                    if ((int)m_dirFilters.size() < newDepth
-                        || PatternMatch(m_dirFilters[depth], FileData.cFileName))
+                    if (nFilters < newDepth
+                        || dirScan.m_dirMatch[depth].Match(entry.name, entry.nameLen))
                     {
-                        if ((m_entryType == eDir || m_entryType == eFilesDir) &&
-                            m_add_cb && depth >= (int)m_dirFilters.size())
-                            m_add_cb(m_cb_data, m_dir, &FileData, depth);
-
-                        m_dir[dirLen] = sDirChr;
-                        strcpy_s(m_dir + dirLen +1, ARRAYSIZE(m_dir) - dirLen - 1, FileData.cFileName);
-                        fileCnt += GetFilesInDirectory(depth+1);
-                        m_dir[dirLen] = '\0';
+                        if (dirScan.m_add_cb && depth >= nFilters)
+                            AddEntry(dirScan, m_dir.c_str(), entry, depth);
+
+                        if (depth >= nFilters && dirScan.PruneDir(m_dir.c_str(), entry.name))
+                            continue;
+
+                        m_dir += sDirChr;
+                        m_dir += entry.name;
+                        dirScan.m_fileInfo = NULL;
+                        fileCnt += ScanOrdered(scan, depth+1);
+                        m_dir.resize(dirLen);
                     }
                 }
-                else if (m_fileFilter.empty() || PatternMatch(m_fileFilter, FileData.cFileName))
+                else if (dirScan.m_fileMatch.Match(entry.name, entry.nameLen))
                 {
-                    if (m_add_cb)
-                        m_add_cb(m_cb_data, m_dir, &FileData, depth);
+                    if (dirScan.m_add_cb)
+                        AddEntry(dirScan, m_dir.c_str(), entry, depth);
                 }
             }
         }
         else
         {
-            if (m_entryType != eDir)
+            if (dirScan.m_entryType != DirectoryScan::eDir)
             {
                 ++fileCnt;
-                if (m_fileFilter.empty() || PatternMatch(m_fileFilter, FileData.cFileName))
+                if (dirScan.m_fileMatch.Match(entry.name, entry.nameLen))
                 {
-                    if (m_add_cb && depth >= (int)m_dirFilters.size())
-                        m_add_cb(m_cb_data, m_dir, &FileData, depth);
+                    if (dirScan.m_add_cb && depth >= nFilters)
+                        AddEntry(dirScan, m_dir.c_str(), entry, depth);
                 }
             }
         }
-
-        is_more = (FindNextFile(hSearch, &FileData) != 0) ? true : false;
     }
 
-    // Close directory before calling callback incase client wants to delete dir.
-    FindClose(hSearch);
-
-    DWORD err = GetLastError();
-    if (err != ERROR_NO_MORE_FILES && !m_abort)
+    dirScan.m_fileInfo = NULL;
+    if (node->error != ERROR_NO_MORE_FILES && !dirScan.m_abort)
     {
-        LLMsg::PresentError(err, "DirScan ", "\n");
+        LLMsg::PresentError(node->error, "DirScan ", "\n");
     }
 
-    if (m_entryType != eFile)
+    if (dirScan.m_entryType != DirectoryScan::eFile)
     {
         // Set attribute for end-of-directory
+        WIN32_FIND_DATA FileData;
+        ToFindData(node->entries.Back(), FileData);
         FileData.dwFileAttributes = FILE_ATTRIBUTE_DIRECTORY;
         FileData.cFileName[0] = '\0';
         int dirDepth = -1 - depth;
 
-        // dirDepth is positive while walking down into directories and negative when
-        // walking back out.
-        //      del command will delete directories on the way out.
-        if (m_recurse || dirDepth >= 0 || m_addAllDepths)
-        if (m_add_cb && (m_dirFilters.size() == 0 || depth >= (int)m_dirFilters.size() || m_addAllDepths))
-            m_add_cb(m_cb_data, m_dir, &FileData, dirDepth);
+        if (dirScan.m_recurse || dirDepth >= 0 || dirScan.m_addAllDepths)
+        if (dirScan.m_add_cb && (nFilters == 0 || depth >= nFilters || dirScan.m_addAllDepths))
+            dirScan.m_add_cb(dirScan.m_cb_data, m_dir.c_str(), &FileData, dirDepth);
+    }
+
+    return fileCnt;
+}
+
+//-----------------------------------------------------------------------------
+// Same logic as GetFilesInDirectory.
+static size_t ScanOrdered(ParallelScan& scan, int depth)
+{
+    DirectoryScan& dirScan = scan.dirScan;
+    size_t  fileCnt = 0;
+    ScanNode* node = TakeDir(scan, DirSearch(dirScan.m_dir), depth);
+
+    if (node->found)
+    {
+        if (!node->readAhead)
+            ReadAhead(node);
+        PrefetchInfo(node);
+
+        if (scan.filesFirst)
+        {
+            dirScan.m_entryType = DirectoryScan::eFile;
+            dirScan.m_recurse   = false;
+            fileCnt = ReplayDir(scan, node, depth);
+
+            if (scan.recurse)
+            {
+                dirScan.m_entryType = DirectoryScan::eDir;
+                dirScan.m_recurse   = true;
+                fileCnt += ReplayDir(scan, node, depth);
+            }
+        }
+        else
+        {
+            dirScan.m_entryType = DirectoryScan::eFilesDir;
+            fileCnt = ReplayDir(scan, node, depth);
+        }
+    }
+
+    node->Release();
+    return fileCnt;
+}
+
+//-----------------------------------------------------------------------------
+// Called when node and all of its subdirectories are done, make end-of-directory callback.
+static void CompleteDir(ScanNode* node)
+{
+    while (node != NULL && --node->pending == 0)
+    {
+        ParallelScan& scan = *node->scan;
+        DirectoryScan& dirScan = scan.dirScan;
+        int nFilters = (int)dirScan.m_dirFilters.size();
+
+        if (node->found && (scan.recurse || dirScan.m_addAllDepths) && dirScan.m_add_cb
+            && (nFilters == 0 || node->depth >= nFilters || dirScan.m_addAllDepths))
+        {
+            std::string dir(node->search, 0, node->search.length() - 2);
+            WIN32_FIND_DATA FileData;
+            ToFindData(node->entries.Back(), FileData);
+            FileData.dwFileAttributes = FILE_ATTRIBUTE_DIRECTORY;
+            FileData.cFileName[0] = '\0';
+
+            std::lock_guard<std::mutex> lock(scan.cbMutex);
+            dirScan.m_add_cb(dirScan.m_cb_data, dir.c_str(), &FileData, -1 - node->depth);
+        }
+
+        ScanNode* parent = node->parent;
+        delete node;
+        node = parent;
+    }
+}
+
+//-----------------------------------------------------------------------------
+static void UnorderedTask(void* data)
+{
+    ScanNode* node = (ScanNode*)data;
+    ParallelScan& scan = *node->scan;
+    DirectoryScan& dirScan = scan.dirScan;
+    int depth = node->depth;
+    int nFilters = (int)dirScan.m_dirFilters.size();
+
+    ReadDir(node);
+    PrefetchInfo(node);
+
+    if (node->found && !dirScan.m_abort)
+    {
+        std::string dir(node->search, 0, node->search.length() - 2);
+        std::vector<unsigned> entries;
+        std::vector<ScanNode*> subDirs;
+        size_t fileCnt = 0;
+
+        for (unsigned idx = 0; idx != node->entries.Size(); idx++)
+        {
+            const FileEntry& entry = node->entries[idx];
+
+            if ((entry.attributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+            {
+                if (IsScanDir(scan, entry, depth))
+                {
+                    if (depth >= nFilters)
+                        entries.push_back(idx);
+
+                    std::string subSearch = SubDirSearch(node->search, entry.name);
+                    if (!IsPruned(scan, node->search, entry, depth))
+                        subDirs.push_back(new ScanNode(subSearch, depth + 1, &scan, node));
+                }
+                else if (!(dirScan.m_skipJunction && (entry.attributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0)
+                    && (entry.name[0] != '.' || isalnum(entry.name[1]))
+                    && !scan.recurse && depth >= nFilters
+                    && dirScan.m_fileMatch.Match(entry.name, entry.nameLen))
+                {
+                    entries.push_back(idx);
+                }
+            }
+            else
+            {
+                ++fileCnt;
+                if (dirScan.m_fileMatch.Match(entry.name, entry.nameLen) && depth >= nFilters)
+                    entries.push_back(idx);
+            }
+        }
+        scan.fileCnt += fileCnt;
+
+        {
+            std::lock_guard<std::mutex> lock(scan.cbMutex);
+            for (unsigned idx = 0; idx != entries.size() && !dirScan.m_abort; idx++)
+            {
+                dirScan.m_fileInfo = node->infos.empty() ? NULL : &node->infos[entries[idx]];
+                if (dirScan.m_add_cb)
+                    AddEntry(dirScan, dir.c_str(), node->entries[entries[idx]], depth);
+            }
+            dirScan.m_fileInfo = NULL;
+
+            if (node->error != ERROR_NO_MORE_FILES && !dirScan.m_abort)
+                LLMsg::PresentError(node->error, "DirScan ", "\n");
+        }
+
+        // Keep last entry for end-of-directory, release the rest.
+        node->entries.KeepLast();
+        node->infos.clear();
+        node->infos.shrink_to_fit();
+
+        node->pending += (unsigned)subDirs.size();
+        for (unsigned idx = 0; idx != subDirs.size(); idx++)
+            scan.pool.Submit(UnorderedTask, subDirs[idx]);
+    }
+
+    CompleteDir(node);
+}
+
+//-----------------------------------------------------------------------------
+size_t DirectoryScan::GetFilesInDirectoryParallel(int depth)
+{
+    ParallelScan scan(*this);
+    size_t fileCnt = 0;
+
+    if (m_scanMode == eScanUnordered)
+    {
+        m_entryType = eFilesDir;
+
+        ScanNode* root = new ScanNode(DirSearch(m_dir), depth, &scan, NULL);
+
+        scan.pool.Submit(UnorderedTask, root);
+        scan.pool.Wait();
+        fileCnt = scan.fileCnt;
+    }
+    else
+    {
+        fileCnt = ScanOrdered(scan, depth);
+
+        // Stop read ahead and release directories which were never reached (abort).
+        scan.done = true;
+        scan.pool.Wait();
+        std::unordered_map<std::string, ScanNode*>::iterator iter;
+        for (iter = scan.ahead.begin(); iter != scan.ahead.end(); ++iter)
+            iter->second->Release();
+        scan.ahead.clear();
+
+        m_recurse = scan.recurse;
     }
 
     return fileCnt;
@@ -486,7 +1089,13 @@ void DirectoryScan::Init(
     if (*pBegDir)
         m_fileFilter = pBegDir;
 
-    strcpy_s(m_dir, ARRAYSIZE(m_dir), defDir);
+    m_dir = defDir;
+
+    // Compile filters once for the whole scan.
+    m_fileMatch.Compile(m_fileFilter.c_str());
+    m_dirMatch.clear();
+    for (unsigned idx = 0; idx != m_dirFilters.size(); idx++)
+        m_dirMatch.push_back(WildPattern(m_dirFilters[idx]));
 
     if (m_disableWow64Redirection)
         Wow64DisableWow64FsRedirection(&m_oldWow64Redirection);
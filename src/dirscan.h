@@ -35,20 +35,18 @@
 #include <string>
 #include <ctype.h>
 #include "ll_stdhdr.h"
+#include "WildPattern.h"
+
+class DirCache;
 
 // Compare a pattern to a string.
 // Patterns supported:
 //          ?        ; any single character
 //          *        ; zero or more characters
+// Compiles pattern on each call, use WildPattern when matching repeatedly.
 bool PatternMatch(const std::string& pattern, const char* str);
 
-struct PatInfo
-{
-    unsigned  rawLen;
-    unsigned  rawOff;
-    unsigned  wildOff;
-};
-
+// Match and append position of each '*' and '?' in wildStr to patInfoLst.
 bool WildCompare(
         const char* wildStr,
         const char* rawStr,
@@ -66,6 +64,9 @@ public:
     size_t GetFilesInDirectory(int depth=0);
     size_t GetFilesInDirectory2(int depth=0);
 
+    // Scan using a work-stealing pool of m_threads, see m_scanMode.
+    size_t GetFilesInDirectoryParallel(int depth=0);
+
     // If m_fileFirst true, then process only files in first pass, directories only
     // in 2nd pass, else both in one pass.
     bool        m_filesFirst;
@@ -73,16 +74,55 @@ public:
     EntryType   m_entryType;
 
 
-    char        m_dir[MAX_PATH];
+    std::string m_dir;                      // Directory being scanned, no length limit
     std::string m_fileFilter;
     std::vector<const char*> m_dirFilters;
+    WildPattern m_fileMatch;                // m_fileFilter compiled by Init
+    std::vector<WildPattern> m_dirMatch;    // m_dirFilters compiled by Init
     bool        m_recurse;
     bool        m_skipJunction;
+
+    // Subdirectories not to descend into, applied below the m_dirFilters levels.
+    // The directory entry itself is still passed to m_add_cb.
+    //      m_pruneDirs  path patterns, matched against "<dir>\<name>\"
+    //      m_onlyDirs   name patterns, if not empty only matching directories are scanned
+    WildPatternSet m_pruneDirs;
+    WildPatternSet m_onlyDirs;
+    bool        PruneDir(const char* pDir, const char* name) const;
+
     bool        m_addAllDepths;
-    bool        m_abort;
+    volatile bool m_abort;
     bool        m_disableWow64Redirection;
     PVOID       m_oldWow64Redirection;
 
+    // eScanSerial    - single thread, depth first.
+    // eScanParallel  - workers read directories ahead, m_add_cb called in serial order.
+    // eScanUnordered - workers read and report directories as they complete,
+    //                  m_add_cb calls are serialized but in no particular order.
+    //                  End-of-directory still follows all entries below it.
+    enum  ScanMode { eScanSerial, eScanParallel, eScanUnordered };
+    ScanMode    m_scanMode;
+    unsigned    m_threads;          // 0=one per hardware thread
+    unsigned    m_maxAheadDirs;     // eScanParallel limit on directories read ahead
+
+    // Non-zero runs the scan on a producer thread and passes its entries to
+    // m_add_cb in batches of m_streamBatch, see ScanStream.
+    unsigned    m_streamBatch;
+
+    // Per-entry handle information (link count, file index, volume).
+    // When m_prefetchInfo is set it is fetched for each directory batch by the
+    // worker pool, before the entries are passed to m_add_cb.
+    struct FileInfo
+    {
+        bool  valid;
+        BY_HANDLE_FILE_INFORMATION info;
+    };
+    bool        m_prefetchInfo;
+    const FileInfo* m_fileInfo;     // Set during m_add_cb, NULL if not prefetched.
+
+    // Replay unchanged directories from a snapshot, NULL to always read, see DirCache.
+    DirCache*   m_dirCache;
+
     typedef int (*Add_cb)(void *, const char* pDir, const WIN32_FIND_DATA * pFileData, int depth);
     Add_cb      m_add_cb;
     void *      m_cb_data;
@@ -94,11 +134,6 @@ public:
     // Pointers to this are stored in the m_dirFilters list.
     std::string m_pathPat;
 
-    // Text comparison functions.
-    static bool YCaseChrCmp(char c1, char c2) { return c1 == c2; }
-    static bool NCaseChrCmp(char c1, char c2) { return ToLower(c1) == ToLower(c2); }
-    static bool (*ChrCmp)(char c1, char c2);
-
     // Utility function to determine if two paths point to same file.
     static bool IsSameFile(const char* path1, const char* path2);
 
@@ -59,8 +59,10 @@ bool LLBase::ParseBaseCmds(const char*& cmdOpts)
     const char excludeEmptyMsg[] = "Invalid exclude syntax. Use -X=<pattern>[,<pattern> with no spaces\n";
     const char missingExitMsg[] = "Missing exit options. Use -E=<opts>\n";
     const char missingDepthMsg[] = "Depth, -d=0 (all), -d=-n (less), -d=+n (more)";
+    const char pruneEmptyMsg[] = "Invalid prune syntax. Use -Xp=<pattern>[,<pattern> or -Dp=<pattern>[,<pattern>\n";
 
     std::string str;
+    LLSup::StringList strList;
     bool valid;
 
     switch (*cmdOpts)
@@ -76,6 +78,15 @@ bool LLBase::ParseBaseCmds(const char*& cmdOpts)
         cmdOpts = LLSup::ParseNum(cmdOpts+1, m_depthLimit, missingDepthMsg);
         break;
     case 'D':   // Limit to directories, -D or -D=<dirPat>[,<dirPat>]...
+        if (cmdOpts[1] == 'p')
+        {
+            // Prune, only scan directories matching -Dp=<dirPat>[,<dirPat>]...
+            cmdOpts = LLSup::ParseList(cmdOpts + 2, strList, pruneEmptyMsg);
+            for (unsigned idx = 0; idx != strList.size(); idx++)
+                m_dirScan.m_onlyDirs.Add(strList[idx]);
+            strList.clear();
+            break;
+        }
 		cmdOpts = LLSup::ParseList(cmdOpts + 1, m_includeDirList, NULL);
         m_onlyAttr = FILE_ATTRIBUTE_DIRECTORY;
         m_dirSort.SetSortAttr(m_onlyAttr);
@@ -109,6 +120,23 @@ bool LLBase::ParseBaseCmds(const char*& cmdOpts)
     case 'I':   // Input list of files, -I=<inFilePath>, or -I=-
         cmdOpts = LLSup::ParseString(cmdOpts+1, m_inFile, missingInFileMsg);
         break;
+    case 'K':   // Directory snapshot cache, see ParseDirCache
+        ErrorMsg() << "\n-K directory cache is only valid with list and find commands\n";
+        return false;
+    case 'J':   // Parallel directory scan, -J, -Ju (unordered), -Jb (batched), -J=<threads>
+        m_dirScan.m_scanMode = DirectoryScan::eScanParallel;
+        if (cmdOpts[1] == 'u')
+        {
+            m_dirScan.m_scanMode = DirectoryScan::eScanUnordered;
+            cmdOpts++;
+        }
+        else if (cmdOpts[1] == 'b')
+        {
+            m_dirScan.m_streamBatch = 256;
+            cmdOpts++;
+        }
+        cmdOpts = LLSup::ParseNum(cmdOpts+1, m_dirScan.m_threads, NULL);
+        break;
     case 'N':
     case 'n':   // No copy, just show command.
         m_exec = false;
@@ -142,7 +170,30 @@ bool LLBase::ParseBaseCmds(const char*& cmdOpts)
         m_verbose = true;
         break;
     case 'X':   // Exclude, -X=<pathPat>[,<pathPat>...]
-        cmdOpts = LLSup::ParseList(cmdOpts+1, m_excludeList, excludeEmptyMsg);
+        if (cmdOpts[1] == 'p')
+        {
+            // Prune, exclude and do not scan directories matching -Xp=<pathPat>[,<pathPat>...]
+            cmdOpts = LLSup::ParseList(cmdOpts + 2, strList, pruneEmptyMsg);
+            for (unsigned idx = 0; idx != strList.size(); idx++)
+            {
+                m_excludeList.push_back(strList[idx]);
+                m_dirScan.m_pruneDirs.Add(strList[idx] + "\\");
+            }
+            strList.clear();
+            break;
+        }
+        {
+            // Patterns ending in '*' which match "<dir>\" match everything below dir,
+            // so those directories are not scanned.
+            size_t firstIdx = m_excludeList.size();
+            cmdOpts = LLSup::ParseList(cmdOpts+1, m_excludeList, excludeEmptyMsg);
+            for (size_t idx = firstIdx; idx < m_excludeList.size(); idx++)
+            {
+                const std::string& pattern = m_excludeList[idx];
+                if (!pattern.empty() && pattern[pattern.length()-1] == '*')
+                    m_dirScan.m_pruneDirs.Add(pattern);
+            }
+        }
         break;
     case 'Z':   // if siZe  -Z=1000K  or -Z<1M or -Z>1G
         cmdOpts = LLSup::ParseSizeOp(cmdOpts+1, m_onlySizeOp, m_onlySize);
@@ -163,6 +214,18 @@ bool LLBase::ParseBaseCmds(const char*& cmdOpts)
     return true;
 }
 
+// ---------------------------------------------------------------------------
+// Parse directory snapshot cache, -K or -K=<cacheDir>
+// Replayed file sizes and times can be stale, so only commands which
+// list files and never act on them call this.
+void LLBase::ParseDirCache(const char*& cmdOpts)
+{
+    std::string cacheDir;
+    cmdOpts = LLSup::ParseString(cmdOpts+1, cacheDir, NULL);
+    if (m_dirCache.Open(cacheDir.c_str()))
+        m_dirScan.m_dirCache = &m_dirCache;
+}
+
 // ---------------------------------------------------------------------------
 //  Filter on:
 //      m_onlyAttr      File or Directory, -F or -D
@@ -189,13 +252,7 @@ bool LLBase::FilterDir(
             return false;
     }
 
-    LARGE_INTEGER fileSize;
-    fileSize.HighPart = pFileData->nFileSizeHigh;
-    fileSize.LowPart  = pFileData->nFileSizeLow;
-    m_fileSize = fileSize.QuadPart;
-
-    m_srcPath = LLPath::Join(pDir, pFileData->cFileName);
-    m_isDir   = ((pFileData->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0);
+    SetEntry(pDir, pFileData);
 
     if (m_isDir)
     {
@@ -229,6 +286,18 @@ bool LLBase::FilterDir(
     return true;
 }
 
+// ---------------------------------------------------------------------------
+void LLBase::SetEntry(const char* pDir, const WIN32_FIND_DATA* pFileData)
+{
+    LARGE_INTEGER fileSize;
+    fileSize.HighPart = pFileData->nFileSizeHigh;
+    fileSize.LowPart  = pFileData->nFileSizeLow;
+    m_fileSize = fileSize.QuadPart;
+
+    m_srcPath = LLPath::Join(pDir, pFileData->cFileName);
+    m_isDir   = ((pFileData->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0);
+}
+
 // ---------------------------------------------------------------------------
 // Populate m_dstPath, replace #n and *n patterns.
 // If m_dstPath contains a plan '*' it is not replaced.
@@ -340,6 +409,19 @@ bool LLBase::FilterGrep()
     return true;
 }
 
+// ---------------------------------------------------------------------------
+void LLBase::CloseDirCache()
+{
+    if (m_dirScan.m_dirCache == NULL)
+        return;
+
+    VerboseMsg() << "[DirCache] hits=" << m_dirCache.Hits()
+        << " misses=" << m_dirCache.Misses()
+        << " dirs=" << m_dirCache.Size() << std::endl;
+    m_dirCache.Save();
+    m_dirScan.m_dirCache = NULL;
+}
+
 // ---------------------------------------------------------------------------
 // Return true if user wants to quit.
 bool LLBase::PromptAnsQuit()
@@ -36,6 +36,7 @@
 #include "llmsg.h"
 #include "llerrMsgs.h"
 #include "Handle.h"
+#include "DirCache.h"
 
 #define HAVE_REGEX
 #include <regex>
@@ -133,6 +134,9 @@ public:
     // Parse base commands, return false is unknown command.
     bool LLBase::ParseBaseCmds(const char*& cmdOpts);
 
+    // Parse -K directory snapshot cache, only used by listing commands.
+    void ParseDirCache(const char*& cmdOpts);
+
     virtual int ProcessEntry(const char* pDir, const WIN32_FIND_DATA* pFileData, int depth) = 0;
 
     static int EntryCb(
@@ -158,6 +162,10 @@ public:
     //  If pass, populate m_srcPath
     bool FilterDir(const char* pDir, const WIN32_FIND_DATA* pFileData, int depth);
 
+    // Populate m_srcPath, m_isDir and m_fileSize of an entry which already
+    // passed FilterDir, it is not filtered or counted again.
+    void SetEntry(const char* pDir, const WIN32_FIND_DATA* pFileData);
+
     // Increment m_countOut and return true if execeeded output limit.
     bool IsQuit()
     {
@@ -172,6 +180,7 @@ public:
 
     int ExitStatus(int status)
 	{
+        CloseDirCache();
 		VerboseMsg() << "[ExitStatus] " << status << std::endl;
 		return status;
 	}
@@ -184,6 +193,9 @@ public:
     // Return true if  no grep specified or grep found a match.
     bool FilterGrep();
 
+    // Save directory snapshot (-K) and report hit counts (-v).
+    void CloseDirCache();
+
     // Return true if users wants to quit.
     bool PromptAnsQuit();
 
@@ -201,9 +213,9 @@ public:
     LONGLONG            m_onlySize;         // -Z<op><value>
     LLSup::SizeOp       m_onlySizeOp;       //    op=(Greater|Less|Equal) value=num<units G|M|K>, ex -Zg100M
 
-    LLSup::StringList   m_excludeList;      // -X<pathPat>[,<pathPat>
-    LLSup::StringList   m_includeFileList;      // -F[<filePat>][,<filePat>]
-	LLSup::StringList   m_includeDirList;      // -D[<dirPat>][,<dirPat>]
+    LLSup::PatternList  m_excludeList;      // -X<pathPat>[,<pathPat>
+    LLSup::PatternList  m_includeFileList;      // -F[<filePat>][,<filePat>]
+	LLSup::PatternList  m_includeDirList;      // -D[<dirPat>][,<dirPat>]
 
     // Example  -TmcEnow        Select if modify or create time Equal to now\n"
     //          -TmG-4.5        Select if modify time Greater than 4.5 hours ago\n"
@@ -217,6 +229,7 @@ public:
 
     DirectoryScan       m_dirScan;
     LLDirSort           m_dirSort;
+    DirCache            m_dirCache;         // -K=<cacheDir>  directory snapshot used by m_dirScan
 
     // Output colors
     int                 m_screenWidth;      // Used for wide output
@@ -0,0 +1,524 @@
+//-----------------------------------------------------------------------------
+// llbench - Benchmark pattern matching and directory scanning
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include <iostream>
+#include <iomanip>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "llbench.h"
+#include "DirReader.h"
+
+
+// ---------------------------------------------------------------------------
+
+static const char sHelp[] =
+" Bench " LLVERSION "\n"
+" Benchmark pattern matching and directory scans\n"
+"\n"
+"  !0eSyntax:!0f\n"
+"    [<switches>] \n"
+"\n"
+"  !0eWhere switches are:!0f\n"
+"   -?                  ; Show this help\n"
+"   -b=<bench>,...      ; Benchmarks to run, patterns and/or scan, default both\n"
+"   -c=<count>          ; Runs per measurement, best run is reported, default 3\n"
+"   -1=<file>           ; Redirect output to file \n"
+"   -J                  ; Parallel directory scan (-J=<threads>), -Ju unordered, -Jb batched\n"
+"   -K                  ; Cache directory snapshot, reuse unchanged dirs (-K=<cacheDir>)\n"
+"                       ;   file sizes/times may be stale\n"
+"\n"
+"   Pattern bench:\n"
+"   -l=<n>,...          ; Pattern list sizes, default 1,10,50,200\n"
+"   -n=<count>          ; Synthetic path names per run, default 100000\n"
+"\n"
+"   Scan bench, synthetic tree is created once and reused:\n"
+"   -t=<dir>            ; Tree parent directory, default %TEMP%\\llbench\n"
+"   -f=<n>              ; Subdirectories per directory, default 4\n"
+"   -d=<n>              ; Directory levels, default 3\n"
+"   -m=<n>              ; Files per directory, default 50\n"
+"   -w=<n>              ; Random part of file name length, default 12\n"
+"   -e=<ext>,...        ; Extension mix, repeat to weight, default cpp,h,obj,pdb,txt,exe,dll,lib\n"
+"\n"
+"  !0eOutput:!0f\n"
+"    Comma separated, one row per measurement:\n"
+"      bench,variant,size,entries,nsPerEntry,entriesPerSec,sysCallsPerEntry,matched\n"
+"    bench=patterns  variant=set   PatternList (-X, -F, -D lists), size=patterns\n"
+"                    variant=loop  plain loop over each pattern, for comparison\n"
+"    bench=scan      variant=recursive  GetFilesInDirectory, size=directories\n"
+"                    variant=filtered   plus FilterDir with -F=*.<first ext>\n"
+"                    variant=excluded   plus FilterDir with -X=*\\d1\\* (pruned)\n"
+"                    variant=sorted     plus LLDirSort by name\n"
+"    sysCallsPerEntry counts directory open, read and close calls\n"
+"\n"
+"  !0eExample:!0f\n"
+"    llfile -xb                       ; run with defaults\n"
+"    llfile -xb -n=1000000 -l=10,100,1000 -1=bench.csv \n"
+"    llfile -xb -b=scan -f=8 -d=4 -m=100 -J -1=scan.csv \n"
+"\n"
+"\n";
+
+LLConfig LLBench::sConfig;
+
+// Extension mix of synthetic names.
+static const char* sExtn[] = { "cpp", "h", "obj", "pdb", "txt", "exe", "dll", "lib" };
+static const char sTreeDone[] = "llbench.tree";
+
+// Small deterministic generator so runs are reproducible.
+static uint NextRand(uint& seed)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8);
+}
+
+// ---------------------------------------------------------------------------
+LLBench::LLBench() :
+    m_entries(100000),
+    m_repeat(3),
+    m_fanOut(4),
+    m_depth(3),
+    m_filesPerDir(50),
+    m_nameLen(12),
+    m_filter(false),
+    m_scanned(0),
+    m_matched(0)
+{
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    m_tickFreq = freq.QuadPart;
+
+    sConfigp = &GetConfig();
+}
+
+// ---------------------------------------------------------------------------
+LLConfig& LLBench::GetConfig()
+{
+    return sConfig;
+}
+
+// ---------------------------------------------------------------------------
+int LLBench::StaticRun(const char* cmdOpts, int argc, const char* pDirs[])
+{
+    LLBench llBench;
+    return llBench.Run(cmdOpts, argc, pDirs);
+}
+
+// ---------------------------------------------------------------------------
+int LLBench::Run(const char* cmdOpts, int argc, const char* pDirs[])
+{
+    const char missingCountMsg[] = "Missing count, syntax -n=<count> or -c=<count>\n";
+    const char missingListMsg[]  = "Missing list sizes, syntax -l=<n>,...\n";
+    const char missingBenchMsg[] = "Missing benchmark, syntax -b=patterns,scan\n";
+    const char missingTreeMsg[]  = "Missing tree setting, syntax -t=<dir>, -f=<n>, -d=<n>, -m=<n>, -w=<n>, -e=<ext>,...\n";
+    LLSup::StringList sizeList;
+
+    // Parse options
+    while (*cmdOpts)
+    {
+        switch (*cmdOpts)
+        {
+        case 'b':   // -b=<bench>,...
+            cmdOpts = LLSup::ParseList(cmdOpts+1, m_benchList, missingBenchMsg);
+            break;
+        case 'c':   // -c=<count>
+            cmdOpts = LLSup::ParseNum(cmdOpts+1, m_repeat, missingCountMsg);
+            break;
+        case 'l':   // -l=<n>,...
+            cmdOpts = LLSup::ParseList(cmdOpts+1, sizeList, missingListMsg);
+            for (unsigned idx = 0; idx != sizeList.size(); idx++)
+                m_listSizes.push_back((uint)strtoul(sizeList[idx].c_str(), NULL, 10));
+            sizeList.clear();
+            break;
+        case 'n':   // -n=<count>
+            cmdOpts = LLSup::ParseNum(cmdOpts+1, m_entries, missingCountMsg);
+            break;
+        case 'K':   // -K or -K=<cacheDir>
+            ParseDirCache(cmdOpts);
+            break;
+        case 't':   // -t=<dir>
+            cmdOpts = LLSup::ParseString(cmdOpts+1, m_treeRoot, missingTreeMsg);
+            break;
+        case 'f':   // -f=<fanOut>
+            cmdOpts = LLSup::ParseNum(cmdOpts+1, m_fanOut, missingTreeMsg);
+            break;
+        case 'd':   // -d=<depth>
+            cmdOpts = LLSup::ParseNum(cmdOpts+1, m_depth, missingTreeMsg);
+            break;
+        case 'm':   // -m=<filesPerDir>
+            cmdOpts = LLSup::ParseNum(cmdOpts+1, m_filesPerDir, missingTreeMsg);
+            break;
+        case 'w':   // -w=<nameLen>
+            cmdOpts = LLSup::ParseNum(cmdOpts+1, m_nameLen, missingTreeMsg);
+            break;
+        case 'e':   // -e=<ext>,...
+            cmdOpts = LLSup::ParseList(cmdOpts+1, m_extnList, missingTreeMsg);
+            break;
+
+        case '?':
+            Colorize(std::cout, sHelp);
+            return sIgnore;
+        default:
+            if ( !ParseBaseCmds(cmdOpts))
+                return sError;
+        }
+
+        // Advance to next parameter
+        LLSup::AdvCmd(cmdOpts);
+    }
+
+    if (m_listSizes.empty())
+    {
+        const uint sDefSizes[] = { 1, 10, 50, 200 };
+        m_listSizes.assign(sDefSizes, sDefSizes + ARRAYSIZE(sDefSizes));
+    }
+    if (m_repeat == 0)
+        m_repeat = 1;
+    if (m_extnList.empty())
+        m_extnList.assign(sExtn, sExtn + ARRAYSIZE(sExtn));
+    if (m_benchList.empty())
+    {
+        m_benchList.push_back("patterns");
+        m_benchList.push_back("scan");
+    }
+
+    LLMsg::Out() << "bench,variant,size,entries,nsPerEntry,entriesPerSec,sysCallsPerEntry,matched\n";
+    for (unsigned idx = 0; idx != m_benchList.size(); idx++)
+    {
+        if (_stricmp(m_benchList[idx].c_str(), "patterns") == 0)
+            BenchPatterns();
+        else if (_stricmp(m_benchList[idx].c_str(), "scan") == 0)
+            BenchScan();
+        else
+            ErrorMsg() << "Unknown benchmark " << m_benchList[idx] << ", use patterns or scan\n";
+    }
+    LLMsg::Out() << std::flush;
+
+    return ExitStatus(0);
+}
+
+// ---------------------------------------------------------------------------
+double LLBench::NsPerEntry(LONGLONG startTick, LONGLONG endTick, size_t entries) const
+{
+    if (entries == 0 || m_tickFreq == 0)
+        return 0;
+    return (endTick - startTick) * 1e9 / m_tickFreq / entries;
+}
+
+// ---------------------------------------------------------------------------
+void LLBench::ShowRow(
+        const char* bench,
+        const char* variant,
+        size_t size,
+        size_t entries,
+        double nsPerEntry,
+        double sysCallsPerEntry,
+        size_t matched)
+{
+    LLMsg::Out() << bench
+        << "," << variant
+        << "," << size
+        << "," << entries
+        << "," << std::fixed << std::setprecision(1) << nsPerEntry
+        << "," << std::setprecision(0) << (nsPerEntry > 0 ? 1e9 / nsPerEntry : 0)
+        << "," << std::setprecision(3) << sysCallsPerEntry
+        << "," << matched
+        << "\n";
+}
+
+// ---------------------------------------------------------------------------
+// Synthetic names look like  src\mod12\sub3\file004512.cpp
+// Pattern lists mix the common exclude shapes:
+//      *.ext           ; suffix, first one (*.obj) matches 1 in 8 names
+//      *\name\*        ; contains
+//      name*           ; prefix
+void LLBench::BenchPatterns()
+{
+    uint seed = 1;
+    std::vector<std::string> names(m_entries);
+    char name[MAX_PATH];
+    for (uint idx = 0; idx != m_entries; idx++)
+    {
+        uint rnd = NextRand(seed);
+        sprintf_s(name, ARRAYSIZE(name), "src\\mod%u\\sub%u\\file%06u.%s",
+            rnd % 50, (rnd >> 6) % 8, idx, sExtn[(rnd >> 9) % ARRAYSIZE(sExtn)]);
+        names[idx] = name;
+    }
+
+    for (unsigned sizeIdx = 0; sizeIdx != m_listSizes.size(); sizeIdx++)
+    {
+        uint patCnt = m_listSizes[sizeIdx];
+        LLSup::PatternList patList;
+        std::vector<WildPattern> loopList;
+        char pattern[MAX_PATH];
+
+        for (uint patIdx = 0; patIdx != patCnt; patIdx++)
+        {
+            switch (patIdx % 4)
+            {
+            case 0:
+            case 1:
+                if (patIdx == 0)
+                    strcpy_s(pattern, ARRAYSIZE(pattern), "*.obj");
+                else
+                    sprintf_s(pattern, ARRAYSIZE(pattern), "*.x%u", patIdx);
+                break;
+            case 2:
+                sprintf_s(pattern, ARRAYSIZE(pattern), "*\\skip%u\\*", patIdx);
+                break;
+            default:
+                sprintf_s(pattern, ARRAYSIZE(pattern), "tmp%u*", patIdx);
+                break;
+            }
+            patList.push_back(pattern);
+            loopList.push_back(WildPattern(pattern));
+        }
+
+        for (int matcher = 0; matcher != 2; matcher++)
+        {
+            double bestNs = 0;
+            size_t matched = 0;
+            for (uint run = 0; run != m_repeat && !IsQuit(); run++)
+            {
+                LARGE_INTEGER startTick, endTick;
+                matched = 0;
+                QueryPerformanceCounter(&startTick);
+                for (uint idx = 0; idx != m_entries; idx++)
+                {
+                    const char* pName = names[idx].c_str();
+                    if (matcher == 0)
+                    {
+                        matched += patList.Matches(pName);
+                    }
+                    else
+                    {
+                        size_t nameLen = names[idx].length();
+                        for (unsigned patIdx = 0; patIdx != loopList.size(); patIdx++)
+                        {
+                            if (loopList[patIdx].Match(pName, nameLen))
+                            {
+                                matched++;
+                                break;
+                            }
+                        }
+                    }
+                }
+                QueryPerformanceCounter(&endTick);
+
+                double ns = NsPerEntry(startTick.QuadPart, endTick.QuadPart, m_entries);
+                if (run == 0 || ns < bestNs)
+                    bestNs = ns;
+            }
+
+            ShowRow("patterns", (matcher == 0) ? "set" : "loop", patCnt, m_entries, bestNs, 0, matched);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Tree is built in a directory named after its settings, so a tree is only
+// created once per setting and every run scans the same names.
+//      <m_treeRoot>\f4_d3_m50_w12_e8\d0\d1\...\<random>_<n>.<ext>
+std::string LLBench::MakeTree(size_t& dirCnt)
+{
+    std::string root = m_treeRoot;
+    if (root.empty())
+    {
+        char tempDir[MAX_PATH];
+        DWORD len = GetTempPath(ARRAYSIZE(tempDir), tempDir);
+        if (len == 0 || len >= ARRAYSIZE(tempDir))
+            return std::string();
+        root = tempDir;
+        root += "llbench";
+    }
+
+    char treeName[MAX_PATH];
+    sprintf_s(treeName, ARRAYSIZE(treeName), "f%u_d%u_m%u_w%u_e",
+        m_fanOut, m_depth, m_filesPerDir, m_nameLen);
+    std::string treeDir = LLPath::Join(root, treeName);
+    for (unsigned idx = 0; idx != m_extnList.size(); idx++)
+        treeDir += (idx == 0 ? "" : "_") + m_extnList[idx];
+
+    // Directory count of a full tree, 1 + fanOut + fanOut^2 ...
+    dirCnt = 0;
+    size_t levelCnt = 1;
+    for (uint level = 0; level <= m_depth; level++)
+    {
+        dirCnt += levelCnt;
+        levelCnt *= m_fanOut;
+    }
+
+    std::string donePath = LLPath::Join(treeDir, sTreeDone);
+    if (GetFileAttributes(donePath.c_str()) != INVALID_FILE_ATTRIBUTES)
+        return treeDir;
+
+    VerboseMsg() << "[Bench] Creating " << dirCnt << " directories in " << treeDir << std::endl;
+    CreateDirectory(root.c_str(), NULL);
+    size_t madeCnt = 0;
+    uint seed = 1;
+    MakeTreeLevel(treeDir, 0, seed, madeCnt);
+
+    HANDLE hFile = CreateFile(donePath.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        LLMsg::PresentError(GetLastError(), "Failed to create bench tree, ", treeDir.c_str());
+        return std::string();
+    }
+    CloseHandle(hFile);
+    return treeDir;
+}
+
+// ---------------------------------------------------------------------------
+void LLBench::MakeTreeLevel(const std::string& dir, uint level, uint& seed, size_t& dirCnt)
+{
+    CreateDirectory(dir.c_str(), NULL);
+    dirCnt++;
+
+    std::string name;
+    char suffix[40];
+    for (uint fileIdx = 0; fileIdx != m_filesPerDir; fileIdx++)
+    {
+        name.clear();
+        for (uint chrIdx = 0; chrIdx != m_nameLen; chrIdx++)
+            name += (char)('a' + NextRand(seed) % 26);
+        const std::string& extn = m_extnList[NextRand(seed) % m_extnList.size()];
+        sprintf_s(suffix, ARRAYSIZE(suffix), "_%u.", fileIdx);
+        name += suffix + extn;
+
+        std::string filePath = LLPath::Join(dir, name.c_str());
+        HANDLE hFile = CreateFile(filePath.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile != INVALID_HANDLE_VALUE)
+            CloseHandle(hFile);
+    }
+
+    if (level < m_depth)
+    {
+        char subName[40];
+        for (uint dirIdx = 0; dirIdx != m_fanOut; dirIdx++)
+        {
+            sprintf_s(subName, ARRAYSIZE(subName), "d%u", dirIdx);
+            MakeTreeLevel(LLPath::Join(dir, subName), level + 1, seed, dirCnt);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Each variant scans the whole tree, counting and filtering in ProcessEntry.
+// Scan settings from -J and -K apply to every variant.
+void LLBench::BenchScan()
+{
+    enum { eRecursive, eFiltered, eExcluded, eSorted, eVariants };
+    static const char* sVariant[] = { "recursive", "filtered", "excluded", "sorted" };
+
+    size_t dirCnt = 0;
+    std::string treeDir = MakeTree(dirCnt);
+    if (treeDir.empty())
+        return;
+
+    for (int variant = 0; variant != eVariants; variant++)
+    {
+        double bestNs = 0;
+        double sysCallsPerEntry = 0;
+        size_t scanned = 0;
+        size_t matched = 0;
+
+        for (uint run = 0; run != m_repeat && !IsQuit(); run++)
+        {
+            LLDirSort dirSort;
+            m_dirScan.Init(treeDir.c_str(), NULL);
+            m_dirScan.m_recurse = true;
+            m_dirScan.m_add_cb  = EntryCb;
+            m_dirScan.m_cb_data = this;
+            m_dirScan.m_pruneDirs.Clear();
+            m_includeFileList.clear();
+            m_excludeList.clear();
+            m_filter  = (variant == eFiltered || variant == eExcluded);
+            m_scanned = 0;
+            m_matched = 0;
+
+            switch (variant)
+            {
+            case eFiltered:
+                m_includeFileList.push_back("*." + m_extnList[0]);
+                break;
+            case eExcluded:
+                m_excludeList.push_back("*\\d1\\*");
+                m_dirScan.m_pruneDirs.Add("*\\d1\\*");
+                break;
+            case eSorted:
+                dirSort.m_baseDirLen = 0;
+                dirSort.SetSort(m_dirScan, "n", false, true);
+                break;
+            }
+
+            LARGE_INTEGER startTick, endTick;
+            ULONGLONG startCalls = DirReader::SysCalls();
+            QueryPerformanceCounter(&startTick);
+            m_dirScan.GetFilesInDirectory();
+            if (variant == eSorted)
+                dirSort.ShowSorted(EntryCb, this);
+            QueryPerformanceCounter(&endTick);
+            ULONGLONG sysCalls = DirReader::SysCalls() - startCalls;
+
+            // Sorted entries are counted as ShowSorted returns them.
+            size_t entries = m_scanned;
+            double ns = NsPerEntry(startTick.QuadPart, endTick.QuadPart, entries);
+            if (run == 0 || ns < bestNs)
+            {
+                bestNs = ns;
+                scanned = entries;
+                matched = m_matched;
+                sysCallsPerEntry = (entries != 0) ? (double)sysCalls / entries : 0;
+            }
+        }
+
+        ShowRow("scan", sVariant[variant], dirCnt, scanned, bestNs, sysCallsPerEntry, matched);
+    }
+
+    m_includeFileList.clear();
+    m_excludeList.clear();
+    m_dirScan.m_pruneDirs.Clear();
+}
+
+// ---------------------------------------------------------------------------
+int LLBench::ProcessEntry(
+        const char* pDir,
+        const WIN32_FIND_DATA* pFileData,
+        int depth)
+{
+    if (depth < 0)
+        return sIgnore;     // ignore end-of-directory
+
+    m_scanned++;
+    if (m_filter && !FilterDir(pDir, pFileData, depth))
+        return sIgnore;
+
+    m_matched++;
+    return sOkay;
+}
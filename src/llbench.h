@@ -0,0 +1,89 @@
+//-----------------------------------------------------------------------------
+// llbench - Benchmark pattern matching and directory scanning
+//
+// Author: Dennis Lang - 2015
+// http://landenlabs.com/
+//
+// This file is part of LLFile project.
+//
+// ----- License ----
+//
+// Copyright (c) 2015 Dennis Lang
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is furnished to do
+// so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#pragma once
+
+#include <iostream>
+#include <windows.h>
+
+#include "llbase.h"
+
+// ---------------------------------------------------------------------------
+class LLBench : public LLBase
+{
+public:
+    LLBench();
+    ~LLBench() {}
+
+    static int StaticRun(const char* cmdOpts, int argc, const char* pDirs[]);
+    int Run(const char* cmdOpts, int argc, const char* pDirs[]);
+
+    static LLConfig sConfig;
+    LLConfig&       GetConfig();
+
+protected:
+    // Time PatternList against a plain loop of WildPatterns, per list size.
+    void BenchPatterns();
+
+    // Time directory scan of a synthetic tree in each scan mode.
+    void BenchScan();
+
+    // Create synthetic tree below m_treeRoot unless already there, return its path.
+    std::string MakeTree(size_t& dirCnt);
+    void MakeTreeLevel(const std::string& dir, uint level, uint& seed, size_t& dirCnt);
+
+    // Return elapsed nanoseconds per entry between two QueryPerformanceCounter ticks.
+    double NsPerEntry(LONGLONG startTick, LONGLONG endTick, size_t entries) const;
+
+    // One comma separated result row.
+    void ShowRow(const char* bench, const char* variant, size_t size, size_t entries,
+        double nsPerEntry, double sysCallsPerEntry, size_t matched);
+
+    virtual int ProcessEntry(const char* pDir, const WIN32_FIND_DATA* pFileData, int depth);
+
+    LLSup::StringList       m_benchList;    // -b=<bench>,... patterns, scan
+    uint                    m_entries;      // -n=<count> synthetic names per run
+    uint                    m_repeat;       // -c=<count> runs per measurement, best is reported
+    std::vector<uint>       m_listSizes;    // -l=<n>,... pattern list sizes
+    LONGLONG                m_tickFreq;
+
+    // Synthetic tree
+    std::string             m_treeRoot;     // -t=<dir>
+    uint                    m_fanOut;       // -f=<n> subdirectories per directory
+    uint                    m_depth;        // -d=<n> directory levels below the root
+    uint                    m_filesPerDir;  // -m=<n>
+    uint                    m_nameLen;      // -w=<n> random part of file names
+    LLSup::StringList       m_extnList;     // -e=<ext>,... repeat an extension to weight it
+
+    // Scan entry counters, see ProcessEntry
+    bool                    m_filter;       // pass entries through FilterDir
+    size_t                  m_scanned;
+    size_t                  m_matched;
+};
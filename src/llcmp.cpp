@@ -34,6 +34,9 @@
 #include <assert.h>
 #include <sstream>
 #include <set>
+#include <algorithm>
+#include <unordered_map>
+#include <memory>
 
 #include <windows.h>
 #include <winioctl.h>
@@ -46,6 +49,11 @@
 #include "llprintf.h"
 #include "Security.h"
 #include "comma.h"
+#include "ParallelSort.h"
+#include "WorkPool.h"
+#include "CmpReader.h"
+#include "DiffMap.h"
+#include "MemCompare.h"
 
 
 // ---------------------------------------------------------------------------
@@ -66,6 +74,14 @@ static const char sHelp[] =
 "  !0eCompare mode:!0f\n"
 "    -t                 ; Compare text files, defaults to binary \n"
 "    -F=<filePattern>   ; Compare filenames \n"
+"    -C                 ; Find duplicate files by content in any number of directories \n"
+"    -Cv                ; Same, also compare duplicates byte by byte \n"
+"    -c=<threads>       ; Compare file contents on 'threads' workers, default one per cpu, 1=serial \n"
+"    -c=<threads>,<MB>  ; Also limit MB of files queued for compare, default 256 \n"
+"    -M or -M=<ranges>  ; List byte ranges of differing files, up to 'ranges' per file, default 100 \n"
+"    -Ms                ; Also measure content moved within the files with rolling block checksums \n"
+"    -S                 ; Sample head, tail and 16 blocks of large files before full compare \n"
+"    -S=<blocks>        ; Sample head, tail and 'blocks' blocks, 0=off \n"
 "\n"
 "  !0eExample:!0f\n"
 "    LLCmp  d1\\*               ; Compare similar files in one directory\n"
@@ -126,6 +142,7 @@ static const char sHelp[] =
 "\n"
 "  !0eSpecial actions:!0f (files to delete are sorted, not argument order)\n"
 "   -h                  ; Show MD5 hash only, no compare \n"
+"   -H                  ; Cache -h and -C file hashes, reuse unchanged files (-H=<cacheDir>)\n"
 "   -d=e1 | -d=n1       ; Delete matching (-d=e) or not matching files (-d=n) \n"
 "                       ;   -d=e all files, -d=e1 first file, -d=e2 second file \n"
 "   -d=g | -d=l         ; Delete greatest size file or least size file \n"
@@ -143,29 +160,10 @@ static const char sHelp[] =
 LLCmpConfig LLCmp::sConfig;
 DWORD SHARE_ALL = FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE;
 
-// ---------------------------------------------------------------------------
-static bool CmpMatchName(const LLDirEntry* p1, const LLDirEntry* p2, unsigned levels)
-{
-    bool equal = (_stricmp(p1->filenameLStr, p2->filenameLStr) == 0);
-    if (levels == 0 || !equal)
-        return equal;
-    return (_stricmp(p1->szDir+p1->baseDirLen, p2->szDir+p2->baseDirLen) == 0);
-}
-
-// ---------------------------------------------------------------------------
-static bool CmpMatchPath(const LLDirEntry* p1, const LLDirEntry* p2, unsigned /* levels */)
-{
-    if (_stricmp(p1->filenameLStr, p2->filenameLStr) == 0)
-    {
-        return (_stricmp(p1->szDir+p1->baseDirLen, p2->szDir+p2->baseDirLen) == 0);
-    }
-
-    return false;
-}
-
 // ---------------------------------------------------------------------------
 // Uses static buffers, not thread safe.
-static const char* DisplayMD4Hash(const char* filePath)
+// Unchanged files found in hashCache (-H) are not read.
+static const char* DisplayMD4Hash(const char* filePath, HashCache& hashCache)
 {
     Handle fHnd = CreateFile(filePath, GENERIC_READ, SHARE_ALL, 0,
             OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
@@ -174,26 +172,38 @@ static const char* DisplayMD4Hash(const char* filePath)
     static std::vector<Byte> vBuffer(sBufSize);
     char* buffer = (char*)vBuffer.data();
 
-    md5_state_t state;
-    md5_init(&state);
+    HashCache::Key key;
+    bool cached = hashCache.IsOpen() && HashCache::GetKey(fHnd, ULONGLONG(-1), key);
 
-    DWORD totSize = 0;
-    DWORD rlen=sBufSize;
-    while (rlen == sBufSize && 
-        ReadFile(fHnd, buffer, sBufSize, &rlen, 0) != 0)
+    md5_byte_t digest[16];
+    ULONGLONG totSize = 0;
+    if (cached && hashCache.Find(key, digest))
     {
-        md5_append(&state, (const md5_byte_t *)buffer, rlen);
-        totSize += rlen;
+        totSize = key.size;
     }
+    else
+    {
+        md5_state_t state;
+        md5_init(&state);
 
-    md5_byte_t digest[16];
-    md5_finish(&state, digest);
+        DWORD rlen=sBufSize;
+        while (rlen == sBufSize && 
+            ReadFile(fHnd, buffer, sBufSize, &rlen, 0) != 0)
+        {
+            md5_append(&state, (const md5_byte_t *)buffer, rlen);
+            totSize += rlen;
+        }
 
-    static char hex_output[16*2 + 1 + 15];
+        md5_finish(&state, digest);
+        if (cached && totSize == key.size)
+            hashCache.Store(key, digest);
+    }
+
+    static char hex_output[16*2 + 1 + 25];
     for (int idx = 0; idx < 16; ++idx)
 	    sprintf(hex_output + idx * 2, "%02x", digest[idx]);
 
-    sprintf(hex_output + 32, ", %8u,", totSize);
+    sprintf(hex_output + 32, ", %8llu,", totSize);
     return hex_output;
 }
 
@@ -210,6 +220,7 @@ LLCmp::LLCmp() :
 	m_pushArgs("p"),
     m_compareDataMode(eCompareBinary),
     m_matchMode(eNameAndData),
+    m_verifyContent(false),
     m_offset(0),            // start compare at file offset.
     m_quitByteLimit(10),    // number of different bytes to dump in verbose mode.
     m_levels(30),           // number of directory levels to include in sort compare path
@@ -220,9 +231,20 @@ LLCmp::LLCmp() :
     m_errorCount(0),
     m_minPercentChg(0),
     m_maxPercentChg(0),
+    m_cmpThreads(0),        // content compare workers, one per cpu
+    m_cmpBudgetMB(256),     // MB of files queued for compare
+    m_sampleBlocks(0),      // no sampled pre-check
+    m_sampledCount(0),
+    m_sampleDiffCount(0),
+    m_diffMapRanges(0),     // no map of differences
+    m_diffMapShifted(false),
     m_delCmd(eNoDel),
     m_delFiles(-1),         // if eq or ne deleting, delete all files in group.
-    m_noDel(false)
+    m_noDel(false),
+    m_cmpPool(NULL),
+    m_diffMapPool(NULL),
+    m_cmpBytes(0),
+    m_cmpQuit(false)
 {
     m_sizeFile0 = 0;
     m_sizeFileN = 0;
@@ -257,6 +279,7 @@ int LLCmp::Run(const char* cmdOpts, int argc, const char* pDirs[])
     const char offsetOptErrMsg[] = "Start binary compare at file offset, syntax -o=<#offset>";
     const char quitByteErrMsg[] = "Quit after 'n' differences per file, syntax -Q=<#num>";
     const char widthErrMsg[] = "missing width, syntax -w=<#width>";
+    const char cmpThreadsErrMsg[] = "Compare workers, syntax -c=<#threads>[,<#MB>]";
 	const char argOptMsg[] = "File arguments passed to printf, -a=[pdnres_luc]...";
 	const char sMissingPrintFmtMsg[] = "Missing print format, -p=<fmt>\n";
 
@@ -307,6 +330,15 @@ int LLCmp::Run(const char* cmdOpts, int argc, const char* pDirs[])
         case 'D':    // force directory and name to match before comparing contents.
             m_matchMode = ePathAndData;
             break;
+        case 'C':   // -C or -Cv, match files by content, v=byte compare matches
+            m_matchMode = eContentData;
+            m_showEqual = true;
+            if (cmdOpts[1] == 'v')
+            {
+                m_verifyContent = true;
+                cmdOpts++;
+            }
+            break;
         case 'F':   // compare just filename, date and size and not its contents.
                     // -F=<filePat>[,<filePat>]...
             cmdOpts = LLSup::ParseList(cmdOpts+1, m_includeFileList, NULL);
@@ -315,6 +347,33 @@ int LLCmp::Run(const char* cmdOpts, int argc, const char* pDirs[])
         case 't':
             m_compareDataMode = eCompareText;
             break;
+        case 'c':   // -c=<threads>[,<MB>]
+            cmdOpts = LLSup::ParseNum(cmdOpts+1, m_cmpThreads, cmpThreadsErrMsg);
+            if (cmdOpts[1] == ',')
+            {
+                char* endPtr = 0;
+                m_cmpBudgetMB = (uint)strtoul(cmdOpts+2, &endPtr, 10);
+                cmdOpts = endPtr-1;
+            }
+            break;
+        case 'H':   // File hash cache, -H or -H=<cacheDir>
+            str.clear();
+            cmdOpts = LLSup::ParseString(cmdOpts+1, str, NULL);
+            m_hashCache.Open(str.c_str());
+            break;
+        case 'M':   // -M, -Ms or -M=<ranges>, map of differences
+            m_diffMapRanges = 100;
+            if (cmdOpts[1] == 's')
+            {
+                m_diffMapShifted = true;
+                cmdOpts++;
+            }
+            cmdOpts = LLSup::ParseNum(cmdOpts+1, m_diffMapRanges, NULL);
+            break;
+        case 'S':   // -S or -S=<blocks>, sampled pre-check before full compare
+            m_sampleBlocks = 16;
+            cmdOpts = LLSup::ParseNum(cmdOpts+1, m_sampleBlocks, NULL);
+            break;
         case 'l':   // -l=<directoryLevels>
             cmdOpts = LLSup::ParseNum(cmdOpts+1, m_levels, levelOptErrMsg);
             break;
@@ -416,7 +475,8 @@ int LLCmp::Run(const char* cmdOpts, int argc, const char* pDirs[])
 
     m_dirSort.SetSort(m_dirScan, "n", false, true);
     m_dirSort.SetSortAttr(FILE_ATTRIBUTE_NORMAL | FILE_ATTRIBUTE_ARCHIVE);  // Only show files.
-    m_dirSort.SetSortData(m_compareDataMode == eCompareSpecs);
+    // Sizes are needed for the compare budget and content matching.
+    m_dirSort.SetSortData(m_compareDataMode == eCompareSpecs || m_cmpThreads != 1 || m_matchMode == eContentData);
 
     if (m_inFile.length() != 0)
     {
@@ -440,23 +500,22 @@ int LLCmp::Run(const char* cmdOpts, int argc, const char* pDirs[])
 
     if (m_showMD5hash)
     {
+        m_dirSort.Sort();
         char filePath[MAX_PATH];
-        unsigned fileIdx = 0;
-        LLDirEntry*  pDirEntry = m_dirSort.m_pFirst;
         LLMsg::Out() << "                             MD5, FileSize, File\n";
-        while (pDirEntry)
+        for (size_t fileIdx = 0; fileIdx != m_dirSort.m_count; fileIdx++)
         {
-			sprintf_s(filePath, ARRAYSIZE(filePath), "%s\\%s", pDirEntry->szDir, pDirEntry->filenameLStr);
+            unsigned row = m_dirSort.Row(fileIdx);
+			sprintf_s(filePath, ARRAYSIZE(filePath), "%s\\%s", m_dirSort.Dir(row), m_dirSort.Name(row));
             if ( !LLSup::PatternListMatches(m_excludeList, filePath) &&
-				LLSup::PatternListMatches(m_includeFileList, pDirEntry->filenameLStr, true) &&
-                LLSup::CompareRhsBits(pDirEntry->dwFileAttributes, m_onlyRhs))
+				LLSup::PatternListMatches(m_includeFileList, m_dirSort.Name(row), true) &&
+                LLSup::CompareRhsBits(m_dirSort.Attributes(row), m_onlyRhs))
             {
-                LLMsg::Out() << DisplayMD4Hash(filePath) << " " << filePath << std::endl;
+                LLMsg::Out() << DisplayMD4Hash(filePath, m_hashCache) << " " << filePath << std::endl;
             }
-            pDirEntry = pDirEntry->pNext;
-            fileIdx++;
         }
 
+        CloseHashCache();
         return 0;
     }
 
@@ -464,15 +523,7 @@ int LLCmp::Run(const char* cmdOpts, int argc, const char* pDirs[])
     {
         m_inFileCnt = m_dirSort.m_count;
 
-        switch (m_matchMode)
-        {
-        case eNameAndData:
-            DoCmp(CmpMatchName);
-            break;
-        case ePathAndData:
-            DoCmp(CmpMatchPath);
-            break;
-        }
+        DoCmp();
     }
     catch (exception e)
     {
@@ -483,6 +534,8 @@ int LLCmp::Run(const char* cmdOpts, int argc, const char* pDirs[])
         ErrorMsg() << "Program threw exception " << LLMsg::GetLastErrorMsg() << std::endl;
     }
 
+    CloseHashCache();
+
     if ( !m_quiet)
     {
         // TODO - Add histogram of percent of file good before 1st difference.
@@ -509,6 +562,9 @@ int LLCmp::Run(const char* cmdOpts, int argc, const char* pDirs[])
             SetColor(sConfig.m_colorNormal);
         }
 
+        if (m_sampledCount != 0)
+            LLMsg::Out() << ", Sampled:" << m_sampledCount << " (differ:" << m_sampleDiffCount << ")";
+
         SetColor(sConfig.m_colorSkip);
         if (m_skipCount[0] != 0)
             LLMsg::Out() << ", SkippedLeft:" << m_skipCount[0];
@@ -579,6 +635,9 @@ LLCmp::CompareResult LLCmp::CompareDataBinary(
 {
     compareInfo.differAt = 0;
     compareInfo.diffCnt = 0;
+    compareInfo.sampled = false;
+    compareInfo.sampleDiffer = false;
+    compareInfo.readFailed = false;
 
     struct _stat statResult;
     if (0 == _stat(filePath1, &statResult) && (statResult.st_mode & _S_IFREG) != _S_IFREG)
@@ -587,10 +646,12 @@ LLCmp::CompareResult LLCmp::CompareDataBinary(
     const unsigned sMaxRetry = 10;
     Handle f1;
 
+    // Only local files are mapped, and only while nothing else can write them,
+    // see CmpReader::OpenRead.
+    bool map = LLPath::IsLocalDrive(filePath1) && LLPath::IsLocalDrive(filePath2);
     for (unsigned retry = 0; retry != sMaxRetry; retry++)
     {
-        f1 = CreateFile(filePath1, GENERIC_READ, SHARE_ALL, 0,
-                OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+        f1 = CmpReader::OpenRead(filePath1, map);
         if (f1.NotValid() && GetLastError() == ERROR_NOT_ENOUGH_SERVER_MEMORY)
             Sleep(1000 * retry);
         else
@@ -599,15 +660,15 @@ LLCmp::CompareResult LLCmp::CompareDataBinary(
 
     if (f1.NotValid())
     {
-        LLMsg::PresentError(GetLastError(), "Open failed,", filePath1);
+        compareInfo.openError = GetLastError();
+        compareInfo.openPath = filePath1;
         return eCmpErr;
     }
 
     Handle f2;
     for (unsigned retry = 0; retry != sMaxRetry; retry++)
     {
-        f2 = CreateFile(filePath2, GENERIC_READ, SHARE_ALL, 0,
-                OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+        f2 = CmpReader::OpenRead(filePath2, map);
         if (f2.NotValid() && GetLastError() == ERROR_NOT_ENOUGH_SERVER_MEMORY)
             Sleep(1000 * retry);
         else
@@ -616,7 +677,8 @@ LLCmp::CompareResult LLCmp::CompareDataBinary(
 
     if (f2.NotValid())
     {
-        LLMsg::PresentError(GetLastError(), "Open failed,", filePath2);
+        compareInfo.openError = GetLastError();
+        compareInfo.openPath = filePath2;
         // CloseHandle(f1);
         return eCmpErr;
     }
@@ -646,80 +708,115 @@ LLCmp::CompareResult LLCmp::CompareDataBinary(
 
     if (result == eCmpEqual)
     {
-        DWORD whereSize = DWORD(compareInfo.fileSize2 / 100);
+        LONGLONG whereSize = std::max(compareInfo.fileSize2 / 100, LONGLONG(1));
         memset(compareInfo.whereCnt, 0, sizeof(compareInfo.whereCnt));
 
-        const uint sBufSize = 4096*16;
-        Byte buffer1[sBufSize];
-        Byte buffer2[sBufSize];
-        DWORD rlen1=0, rlen2=0;
+        CmpReader reader(f1, f2, compareInfo.fileSize1, m_offset, map);
+        const Byte* data1;
+        const Byte* data2;
+        size_t length;
 
-        if (m_offset != 0)
+        // Rebuilt files usually differ near the head or tail, sample those
+        // and a few blocks between them before reading the whole file.
+        // Verbose mode needs every difference so it always reads it all.
+        if (m_sampleBlocks != 0 && !m_verbose &&
+            compareInfo.fileSize1 - m_offset >= LONGLONG(m_sampleBlocks + 2) * CmpReader::sSampleBytes * 4)
         {
-            DWORD moved = 0;
-            LARGE_INTEGER fileOffset;
-            fileOffset.QuadPart = m_offset;
-            SetFilePointer(f1, fileOffset.LowPart, &fileOffset.HighPart, moved);
-            SetFilePointer(f2, fileOffset.LowPart, &fileOffset.HighPart, moved);
+            compareInfo.sampled = true;
+            if ( !reader.SamplesEqual(m_sampleBlocks, compareInfo.differAt))
+            {
+                compareInfo.sampleDiffer = true;
+                compareInfo.diffCnt = 1;
+            }
         }
 
         LONGLONG filePos = m_offset;
-        while (
-            (compareInfo.diffCnt == 0 || m_verbose) &&
-            ReadFile(f1, buffer1, sizeof(buffer1), &rlen1, 0) != 0 &&
-            ReadFile(f2, buffer2, sizeof(buffer2), &rlen2, 0) != 0 &&
-            rlen1 == rlen2 &&
-            rlen1 != 0)
+        while ((compareInfo.diffCnt == 0 || m_verbose) && reader.Next(data1, data2, length))
         {
-            if (m_verbose)
+            size_t idx = MemCompare::FirstDiff(data1, data2, length);
+            if (idx != length)
             {
-                for (unsigned idx = 0; idx < rlen1; idx++)
-                {
-                    if (buffer1[idx] != buffer2[idx])
-                    {
-                        compareInfo.differAt = filePos + idx;
-                        compareInfo.diffCnt++;
-                        compareInfo.whereCnt[compareInfo.differAt/whereSize]++;
+                if (compareInfo.diffCnt == 0)
+                    compareInfo.differAt = filePos + idx;
 
-                        if (quitAfter != 0)
-                        {
-                            quitAfter--;
-                            wout << "Differ at: " <<  filePos + idx
-                                << " Data: "
-                                << std::setw(3) << (unsigned)buffer1[idx] << " != "
-                                << std::setw(3) << (unsigned)buffer2[idx]
-                                << std::endl;
-                        }
-                    }
+                if ( !m_verbose)
+                {
+                    compareInfo.diffCnt++;
                 }
-            }
-            else
-            {
-#if 1
-                if (memcmp(buffer1, buffer2, rlen1) != 0)
-#endif
+                else
                 {
-                    unsigned idx;
-                    for (idx = 0; idx < rlen1; idx++)
+                    for (size_t showIdx = idx; quitAfter != 0 && showIdx != length; quitAfter--)
                     {
-                        if (buffer1[idx] != buffer2[idx])
-                        {
-                            compareInfo.diffCnt++;
-                            break;
-                        }
+                        wout << "Differ at: " <<  filePos + showIdx
+                            << " Data: "
+                            << std::setw(3) << (unsigned)data1[showIdx] << " != "
+                            << std::setw(3) << (unsigned)data2[showIdx]
+                            << std::endl;
+                        showIdx++;
+                        showIdx += MemCompare::FirstDiff(data1 + showIdx, data2 + showIdx, length - showIdx);
                     }
 
-                    compareInfo.differAt = filePos + idx;
+                    // Count differences per 1% of the file, the last part
+                    // also holds the remainder.
+                    for (size_t begin = idx; begin != length; )
+                    {
+                        LONGLONG where = std::min((filePos + LONGLONG(begin)) / whereSize, LONGLONG(99));
+                        size_t end = (where == 99) ? length :
+                            (size_t)std::min(LONGLONG(length), (where + 1) * whereSize - filePos);
+                        ULONG diffCnt = (ULONG)MemCompare::CountDiff(data1 + begin, data2 + begin, end - begin);
+                        compareInfo.diffCnt += diffCnt;
+                        compareInfo.whereCnt[where] += diffCnt;
+                        begin = end;
+                    }
                 }
             }
-            filePos += rlen1;
+            filePos += length;
 
-            if (m_progress && compareInfo.fileSize1 > 1024*1024)
+            if (m_progress && m_cmpPool == NULL && compareInfo.fileSize1 > 1024*1024)
                 std::cout << std::fixed << std::setw(6) << std::setprecision(2)
                     << (filePos * 100.0) /  compareInfo.fileSize1 << " %\r";
         }
 
-        result = (rlen1 == rlen2 && compareInfo.diffCnt == 0) ? eCmpEqual : eCmpDiff;
+        if (reader.Error() != 0)
+        {
+            // A failed read is not a difference, -d must not act on it.
+            compareInfo.openError = reader.Error();
+            compareInfo.openPath = (reader.ErrorFile() == 1) ? filePath1 : filePath2;
+            compareInfo.readFailed = true;
+            result = eCmpErr;
+        }
+        else
+        {
+            result = (reader.AtEnd() && compareInfo.diffCnt == 0) ? eCmpEqual : eCmpDiff;
+        }
+    }
+
+    if (result == eCmpDiff && m_diffMapRanges != 0)
+    {
+        DiffMap diffMap(filePath1, compareInfo.fileSize1, filePath2, compareInfo.fileSize2, map);
+        LONGLONG mapSize = std::max(std::max(compareInfo.fileSize1, compareInfo.fileSize2), LONGLONG(1));
+        if (diffMap.MapRanges(m_diffMapPool, m_diffMapRanges))
+        {
+            wout << " Diff map: " << diffMap.m_rangeCnt << " ranges, " << diffMap.m_diffBytes << " bytes ("
+                << std::fixed << std::setprecision(2) << (diffMap.m_diffBytes * 100.0) / mapSize << "%)\n";
+            for (size_t rangeIdx = 0; rangeIdx != diffMap.m_ranges.size(); rangeIdx++)
+            {
+                const DiffMap::Range& range = diffMap.m_ranges[rangeIdx];
+                wout << "  " << range.begin << " - " << range.end - 1
+                    << ", " << range.end - range.begin << " bytes\n";
+            }
+            if (diffMap.m_rangeCnt > diffMap.m_ranges.size())
+                wout << "  ...\n";
+        }
+        if (diffMap.m_error == 0 && m_diffMapShifted && diffMap.MapShifted(m_diffMapPool))
+        {
+            wout << " Block map: " << diffMap.m_blockBytes << " byte blocks"
+                << ", Same: " << diffMap.m_sameBytes
+                << ", Moved: " << diffMap.m_movedBytes
+                << ", New: " << diffMap.m_newBytes << " bytes\n";
+        }
+        if (diffMap.m_error != 0)
+            wout << " Diff map read failed, " << LLMsg::GetErrorMsg(diffMap.m_error) << std::endl;
     }
 
     // CloseHandle(f1);
@@ -729,6 +826,21 @@ LLCmp::CompareResult LLCmp::CompareDataBinary(
 }
 
 
+// ---------------------------------------------------------------------------
+// Files grouped by content hash (-C without v) are equal, no data is read.
+LLCmp::CompareResult LLCmp::CompareDataHashed(
+        const char* filePath1,
+        const char* filePath2,
+        LLCmp::CompareInfo& compareInfo,
+        unsigned quitAfter,
+        std::ostream& wout)
+{
+    compareInfo.fileSize1 = compareInfo.fileSize2 = 0;
+    compareInfo.differAt = 0;
+    compareInfo.diffCnt = 0;
+    return eCmpEqual;
+}
+
 // ---------------------------------------------------------------------------
 // return:  -2 skip, -1 error, 0 identical, 1 differ
 LLCmp::CompareResult  LLCmp::CompareDataText(
@@ -803,7 +915,7 @@ void LLCmp::DeleteCmpFile(const char* fileToDel)
 }
 
 // ---------------------------------------------------------------------------
-std::ostream& LLCmp::PrintPath(const char* msg, const LLDirEntry* dirEntry0, const LLDirEntry* dirEntry1)
+std::ostream& LLCmp::PrintPath(const char* msg, unsigned row0, unsigned row1)
 {
 	int depth = 0;
 	WIN32_FIND_DATA fileData;
@@ -812,44 +924,151 @@ std::ostream& LLCmp::PrintPath(const char* msg, const LLDirEntry* dirEntry0, con
 	LLMsg::Out() << msg;
 
 	sprintf_s(filePath, ARRAYSIZE(filePath), "%s\\%s",
-		dirEntry0->szDir,
-		dirEntry0->filenameLStr);
-	m_dirSort.m_fillFindData(fileData, *dirEntry0, m_dirSort);
-	strncpy(fileData.cFileName, dirEntry0->filenameLStr, MAX_PATH);
-	LLPrintf::PrintFile(m_pushArgs, m_printFmt, dirEntry0->szDir, filePath, &fileData, depth);
+		m_dirSort.Dir(row0),
+		m_dirSort.Name(row0));
+	m_dirSort.GetFindData(row0, fileData);
+	strncpy(fileData.cFileName, m_dirSort.Name(row0), MAX_PATH);
+	LLPrintf::PrintFile(m_pushArgs, m_printFmt, m_dirSort.Dir(row0), filePath, &fileData, depth);
 
 	LLMsg::Out() << ", ";
 	sprintf_s(filePath, ARRAYSIZE(filePath), "%s\\%s",
-		dirEntry1->szDir,
-		dirEntry1->filenameLStr);
-	m_dirSort.m_fillFindData(fileData, *dirEntry1, m_dirSort);
-	strncpy(fileData.cFileName, dirEntry1->filenameLStr, MAX_PATH);
-	LLPrintf::PrintFile(m_pushArgs, m_printFmt, dirEntry1->szDir, filePath, &fileData, depth);
+		m_dirSort.Dir(row1),
+		m_dirSort.Name(row1));
+	m_dirSort.GetFindData(row1, fileData);
+	strncpy(fileData.cFileName, m_dirSort.Name(row1), MAX_PATH);
+	LLPrintf::PrintFile(m_pushArgs, m_printFmt, m_dirSort.Dir(row1), filePath, &fileData, depth);
 
 	return LLMsg::Out();
 }
 
 // ---------------------------------------------------------------------------
-int LLCmp::CompareFileData(DirEntryList& dirEntryList)
+void LLCmp::QueueFileData(const DirEntryList& dirEntryList)
 {
-    int resultStatus = sIgnore;
-
-    char filePath1[MAX_PATH];
-    char filePath2[MAX_PATH];
+    const LONGLONG sMinTaskBytes = 2 * CmpReader::sReadBytes;  // read buffers of a compare
+    LONGLONG budget = std::max(LONGLONG(m_cmpBudgetMB) << 20, sMinTaskBytes);
 
     if (dirEntryList.size() == 0)
-        return resultStatus;
+        return;
+
+    // Each group holds its bytes until reported, a group larger than the
+    // budget runs alone.
+    LONGLONG groupBytes = 0;
+    WIN32_FIND_DATA fileData;
+    for (size_t fileIdx = 1; fileIdx < dirEntryList.size(); fileIdx++)
+    {
+        m_dirSort.GetFindData(dirEntryList[fileIdx], fileData);
+        LONGLONG fileSize = ((LONGLONG)fileData.nFileSizeHigh << 32) | fileData.nFileSizeLow;
+        groupBytes += std::max(fileSize, sMinTaskBytes);
+    }
+    groupBytes = std::min(groupBytes, budget);
+
+    while (m_cmpBytes != 0 && m_cmpBytes + groupBytes > budget)
+        PopFileData(true);
+
+    m_cmpGroups.push_back(CmpGroup());
+    CmpGroup& group = m_cmpGroups.back();
+    group.rows = dirEntryList;
+    group.bytes = groupBytes;
+    group.running = unsigned(dirEntryList.size() - 1);
+    group.tasks.resize(dirEntryList.size() - 1);
+    m_cmpBytes += groupBytes;
+
+    std::string dir1;
+    m_dirSort.Dir(dirEntryList[0], dir1);
+    for (size_t fileIdx = 1; fileIdx < dirEntryList.size(); fileIdx++)
+    {
+        CmpTask& task = group.tasks[fileIdx - 1];
+        task.llcmp = this;
+        task.group = &group;
+        task.filePath1 = dir1 + "\\" + m_dirSort.Name(dirEntryList[0]);
+        m_dirSort.Dir(dirEntryList[fileIdx], task.filePath2);
+        task.filePath2 += '\\';
+        task.filePath2 += m_dirSort.Name(dirEntryList[fileIdx]);
+    }
+
+    // Tasks are complete before they are submitted, the deque keeps
+    // group in place as more groups are queued.
+    for (size_t taskIdx = 0; taskIdx != group.tasks.size(); taskIdx++)
+    {
+        if (m_cmpPool != NULL)
+            m_cmpPool->Submit(RunCmpTask, &group.tasks[taskIdx]);
+        else
+            RunCmpTask(&group.tasks[taskIdx]);
+    }
+}
+
+// ---------------------------------------------------------------------------
+void LLCmp::RunCmpTask(void* data)
+{
+    CmpTask& task = *(CmpTask*)data;
+    LLCmp& llcmp = *task.llcmp;
+    std::ostringstream cmpResults;
+
+    // Enable comma formatting of numbers.
+    char sep = ',';
+    int group = 3;
+    cmpResults.imbue(std::locale(std::locale(), new numfmt<char>(sep, group)));
+
+    task.compareInfo.openError = 0;
+    task.compareInfo.openPath = NULL;
+    task.compareInfo.readFailed = false;
+    task.compareInfo.sampled = false;
+    task.compareInfo.sampleDiffer = false;
+    task.result = (llcmp.*llcmp.compareFileMethod)(task.filePath1.c_str(), task.filePath2.c_str(),
+            task.compareInfo, llcmp.m_quitByteLimit, cmpResults);
+    task.results = cmpResults.str();
+
+    std::lock_guard<std::mutex> lock(llcmp.m_cmpMutex);
+    if (--task.group->running == 0)
+        llcmp.m_cmpDone.notify_all();
+}
+
+// ---------------------------------------------------------------------------
+// Report the oldest queued group, return false if there is none or it is
+// still running and not wait.
+bool LLCmp::PopFileData(bool wait)
+{
+    if (m_cmpGroups.empty())
+        return false;
+
+    CmpGroup& group = m_cmpGroups.front();
+    {
+        std::unique_lock<std::mutex> lock(m_cmpMutex);
+        if (group.running != 0 && !wait)
+            return false;
+        while (group.running != 0)
+            m_cmpDone.wait(lock);
+    }
+
+    if ( !m_cmpQuit && ReportGroupData(group) != sIgnore && IsQuit())
+        m_cmpQuit = true;
+
+    m_cmpBytes -= group.bytes;
+    m_cmpGroups.pop_front();
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+bool LLCmp::ReportFileData(bool wait)
+{
+    while (PopFileData(wait))
+        ;
+    return m_cmpQuit;
+}
 
-    bool isLeft = (_strnicmp(m_dirs[0].c_str(),  dirEntryList[0]->szDir, m_dirs[0].length()) == 0);
+// ---------------------------------------------------------------------------
+int LLCmp::ReportGroupData(CmpGroup& group)
+{
+    int resultStatus = sIgnore;
+    DirEntryList& dirEntryList = group.rows;
+
+    bool isLeft = (_strnicmp(m_dirs[0].c_str(),  m_dirSort.Dir(dirEntryList[0]), m_dirs[0].length()) == 0);
 
     if (dirEntryList.size() == 1 && m_matchMode == eNameAndData)
     {
         if ((isLeft && m_showSkipLeft) || ( !isLeft && m_showSkipRight))
         {
-            sprintf_s(filePath1, ARRAYSIZE(filePath1), "%s\\%s",
-                dirEntryList[0]->szDir,
-                dirEntryList[0]->filenameLStr);
-            LLMsg::Out() << "Skip, " << filePath1 << std::endl;
+            LLMsg::Out() << "Skip, " << m_dirSort.Dir(dirEntryList[0]) << "\\" << m_dirSort.Name(dirEntryList[0]) << std::endl;
             resultStatus = sOkay;
         }
         m_skipCount[isLeft ? 0 : 1]++;
@@ -858,30 +1077,22 @@ int LLCmp::CompareFileData(DirEntryList& dirEntryList)
 
     for (size_t fileIdx = 1; fileIdx < dirEntryList.size(); fileIdx++)
     {
-        sprintf_s(filePath1, ARRAYSIZE(filePath1), "%s\\%s",
-            dirEntryList[0]->szDir,
-            dirEntryList[0]->filenameLStr);
-        sprintf_s(filePath2, ARRAYSIZE(filePath2), "%s\\%s",
-            dirEntryList[fileIdx]->szDir,
-            dirEntryList[fileIdx]->filenameLStr);
-
-        CompareInfo compareInfo;
-        unsigned quitAfter = m_quitByteLimit;
-        std::ostringstream cmpResults;
+        CmpTask& task = group.tasks[fileIdx - 1];
+        const char* filePath1 = task.filePath1.c_str();
+        const char* filePath2 = task.filePath2.c_str();
+        CompareInfo& compareInfo = task.compareInfo;
+        const std::string& cmpResults = task.results;
+        CompareResult cmpResult = task.result;
 
-        // Enable comma formatting of numbers.
-        char sep = ',';
-        int group = 3;
-        cmpResults.imbue(std::locale(std::locale(), new numfmt<char>(sep, group)));
+        if (compareInfo.sampled)
+            m_sampledCount++;
+        if (compareInfo.sampleDiffer)
+            m_sampleDiffCount++;
 
-        isLeft = (_strnicmp(m_dirs[0].c_str(),  dirEntryList[0]->szDir, m_dirs[0].length()) == 0);
+        isLeft = (_strnicmp(m_dirs[0].c_str(),  m_dirSort.Dir(dirEntryList[0]), m_dirs[0].length()) == 0);
 
         bool okayToSkip = ((isLeft && m_showSkipLeft) || ( !isLeft && m_showSkipRight));
 
-        unsigned cmpResult = 
-                (this->*compareFileMethod)(filePath1, filePath2, compareInfo, quitAfter, cmpResults);
-
-
         switch (cmpResult)
         {
         case eCmpSkip:    // Skipped
@@ -890,12 +1101,15 @@ int LLCmp::CompareFileData(DirEntryList& dirEntryList)
             {
                 // LLMsg::Out() << "Skip, " << filePath1 << ", " << filePath2 << std::endl;
 				PrintPath("Skip, ", dirEntryList[0], dirEntryList[fileIdx]) << std::endl;
-                LLMsg::Out() << cmpResults.str();
+                LLMsg::Out() << cmpResults;
                 resultStatus = sOkay;
             }
             break;
         case eCmpErr:    // access error
             m_errorCount++;
+            if (compareInfo.openPath != NULL)
+                LLMsg::PresentError(compareInfo.openError,
+                    compareInfo.readFailed ? "Read failed," : "Open failed,", compareInfo.openPath);
             // LLMsg::Out() << "Err, " << filePath1 << ", " << filePath2 << std::endl;
 			PrintPath("Err, ", dirEntryList[0], dirEntryList[fileIdx]) << std::endl;
             resultStatus = sError;
@@ -906,7 +1120,7 @@ int LLCmp::CompareFileData(DirEntryList& dirEntryList)
             {
                 // LLMsg::Out() << "==, " << filePath1 << ", " << filePath2 << std::endl;
 				PrintPath("==, ", dirEntryList[0], dirEntryList[fileIdx]) << std::endl;
-                LLMsg::Out() << cmpResults.str();
+                LLMsg::Out() << cmpResults;
                 resultStatus = sOkay;
             }
 
@@ -962,11 +1176,11 @@ int LLCmp::CompareFileData(DirEntryList& dirEntryList)
                             << " (" << compareInfo.diffCnt*100/compareInfo.fileSize1
                             << "%)";
                     LLMsg::Out() << std::endl;
-                    LLMsg::Out() << cmpResults.str();
+                    LLMsg::Out() << cmpResults;
                     if (m_verbose && compareInfo.diffCnt != 0)
                     {
                         LLMsg::Out() << " Where:";
-                        DWORD whereSize = DWORD(compareInfo.fileSize2 / 100);
+                        LONGLONG whereSize = std::max(compareInfo.fileSize2 / 100, LONGLONG(1));
                         for (unsigned whIdx = 0; whIdx != 100; whIdx++)
                         {
                             if (compareInfo.whereCnt[whIdx] == 0)
@@ -1046,15 +1260,15 @@ int LLCmp::CompareFileSpecs(DirEntryList& dirEntryList)
         return sIgnore;
 
     sprintf_s(filePath0, ARRAYSIZE(filePath0), "%s\\%s",
-            dirEntryList[0]->szDir,
-            dirEntryList[0]->filenameLStr);
+            m_dirSort.Dir(dirEntryList[0]),
+            m_dirSort.Name(dirEntryList[0]));
     WIN32_FIND_DATA fileData0;
-    m_dirSort.m_fillFindData(fileData0, *dirEntryList[0], m_dirSort);
+    m_dirSort.GetFindData(dirEntryList[0], fileData0);
 
     bool allEqual = true;
     bool allDiff = true;
     bool isSkip = false;
-    bool isLeft = (_strnicmp(m_dirs[0].c_str(),  dirEntryList[0]->szDir, m_dirs[0].length()) == 0);
+    bool isLeft = (_strnicmp(m_dirs[0].c_str(),  m_dirSort.Dir(dirEntryList[0]), m_dirs[0].length()) == 0);
     bool okayToSkip = ((isLeft && m_showSkipLeft) || ( !isLeft && m_showSkipRight));
 
     if (dirEntryList.size() == 1)
@@ -1078,7 +1292,7 @@ int LLCmp::CompareFileSpecs(DirEntryList& dirEntryList)
 
     for (size_t fileIdx = 1; fileIdx < dirEntryList.size(); fileIdx++)
     {
-        m_dirSort.m_fillFindData(fileDataN, *dirEntryList[fileIdx], m_dirSort);
+        m_dirSort.GetFindData(dirEntryList[fileIdx], fileDataN);
         largeN.LowPart = fileDataN.nFileSizeLow;
         largeN.HighPart = fileDataN.nFileSizeHigh;
 
@@ -1107,9 +1321,9 @@ int LLCmp::CompareFileSpecs(DirEntryList& dirEntryList)
     for (size_t fileIdx = 1; fileIdx < dirEntryList.size(); fileIdx++)
     {
         sprintf_s(filePathN, ARRAYSIZE(filePath0), "%s\\%s",
-            dirEntryList[fileIdx]->szDir,
-            dirEntryList[fileIdx]->filenameLStr);
-        m_dirSort.m_fillFindData(fileDataN, *dirEntryList[fileIdx], m_dirSort);
+            m_dirSort.Dir(dirEntryList[fileIdx]),
+            m_dirSort.Name(dirEntryList[fileIdx]));
+        m_dirSort.GetFindData(dirEntryList[fileIdx], fileDataN);
         largeN.LowPart = fileDataN.nFileSizeLow;
         largeN.HighPart = fileDataN.nFileSizeHigh;
 
@@ -1236,147 +1450,554 @@ void LLCmp::ReportCompareFileSpecs() const
 }
 
 // ---------------------------------------------------------------------------
-// ---------------------------------------------------------------------------
+// Match order of rows for -L levels: name, then the last 'levels' directories
+// below the compared roots, then the full directory.
+//
+// 5/4/2013 - Change order from dir,name to name then dir to allow
+// matching in uneaven directories.
+// The root directories are peeled off so left and right trees line up.
+//
+// The level directory depends only on the directory, so it is built and case
+// folded once per DirId, names are compared by the LLDirSort keys. Equal
+// folded paths share one id (PathId) and equal folded directories below the
+// row's base directory share one id (RelDirId), so rows are matched by
+// comparing integers. The level directory only orders rows for display.
+// Compare only reads the tables and can be called from several threads.
 class CompareDirLevels
 {
 public:
-    static bool Compare(LLDirEntry* pDirEnt1, LLDirEntry* pDirEnt2);
-    static void SetLevels(unsigned levels, std::vector<std::string> dirs)
-    {
-        s_levels = levels;
-        s_dirs = dirs;
-        std::sort(s_dirs.begin(), s_dirs.end(),  CmpLen);
-    }
+    static const unsigned sMaxLevels = 50;
+
+    CompareDirLevels(const LLDirSort& dirSort, unsigned levels, const std::vector<std::string>& dirs);
+
+    int Compare(unsigned row1, unsigned row2) const;
+
+    unsigned PathId(unsigned row) const
+    { return m_rowKeys[row]; }
+    unsigned RelDirId(unsigned row) const
+    { return m_rowRelDirs[row]; }
+
+private:
+    CompareDirLevels(const CompareDirLevels&);
+    CompareDirLevels& operator=(const CompareDirLevels&);
+
+    static const char* LevelDir(const char* pDirStr, unsigned levels, const std::vector<std::string>& dirs);
     static bool CmpLen(const std::string& a, const std::string& b)
     {   return a.length() > b.length();    }
-    static const char* CompareDirLevels::GetDir(const LLDirEntry* pDirEnt);
+    // Same folding as _stricmp.
+    static char FoldChr(char chr)
+    {   return (chr >= 'A' && chr <= 'Z') ? (char)(chr - 'A' + 'a') : chr;  }
 
-    static unsigned s_levels;
-    static std::vector<std::string> s_dirs;
+    struct DirKey
+    {
+        std::string path;       // case folded, compared with strcmp
+        size_t      levelOff;   // level directory is path.c_str() + levelOff
+    };
+
+    const LLDirSort&        m_dirSort;
+    std::vector<DirKey>     m_keys;         // one per folded path
+    std::vector<unsigned>   m_rowKeys;      // per row, index in m_keys
+    std::vector<unsigned>   m_rowRelDirs;   // per row, relative directory id
 };
 
-unsigned CompareDirLevels::s_levels = 0;
-std::vector<std::string> CompareDirLevels::s_dirs;
+// ---------------------------------------------------------------------------
+CompareDirLevels::CompareDirLevels(const LLDirSort& dirSort, unsigned levels, const std::vector<std::string>& dirs) :
+    m_dirSort(dirSort),
+    m_rowKeys(dirSort.m_count),
+    m_rowRelDirs(dirSort.m_count)
+{
+    std::vector<std::string> rootDirs(dirs);
+    std::sort(rootDirs.begin(), rootDirs.end(), CmpLen);
+
+    typedef std::unordered_map<unsigned, unsigned> IdMap;
+    typedef std::unordered_map<std::string, unsigned> PathMap;
+    typedef std::unordered_map<ULONGLONG, unsigned> RelMap;
+    IdMap   dirKeys;        // DirId to keys index
+    PathMap pathKeys;       // folded path to keys index
+    RelMap  dirRelDirs;     // DirId and base dir length to relative directory id
+    PathMap relDirIds;      // folded relative directory to its id
+    std::string path;
+    for (unsigned row = 0; row != dirSort.m_count; row++)
+    {
+        std::pair<IdMap::iterator, bool> found = dirKeys.insert(std::make_pair(dirSort.DirId(row), 0u));
+        if (found.second)
+        {
+            dirSort.Dir(row, path);
+            size_t levelOff = LevelDir(path.c_str(), levels, rootDirs) - path.c_str();
+            std::transform(path.begin(), path.end(), path.begin(), FoldChr);
+
+            std::pair<PathMap::iterator, bool> pathFound =
+                pathKeys.insert(std::make_pair(path, (unsigned)m_keys.size()));
+            if (pathFound.second)
+            {
+                m_keys.push_back(DirKey());
+                DirKey& key = m_keys.back();
+                key.path = path;
+                key.levelOff = levelOff;
+            }
+            found.first->second = pathFound.first->second;
+        }
+        m_rowKeys[row] = found.first->second;
+
+        // Same directory relative to the compared root, as _stricmp of Dir() + BaseDirLen().
+        ULONGLONG dirBase = ((ULONGLONG)dirSort.DirId(row) << 32) | (unsigned)dirSort.BaseDirLen(row);
+        std::pair<RelMap::iterator, bool> relFound = dirRelDirs.insert(std::make_pair(dirBase, 0u));
+        if (relFound.second)
+        {
+            const std::string& keyPath = m_keys[m_rowKeys[row]].path;
+            size_t baseLen = std::min((size_t)dirSort.BaseDirLen(row), keyPath.length());
+            relFound.first->second = relDirIds.insert(
+                std::make_pair(keyPath.substr(baseLen), (unsigned)relDirIds.size())).first->second;
+        }
+        m_rowRelDirs[row] = relFound.first->second;
+    }
+}
 
 // ---------------------------------------------------------------------------
-const char* CompareDirLevels::GetDir(const LLDirEntry* pDirEnt)
+// Return start of the level directory in pDirStr, points at its terminating
+// nul if there is none.
+const char* CompareDirLevels::LevelDir(const char* pDirStr, unsigned levels, const std::vector<std::string>& dirs)
 {
-    const int sMaxLevels = 50;
-    const char* dirs[sMaxLevels];
+    const char* levelDirs[sMaxLevels];
     int dirLevel = 0;
-    const char* pDirStr = pDirEnt->szDir;
-    for (unsigned dirIdx = 0; dirIdx != s_dirs.size(); dirIdx++)
+    const char* pDirBeg = pDirStr;
+    for (unsigned dirIdx = 0; dirIdx != dirs.size(); dirIdx++)
     {
-        if (_strnicmp(s_dirs[dirIdx].c_str(), pDirStr,  s_dirs[dirIdx].length()) == 0)
+        if (_strnicmp(dirs[dirIdx].c_str(), pDirStr,  dirs[dirIdx].length()) == 0)
         {
-            pDirStr += s_dirs[dirIdx].length();
-            if (*pDirStr != '\\')
+            pDirStr += dirs[dirIdx].length();
+            if (*pDirStr != '\\' && pDirStr != pDirBeg)
                 pDirStr--;        // backup so it starts on slash
             break;
         }
     }
 
-    while (*pDirStr != 0 && dirLevel < sMaxLevels)
+    while (*pDirStr != 0 && dirLevel < (int)sMaxLevels)
     {
         if (*pDirStr == '\\')
-            dirs[dirLevel++] = pDirStr;
+            levelDirs[dirLevel++] = pDirStr;
         pDirStr++;
     }
 
     dirLevel--;
-    if (dirLevel >= (int)s_levels)
-        return dirs[dirLevel - s_levels];
-    return (dirLevel < 0) ? "" : dirs[0];
+    if (dirLevel >= (int)levels)
+        return levelDirs[dirLevel - levels];
+    return (dirLevel < 0) ? pDirStr + strlen(pDirStr) : levelDirs[0];
+}
+
+// ---------------------------------------------------------------------------
+int CompareDirLevels::Compare(unsigned row1, unsigned row2) const
+{
+    int nameCmp = m_dirSort.CompareNames(row1, row2);
+    unsigned keyIdx1 = m_rowKeys[row1];
+    unsigned keyIdx2 = m_rowKeys[row2];
+    if (nameCmp == 0 && keyIdx1 != keyIdx2)
+    {
+        const DirKey& key1 = m_keys[keyIdx1];
+        const DirKey& key2 = m_keys[keyIdx2];
+        nameCmp = strcmp(key1.path.c_str() + key1.levelOff, key2.path.c_str() + key2.levelOff);
+        if (nameCmp == 0)
+            nameCmp = strcmp(key1.path.c_str(), key2.path.c_str());
+    }
+    return nameCmp;
 }
 
 // ---------------------------------------------------------------------------
-bool CompareDirLevels::Compare(LLDirEntry* pDirEnt1, LLDirEntry* pDirEnt2)
+// Row order for the algorithms, copies share the tables.
+struct DirLevelsLess
 {
-    // 5/4/2013 - Change order from dir,name to name then dir to allow
-    // matching in uneaven directories.
-    // Also add s_dir list to this sorting object to peel off the root directories.
+    DirLevelsLess(const CompareDirLevels& compare) : m_compare(compare)
+    { }
 
+    bool operator()(unsigned row1, unsigned row2) const
+    { return m_compare.Compare(row1, row2) < 0; }
 
-    int nameCmp =  _stricmp(pDirEnt1->filenameLStr, pDirEnt2->filenameLStr);
-	
-	if (nameCmp == 0)
-	{
-		const char* pDir1 = GetDir(pDirEnt1);
-		const char* pDir2 = GetDir(pDirEnt2);
-		nameCmp = _stricmp(pDir1, pDir2);
-	}
-    int fullCmp =  (nameCmp != 0) ? nameCmp : _stricmp(pDirEnt1->szDir, pDirEnt2->szDir);
-    return fullCmp < 0;
+    const CompareDirLevels& m_compare;
+};
+
+// ---------------------------------------------------------------------------
+// Group order by the first row of each group, by name only when the
+// directory is not matched. Ties keep the group order (first seen first).
+struct GroupLess
+{
+    GroupLess(const CompareDirLevels& compare, const LLDirSort& dirSort,
+            const DirEntryList& rows, const std::vector<unsigned>& groupBegins, bool useDir) :
+        m_compare(compare), m_dirSort(dirSort), m_rows(rows), m_groupBegins(groupBegins), m_useDir(useDir)
+    { }
+
+    bool operator()(unsigned group1, unsigned group2) const
+    {
+        unsigned row1 = m_rows[m_groupBegins[group1]];
+        unsigned row2 = m_rows[m_groupBegins[group2]];
+        return (m_useDir ? m_compare.Compare(row1, row2) : m_dirSort.CompareNames(row1, row2)) < 0;
+    }
+
+    const CompareDirLevels&         m_compare;
+    const LLDirSort&                m_dirSort;
+    const DirEntryList&             m_rows;
+    const std::vector<unsigned>&    m_groupBegins;
+    bool                            m_useDir;
+};
+
+// ---------------------------------------------------------------------------
+// FNV-1a hash of a name key and a relative directory id.
+static unsigned MatchHash(const char* key, unsigned relDirId)
+{
+    unsigned hash = 2166136261u;
+    for (; *key != '\0'; key++)
+        hash = (hash ^ (unsigned char)*key) * 16777619u;
+    for (unsigned byte = 0; byte != sizeof(relDirId); byte++, relDirId >>= 8)
+        hash = (hash ^ (relDirId & 0xff)) * 16777619u;
+    return hash;
 }
 
 // ---------------------------------------------------------------------------
+// Group the rows which are compared with each other, each group is
+// rows[groupEnds[g-1] .. groupEnds[g]).
+//
+// Rows are matched by a hash join, in one pass over the rows: the key is the
+// folded name and, with -l levels or path matching, the folded directory
+// below the compared root, so only files at the same relative path pair up.
+// A group holds one row per tree for a match, a single row is only on the
+// left or right side. When the directory is matched the same file found
+// twice (same name and folded path) is kept once.
+//
+// Sorting is only for presentation, groups are shown by name then level
+// directory and the rows of a group by directory. Without levels, groups
+// are shown by name and rows keep their scan order.
+void LLCmp::JoinDirEntries(DirEntryList& rows, std::vector<unsigned>& groupEnds)
+{
+    const unsigned sNone = unsigned(-1);
+    unsigned levels = (m_matchMode == ePathAndData) ? CompareDirLevels::sMaxLevels : m_levels;
+    bool useDir = (levels != 0);
+    CompareDirLevels compare(m_dirSort, levels, m_dirs);
+
+    // Groups are linked lists of rows while joining.
+    std::vector<unsigned> groupHead;
+    std::vector<unsigned> groupTail;
+    std::vector<unsigned> nextRow(m_dirSort.m_count, sNone);
+    std::unordered_multimap<unsigned, unsigned> groups;     // hash to group
+    groups.reserve(m_dirSort.m_count);
+
+    for (unsigned row = 0; row != m_dirSort.m_count; row++)
+    {
+        if (IsExcluded(row) ||
+            !LLSup::PatternListMatches(m_includeFileList, m_dirSort.Name(row), true) ||
+            !LLSup::CompareRhsBits(m_dirSort.Attributes(row), m_onlyRhs))
+            continue;
+
+        unsigned relDirId = useDir ? compare.RelDirId(row) : 0;
+        unsigned hash = MatchHash(m_dirSort.Key(row).key, relDirId);
+        unsigned group = sNone;
+        auto range = groups.equal_range(hash);
+        for (auto it = range.first; it != range.second && group == sNone; ++it)
+        {
+            unsigned head = groupHead[it->second];
+            if (m_dirSort.CompareNames(head, row) == 0 && (!useDir || compare.RelDirId(head) == relDirId))
+                group = it->second;
+        }
+
+        if (group == sNone)
+        {
+            groups.insert(std::make_pair(hash, (unsigned)groupHead.size()));
+            groupHead.push_back(row);
+            groupTail.push_back(row);
+            continue;
+        }
+
+        unsigned pathId = compare.PathId(row);
+        unsigned groupRow = useDir ? groupHead[group] : sNone;
+        while (groupRow != sNone && compare.PathId(groupRow) != pathId)
+            groupRow = nextRow[groupRow];
+        if (groupRow == sNone)
+        {
+            nextRow[groupTail[group]] = row;
+            groupTail[group] = row;
+        }
+    }
+    groups.clear();
+
+    // Flatten in join order with the rows of each group in directory order.
+    DirEntryList joined;
+    std::vector<unsigned> groupBegins(groupHead.size() + 1);
+    joined.reserve(m_dirSort.m_count);
+    for (unsigned group = 0; group != groupHead.size(); group++)
+    {
+        groupBegins[group] = (unsigned)joined.size();
+        for (unsigned row = groupHead[group]; row != sNone; row = nextRow[row])
+            joined.push_back(row);
+        if (useDir)
+            std::sort(joined.begin() + groupBegins[group], joined.end(), DirLevelsLess(compare));
+    }
+    groupBegins.back() = (unsigned)joined.size();
+
+    std::vector<unsigned> groupOrder(groupHead.size());
+    for (unsigned group = 0; group != groupOrder.size(); group++)
+        groupOrder[group] = group;
+    ParallelSort(groupOrder, GroupLess(compare, m_dirSort, joined, groupBegins, useDir));
+
+    rows.clear();
+    rows.reserve(joined.size());
+    groupEnds.clear();
+    groupEnds.reserve(groupOrder.size());
+    for (unsigned pos = 0; pos != groupOrder.size(); pos++)
+    {
+        unsigned group = groupOrder[pos];
+        rows.insert(rows.end(), joined.begin() + groupBegins[group], joined.begin() + groupBegins[group + 1]);
+        groupEnds.push_back((unsigned)rows.size());
+    }
+}
+
 // ---------------------------------------------------------------------------
-void  LLCmp::SortDirEntries()
+// MD5 of the first maxBytes of a file, return 0 or the error.
+// Unchanged files found in hashCache (-H) are not read.
+static DWORD HashFileData(const char* filePath, ULONGLONG maxBytes, std::vector<Byte>& buffer,
+        HashCache& hashCache, ULONGLONG hash[2])
 {
-    if (m_levels == 0 || m_dirSort.m_pFirst == NULL)
-        return;
+    Handle fHnd = CreateFile(filePath, GENERIC_READ, SHARE_ALL, 0,
+            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+    if (fHnd.NotValid())
+        return GetLastError();
+
+    HashCache::Key key;
+    bool cached = hashCache.IsOpen() && HashCache::GetKey(fHnd, maxBytes, key);
+    if (cached && hashCache.Find(key, (BYTE*)hash))
+        return 0;
+
+    md5_state_t state;
+    md5_init(&state);
+
+    DWORD rlen = 1;
+    while (maxBytes != 0 && rlen != 0)
+    {
+        DWORD readLen = (DWORD)std::min(maxBytes, ULONGLONG(buffer.size()));
+        if (ReadFile(fHnd, buffer.data(), readLen, &rlen, 0) == 0)
+            return GetLastError();
+        md5_append(&state, (const md5_byte_t *)buffer.data(), (int)rlen);
+        maxBytes -= rlen;
+    }
+
+    md5_byte_t digest[16];
+    md5_finish(&state, digest);
+    memcpy(hash, digest, sizeof(digest));
+    if (cached)
+        hashCache.Store(key, digest);
+    return 0;
+}
 
-    CompareDirLevels::SetLevels(m_levels, m_dirs);
-    typedef std::set<LLDirEntry*, bool(*)(LLDirEntry*, LLDirEntry*)> SortedSet;
-    SortedSet sortedSet(CompareDirLevels::Compare);
+// ---------------------------------------------------------------------------
+// Slice of candidates hashed by one compare worker.
+struct DupHashBatch
+{
+    const LLDirSort*    dirSort;
+    HashCache*          hashCache;
+    DupCandidate*       begin;
+    DupCandidate*       end;
+    ULONGLONG           minSize;
+    ULONGLONG           maxBytes;
+};
+
+static void RunDupHashBatch(void* data)
+{
+    const DWORD sBufBytes = 1 << 20;
+    DupHashBatch& batch = *(DupHashBatch*)data;
+    std::vector<Byte> buffer((size_t)std::min(batch.maxBytes, ULONGLONG(sBufBytes)));
+    std::string filePath;
 
-    LLDirEntry*  pDirEntry = m_dirSort.m_pFirst;
-    while (pDirEntry)
+    for (DupCandidate* cand = batch.begin; cand != batch.end; cand++)
     {
-        sortedSet.insert(pDirEntry);
-        pDirEntry = pDirEntry->pNext;
+        if (cand->size <= batch.minSize)
+            continue;
+        batch.dirSort->Dir(cand->row, filePath);
+        filePath += '\\';
+        filePath += batch.dirSort->Name(cand->row);
+        cand->error = HashFileData(filePath.c_str(), batch.maxBytes, buffer, *batch.hashCache, cand->hash);
     }
+}
+
+// ---------------------------------------------------------------------------
+// Largest files first, then by hash, then in scan order.
+struct DupLess
+{
+    bool operator()(const DupCandidate& left, const DupCandidate& right) const
+    {
+        if (left.size != right.size)
+            return left.size > right.size;
+        if (left.hash[0] != right.hash[0])
+            return left.hash[0] < right.hash[0];
+        if (left.hash[1] != right.hash[1])
+            return left.hash[1] < right.hash[1];
+        return left.row < right.row;
+    }
+};
+
+static bool SameContent(const DupCandidate& left, const DupCandidate& right)
+{
+    return left.size == right.size && left.hash[0] == right.hash[0] && left.hash[1] == right.hash[1];
+}
 
-    pDirEntry = m_dirSort.m_pFirst = *sortedSet.begin();
-    // LLMsg::Out() << pDirEntry->szDir << pDirEntry->filenameLStr.m_str << std::endl;
-    SortedSet::iterator iter = sortedSet.begin();
-    if (iter != sortedSet.end())
+// ---------------------------------------------------------------------------
+// Sort candidates and keep those with the same size and hash as another.
+static void KeepDupCandidates(std::vector<DupCandidate>& cands)
+{
+    ParallelSort(cands, DupLess());
+
+    size_t keep = 0;
+    size_t end;
+    for (size_t begin = 0; begin != cands.size(); begin = end)
     {
-        iter++;
-        for ( ; iter != sortedSet.end(); ++iter)
+        for (end = begin + 1; end != cands.size() && SameContent(cands[begin], cands[end]); end++)
+            ;
+        if (end - begin > 1)
         {
-            // LLMsg::Out() << (*iter)->filenameLStr << " " << (*iter)->szDir <<  std::endl;
+            for (size_t idx = begin; idx != end; idx++)
+                cands[keep++] = cands[idx];
+        }
+    }
+    cands.resize(keep);
+}
 
-            pDirEntry->pNext = *iter;
-            (*iter)->pPrev = pDirEntry;
-            pDirEntry = *iter;
-            (*iter)->pNext = NULL;
-            // LLMsg::Out() << pDirEntry->szDir << pDirEntry->filenameLStr.m_str << std::endl;
+// ---------------------------------------------------------------------------
+void LLCmp::HashDupCandidates(std::vector<DupCandidate>& cands, ULONGLONG minSize, ULONGLONG maxBytes)
+{
+    const size_t sBatchCands = 64;
+    std::vector<DupHashBatch> batches((cands.size() + sBatchCands - 1) / sBatchCands);
+    for (size_t idx = 0; idx != batches.size(); idx++)
+    {
+        DupHashBatch& batch = batches[idx];
+        batch.dirSort = &m_dirSort;
+        batch.hashCache = &m_hashCache;
+        batch.begin = cands.data() + idx * sBatchCands;
+        batch.end = cands.data() + std::min(cands.size(), (idx + 1) * sBatchCands);
+        batch.minSize = minSize;
+        batch.maxBytes = maxBytes;
+        if (m_cmpPool != NULL)
+            m_cmpPool->Submit(RunDupHashBatch, &batch);
+        else
+            RunDupHashBatch(&batch);
+    }
+    if (m_cmpPool != NULL)
+        m_cmpPool->Wait();
+
+    size_t keep = 0;
+    for (size_t idx = 0; idx != cands.size(); idx++)
+    {
+        if (cands[idx].error == 0)
+        {
+            cands[keep++] = cands[idx];
+            continue;
         }
+
+        m_errorCount++;
+        m_dirSort.Dir(cands[idx].row, m_rowPath);
+        m_rowPath += '\\';
+        m_rowPath += m_dirSort.Name(cands[idx].row);
+        LLMsg::PresentError(cands[idx].error, "Read failed,", m_rowPath.c_str());
+    }
+    cands.resize(keep);
+}
+
+// ---------------------------------------------------------------------------
+void LLCmp::CloseHashCache()
+{
+    if ( !m_hashCache.IsOpen())
+        return;
+
+    VerboseMsg() << "[HashCache] hits=" << m_hashCache.Hits()
+        << " misses=" << m_hashCache.Misses()
+        << " hashes=" << m_hashCache.Size() << std::endl;
+    m_hashCache.Save();
+}
+
+// ---------------------------------------------------------------------------
+// Only files which could have a duplicate are read: same size files have the
+// head of their data hashed, files whose heads match then have all their
+// data hashed. Empty files are not matched.
+void LLCmp::JoinContentEntries(DirEntryList& rows, std::vector<unsigned>& groupEnds)
+{
+    const ULONGLONG sHeadBytes = 4096;
+
+    std::vector<DupCandidate> cands;
+    cands.reserve(m_dirSort.m_count);
+    for (unsigned row = 0; row != m_dirSort.m_count; row++)
+    {
+        if (IsExcluded(row) ||
+            !LLSup::PatternListMatches(m_includeFileList, m_dirSort.Name(row), true) ||
+            !LLSup::CompareRhsBits(m_dirSort.Attributes(row), m_onlyRhs))
+            continue;
+
+        DupCandidate cand;
+        cand.size = m_dirSort.GetValue(row, LLDirSort::eSize);
+        cand.hash[0] = cand.hash[1] = 0;
+        cand.row = row;
+        cand.error = 0;
+        if (cand.size != 0)
+            cands.push_back(cand);
+    }
+
+    KeepDupCandidates(cands);       // same size
+    HashDupCandidates(cands, 0, sHeadBytes);
+    KeepDupCandidates(cands);       // same head
+    HashDupCandidates(cands, sHeadBytes, ULONGLONG(-1));
+    KeepDupCandidates(cands);       // same data
+
+    rows.clear();
+    rows.reserve(cands.size());
+    groupEnds.clear();
+    for (size_t idx = 0; idx != cands.size(); idx++)
+    {
+        if (idx != 0 && !SameContent(cands[idx - 1], cands[idx]))
+            groupEnds.push_back((unsigned)rows.size());
+        rows.push_back(cands[idx].row);
     }
+    if (!rows.empty())
+        groupEnds.push_back((unsigned)rows.size());
+}
+
+// ---------------------------------------------------------------------------
+// Return true if full path of row matches the -X exclude list, the path is
+// only built when there is a list.
+bool LLCmp::IsExcluded(unsigned row)
+{
+    if (m_excludeList.empty())
+        return false;
+
+    m_dirSort.Dir(row, m_rowPath);
+    m_rowPath += '\\';
+    m_rowPath += m_dirSort.Name(row);
+    return LLSup::PatternListMatches(m_excludeList, m_rowPath.c_str());
 }
 
 // ---------------------------------------------------------------------------
-void  LLCmp::DoCmp(CmpMatch cmpMatch)
+void  LLCmp::DoCmp()
 {
     int resultStatus = sIgnore;
-    LLDirEntry* pDirEntry = m_dirSort.m_pFirst;
     DirEntryList cmpList;
-	char filePath[MAX_PATH]; 
+    size_t dirEntryCnt = m_dirSort.m_count;
 
-    size_t dirEntryCnt = 0;
-    while (pDirEntry)
+    // Diff maps of all differing files share one pool, a compare task
+    // waits on it for the regions of its own file.
+    std::unique_ptr<WorkPool> diffMapPool;
+    if (m_compareDataMode == eCompareBinary && m_diffMapRanges != 0 && m_cmpThreads != 1)
     {
-        dirEntryCnt++;
-        pDirEntry = pDirEntry->pNext;
+        diffMapPool.reset(new WorkPool(m_cmpThreads));
+        m_diffMapPool = diffMapPool.get();
     }
 
-    if (dirEntryCnt == 2)
+    if (dirEntryCnt == 2 && m_matchMode != eContentData)
     {
         // Special Case, don't match filenames.
 
-        pDirEntry = m_dirSort.m_pFirst;
-        while (pDirEntry)
+        m_dirSort.Sort();
+        for (size_t fileIdx = 0; fileIdx != dirEntryCnt; fileIdx++)
         {
-			sprintf_s(filePath, ARRAYSIZE(filePath), "%s\\%s", pDirEntry->szDir, pDirEntry->filenameLStr);
-
-            if ( !LLSup::PatternListMatches(m_excludeList, filePath) &&
-                LLSup::PatternListMatches(m_includeFileList, pDirEntry->filenameLStr, true) &&
-                LLSup::CompareRhsBits(pDirEntry->dwFileAttributes, m_onlyRhs))
+            unsigned row = m_dirSort.Row(fileIdx);
+            if ( !IsExcluded(row) &&
+                LLSup::PatternListMatches(m_includeFileList, m_dirSort.Name(row), true) &&
+                LLSup::CompareRhsBits(m_dirSort.Attributes(row), m_onlyRhs))
             {
-                cmpList.push_back(pDirEntry);
+                cmpList.push_back(row);
             }
-            pDirEntry = pDirEntry->pNext;
         }
 
         bool showAny = m_showEqual | m_showDiff | m_showSkipLeft | m_showSkipRight;
@@ -1391,13 +2012,15 @@ void  LLCmp::DoCmp(CmpMatch cmpMatch)
             if (showAny)
                 LLMsg::Out() << "Binary Compare\n";
             compareFileMethod = &LLCmp::CompareDataBinary;
-            resultStatus = CompareFileData(cmpList);
+            QueueFileData(cmpList);
+            ReportFileData(true);
             break;
         case eCompareText:
             if (showAny)
                 LLMsg::Out() << "Text Compare\n";
             compareFileMethod = &LLCmp::CompareDataText;
-            resultStatus = CompareFileData(cmpList);
+            QueueFileData(cmpList);
+            ReportFileData(true);
             break;
         }
     }
@@ -1413,37 +2036,43 @@ void  LLCmp::DoCmp(CmpMatch cmpMatch)
         case eCompareBinary:
             if (showAny)
                 LLMsg::Out() << "Binary Compare\n";
+            compareFileMethod = &LLCmp::CompareDataBinary;
             break;
         case eCompareText:
             if (showAny)
                 LLMsg::Out() << "Text Compare\n";
+            compareFileMethod = &LLCmp::CompareDataText;
             break;
         }
 
-        SortDirEntries();
-        unsigned fileIdx = 0;
-        pDirEntry = m_dirSort.m_pFirst;
-        while (pDirEntry)
+        if (m_matchMode == eContentData && m_compareDataMode != eCompareSpecs && !m_verifyContent)
+            compareFileMethod = &LLCmp::CompareDataHashed;
+
+        // Contents are compared on a pool while earlier groups are reported.
+        std::unique_ptr<WorkPool> cmpPool;
+        if (m_compareDataMode != eCompareSpecs && m_cmpThreads != 1)
         {
-            cmpList.clear();
+            cmpPool.reset(new WorkPool(m_cmpThreads));
+            m_cmpPool = cmpPool.get();
+        }
 
-            do
-            {
-				sprintf_s(filePath, ARRAYSIZE(filePath), "%s\\%s", pDirEntry->szDir, pDirEntry->filenameLStr);
-                if ( !LLSup::PatternListMatches(m_excludeList, filePath) &&
-					LLSup::PatternListMatches(m_includeFileList, pDirEntry->filenameLStr, true) &&
-                    LLSup::CompareRhsBits(pDirEntry->dwFileAttributes, m_onlyRhs))
-                {
-                    cmpList.push_back(pDirEntry);
-                }
-                pDirEntry = pDirEntry->pNext;
-                fileIdx++;
-            } while (pDirEntry && cmpMatch(pDirEntry, cmpList[0], m_levels));
+        DirEntryList joinRows;
+        std::vector<unsigned> groupEnds;
+        if (m_matchMode == eContentData)
+            JoinContentEntries(joinRows, groupEnds);
+        else
+            JoinDirEntries(joinRows, groupEnds);
+        size_t fileIdx = 0;
+        bool quit = false;
+        for (size_t group = 0; group != groupEnds.size(); group++)
+        {
+            cmpList.assign(joinRows.begin() + fileIdx, joinRows.begin() + groupEnds[group]);
+            fileIdx = groupEnds[group];
 
             if (m_progress)
             {
                 // Show file compare progress.
-                std::cout << fileIdx * 100 / m_inFileCnt << "% ";
+                std::cout << fileIdx * 100 / joinRows.size() << "% ";
                 std::cout << " Eq:" << m_equalCount;
                 if (m_diffCount != 0)
                     std::cout << ", Ne:" << m_diffCount;
@@ -1462,21 +2091,23 @@ void  LLCmp::DoCmp(CmpMatch cmpMatch)
             {
             case eCompareSpecs:
                 resultStatus = CompareFileSpecs(cmpList);
+                quit = (resultStatus != sIgnore && IsQuit());
                 break;
             case eCompareBinary:
-                compareFileMethod = &LLCmp::CompareDataBinary;
-                resultStatus = CompareFileData(cmpList);
-                break;
             case eCompareText:
-                compareFileMethod = &LLCmp::CompareDataText;
-                resultStatus = CompareFileData(cmpList);
+                QueueFileData(cmpList);
+                quit = ReportFileData(false);
                 break;
             }
 
-            if (resultStatus != sIgnore && IsQuit())
+            if (quit)
                 break;
         }
+
+        ReportFileData(true);
+        m_cmpPool = NULL;
     }
+    m_diffMapPool = NULL;
 
     switch (m_compareDataMode)
     {
@@ -32,11 +32,16 @@
 #pragma once
 
 #include "llbase.h"
+#include "HashCache.h"
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
 
 // Forward declaration
 struct DirectoryScan;
-typedef bool (*CmpMatch)(const LLDirEntry* p1, const LLDirEntry* p2, unsigned levels);
-typedef std::vector<LLDirEntry*> DirEntryList;
+class WorkPool;
+typedef std::vector<unsigned> DirEntryList;     // LLDirSort rows
 
 // ---------------------------------------------------------------------------
 struct LLCmpConfig : public LLConfig
@@ -81,6 +86,16 @@ public:
 	{  return m_charSet[c]; }
 };
 
+// ---------------------------------------------------------------------------
+// File of a content match, hash is of its first bytes or of all its data.
+struct DupCandidate
+{
+    ULONGLONG   size;
+    ULONGLONG   hash[2];
+    unsigned    row;
+    DWORD       error;      // read failure, candidate is dropped
+};
+
 class LLCmp : public LLBase
 {
 public:
@@ -93,8 +108,11 @@ public:
     int ProcessEntry(const char* pDir, const WIN32_FIND_DATA* pFileData, int depth)
     {  assert(0); return sError; } // Not implemented.
 
-    void DoCmp(CmpMatch cmpMatch);
-    void SortDirEntries();
+    void DoCmp();
+    // Group rows to compare, group g is rows[groupEnds[g-1] .. groupEnds[g]).
+    void JoinDirEntries(DirEntryList& rows, std::vector<unsigned>& groupEnds);
+    // Group rows with the same contents, largest files first, same groupEnds.
+    void JoinContentEntries(DirEntryList& rows, std::vector<unsigned>& groupEnds);
 
     static LLCmpConfig sConfig;
     LLConfig&       GetConfig();
@@ -116,8 +134,9 @@ protected:
 
     CompareDataMode m_compareDataMode;
 
-    enum MatchMode{ eNameAndData, ePathAndData };
+    enum MatchMode{ eNameAndData, ePathAndData, eContentData };
     MatchMode       m_matchMode;
+    bool            m_verifyContent;    // byte compare files grouped by content hash
 
     LONGLONG        m_offset;           // file offset
     uint            m_quitByteLimit;    // number of different bytes to dump if in verbose mode.
@@ -133,6 +152,15 @@ protected:
     size_t          m_delCount;
     size_t          m_diffLineCount;    // available with -t option.
 
+    uint            m_cmpThreads;       // content compare workers, 0=one per cpu, 1=serial
+    uint            m_cmpBudgetMB;      // MB of files compared at once
+    HashCache       m_hashCache;        // -H=<cacheDir> file hashes kept between runs
+    uint            m_sampleBlocks;     // sampled pre-check blocks between head and tail, 0=off
+    size_t          m_sampledCount;     // pairs given the sampled pre-check
+    size_t          m_sampleDiffCount;  // pairs found different by the pre-check
+    uint            m_diffMapRanges;    // ranges listed of a differing binary file, 0=no diff map
+    bool            m_diffMapShifted;   // also map content moved within the files
+
     enum Delete { eNoDel, eMatchDel, eNoMatchDel, eGreaterDel, eLesserDel, eGreater2Del, eLesser2Del};
     Delete          m_delCmd;
     int             m_delFiles; // While files to delete in group: -1=all files, 0=first, 1=2nd 
@@ -146,6 +174,11 @@ private:
         LONGLONG    differAt;
         ULONG       diffCnt;
         DWORD       whereCnt[100];
+        DWORD       openError;      // open failure of openPath, reported in order
+        const char* openPath;
+        bool        readFailed;     // openError is a read failure, not an open failure
+        bool        sampled;        // sampled pre-check was run
+        bool        sampleDiffer;   // sampled pre-check found a difference
     };
 
     enum CompareResult { eCmpSkip = -2, eCmpErr = -1, eCmpEqual = 0, eCmpDiff = 1 };
@@ -163,15 +196,55 @@ private:
     int CompareFileSpecs(DirEntryList& dirEntryList);
     void ReportCompareFileSpecs() const;
 
-	std::ostream&  PrintPath(const char* msg, const LLDirEntry* dirEntry0, const LLDirEntry* dirEntry1);
+	std::ostream&  PrintPath(const char* msg, unsigned row0, unsigned row1);
+    bool IsExcluded(unsigned row);
+
+    // Contents compare of one pair of a group, run on a pipeline worker.
+    struct CmpGroup;
+    struct CmpTask
+    {
+        LLCmp*          llcmp;
+        CmpGroup*       group;
+        std::string     filePath1;
+        std::string     filePath2;
+        CompareInfo     compareInfo;
+        CompareResult   result;
+        std::string     results;        // compare method output
+    };
+
+    // Group of rows, first row is compared against each other row.
+    struct CmpGroup
+    {
+        DirEntryList            rows;
+        std::vector<CmpTask>    tasks;
+        LONGLONG                bytes;      // share of the in-flight budget
+        unsigned                running;    // tasks not finished, guarded by m_cmpMutex
+    };
+
+    // Queue contents compares of a group, they run on m_cmpPool (inline
+    // without a pool) while at most m_cmpBudgetMB of files are queued.
+    void QueueFileData(const DirEntryList& dirEntryList);
+    // Report queued groups in queue order, only finished ones unless wait.
+    // Return true to quit (-Q limit), later groups are then not reported.
+    bool ReportFileData(bool wait);
+    bool PopFileData(bool wait);
+    static void RunCmpTask(void* data);
 
     // Return sIgnore, sOkay or sError
-    int CompareFileData(DirEntryList& dirEntryList);
+    int ReportGroupData(CmpGroup& group);
 
     CompareResult CompareDataBinary(const char* filePath1, const char* filePath2,
         CompareInfo& comapreInfo, unsigned quitAfter, std::ostream&);
     CompareResult CompareDataText(const char* filePath1, const char* filePath2,
         CompareInfo& comapreInfo, unsigned quitAfter, std::ostream&);
+    CompareResult CompareDataHashed(const char* filePath1, const char* filePath2,
+        CompareInfo& comapreInfo, unsigned quitAfter, std::ostream&);
+
+    // Save hash cache (-H) and report hit counts (-v).
+    void CloseHashCache();
+
+    // Hash at most maxBytes of candidates larger than minSize, drop unreadable ones.
+    void HashDupCandidates(std::vector<DupCandidate>& cands, ULONGLONG minSize, ULONGLONG maxBytes);
 
     void DeleteCmpFile(const char* fileToDel);
 
@@ -189,6 +262,15 @@ private:
     std::string         m_maxFileN;
     LONGLONG            m_sizeFile0;
     LONGLONG            m_sizeFileN;
+    std::string         m_rowPath;      // IsExcluded path buffer
+
+    WorkPool*               m_cmpPool;      // NULL runs compares inline
+    WorkPool*               m_diffMapPool;  // NULL runs diff map regions inline
+    std::deque<CmpGroup>    m_cmpGroups;    // queued, in report order
+    LONGLONG                m_cmpBytes;     // bytes of queued groups
+    bool                    m_cmpQuit;
+    std::mutex              m_cmpMutex;
+    std::condition_variable m_cmpDone;
 };
 
 
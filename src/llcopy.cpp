@@ -69,6 +69,10 @@ static const char sHelp[] =
 "   -X=<pathPat>,...    ; Exclude patterns  -X=*.lib,*.obj,*.exe\n"
 "                       ;  No space in patterns. Pattern applied against fullpath\n"
 "                       ;  So *\\ma will exclude a directory ma or file ma \n"
+"                       ;  Patterns ending in * also skip scanning below a matching directory\n"
+"   -Xp=<dirPat>,...    ; Prune, exclude and do not scan directories matching path pattern\n"
+"                       ;  ex -Xp=*\\.git,*\\node_modules \n"
+"   -Dp=<dirPat>,...    ; Prune, only scan directories whose name matches dirPat\n"
 "   -Z<op><value>       ; siZe op=(Greater|Less|Equal) value=num<units G|M|K>, ex -Zg100M \n"
 "  !0eMisc options:!0f\n"
 "   -B=c                ; Add additional field separators to use with #n selection\n"
@@ -49,6 +49,7 @@ static const char sHelp[] =
 "   -f                  ; Force delete even if destination is set to read only\n"
 "   -I=<infile>         ; Read filenames from infile or stdin if -\n"
 "   -j                  ; Follow junctions (default: skip junctions)\n"
+"   -J                  ; Parallel directory scan (-J=<threads>), -Ju unordered, -Jb batched\n"
 "   -n                  ; No delete, just echo command\n"
 "   -p                  ; Prompt before delete\n"
 "   -q                  ; Quiet, don't echo command (echo on by default)\n"
@@ -67,6 +68,10 @@ static const char sHelp[] =
 "   -X=<pathPat>,...    ; Exclude patterns  -X=*.lib,*.obj,*.exe\n"
 "                       ;  No space in patterns. Pattern applied against fullpath\n"
 "                       ;  So *\\ma will exclude a directory ma or file ma \n"
+"                       ;  Patterns ending in * also skip scanning below a matching directory\n"
+"   -Xp=<dirPat>,...    ; Prune, exclude and do not scan directories matching path pattern\n"
+"                       ;  ex -Xp=*\\.git,*\\node_modules \n"
+"   -Dp=<dirPat>,...    ; Prune, only scan directories whose name matches dirPat\n"
 "   -Z<op><value>       ; siZe op=(Greater|Less|Equal) value=num<units G|M|K>, ex -Zg100M \n"
 "   -1=<output>         ; Redirect output to file \n"
 "   -?                  ; Show this help\n"
@@ -102,13 +102,20 @@ static const char sHelp[] =
 "   -D                  ; Show only directories\n"
 "   -F                  ; Show only files\n"
 "   -i                  ; Show fileId (use with -L)\n"
+"   -J                  ; Parallel directory scan, output in same order (-J=<threads>)\n"
+"   -Ju                 ; Parallel directory scan, unordered output, use with -u or -U\n"
+"   -Jb                 ; Parallel directory scan on its own thread, entries passed in batches\n"
+"   -K                  ; Cache directory snapshot, reuse unchanged dirs (-K=<cacheDir>)\n"
+"                       ;   file sizes/times may be stale\n"
 "   -L                  ; Show hard link count and any Alternate Data Streams\n"
+"   -M=<megabytes>      ; Sort memory limit, spill sorted runs to %TEMP% (-Mt=<spillDir>)\n"
 "   -N or -n            ; Show just names, same as -h -s -tn -q\n"
 "   -p                  ; Show full file path\n"
 "   -P=<srcPathPat>     ; Optional regular expression pattern on source files full path\n"
 "   -q                  ; Quiet, dont show stats, no color\n"
-"   -Q=n                ; Quit after 'n' lines output\n"
-"   -S=[-][acmnenpst]   ; Sort on a=access,c=creation,m=modify time, e=ext, n=name, p=path, s=size or t=type. -=reverse\n"
+"   -Q=n                ; Quit after 'n' lines output, with -S only the top 'n' are kept\n"
+"   -S=[-][acdmenpst]   ; Sort on a=access,c=creation,m=modify time, e=ext, n=name, p=path, s=size or t=type. -=reverse\n"
+"                       ;  add d to compare digits in names by value, -S=dn sorts file9 before file10\n"
 "   -t=[acm]            ; Show Time a=access, c=creation, m=modified, n=none\n"
 "   -T=[acm]<op><value> ; Test Time a=access, c=creation, m=modified\n"
 "                       ; op=(Greater|Less|Equal)  Value= now|+/-num[d|h|m]|yyyy:mm:dd:hh:mm:ss \n"
@@ -123,6 +130,10 @@ static const char sHelp[] =
 "   -X=<pathPat>,...    ; Exclude patterns  -X=*.lib,*.obj,*.exe\n"
 "                       ;  No space in patterns. Pattern applied against fullpath\n"
 "                       ;  So *\\ma will exclude a directory ma or file ma \n"
+"                       ;  Patterns ending in * also skip scanning below a matching directory\n"
+"   -Xp=<dirPat>,...    ; Prune, exclude and do not scan directories matching path pattern\n"
+"                       ;  ex -Xp=*\\.git,*\\node_modules \n"
+"   -Dp=<dirPat>,...    ; Prune, only scan directories whose name matches dirPat\n"
 "   -Z<op><value>       ; siZe op=(Greater|Less|Equal) value=num<units G|M|K>, ex -Zg100M \n"
 "   -C=<colorOpt>       ; Set colors, colors are red,green,blue,intensity, add bg to end of color for background\n"
 "    -C=r<colors>       ;   readonly  ex -C=r+red+blue or -C=r+bluebg\n"
@@ -727,7 +738,8 @@ LLDir::LLDir()
         m_watchDir =
         m_showStream =
         m_setTime =
-        m_showSecurity = false;
+        m_showSecurity =
+        m_sortFiltered = false;
 
     m_showPath  = 0;
 
@@ -752,6 +764,19 @@ LLDir::LLDir()
         m_screenWidth = csbiInfo.dwMaximumWindowSize.X;
 }
 
+// ---------------------------------------------------------------------------
+// Sort with a quit limit (-S -Q=n), only entries which pass the filter are
+// offered to the limited LLDirSort so its first n rows are the ones shown.
+static int SortLimitCb(void* cbData,  const char* pDir,  const WIN32_FIND_DATA* pFileData,
+                int depth)      // 0...n is directory depth, -n end-of nth diretory
+{
+    LLDir* pDirBase = (LLDir*)cbData;
+
+    if (depth < 0 || !pDirBase->FilterDir(pDir, pFileData, depth))
+        return 0;
+    return LLDirSort::SortCb(&pDirBase->m_dirSort, pDir, pFileData, depth);
+}
+
 // ---------------------------------------------------------------------------
 static int InvertEntryCb(void* cbData,  const char* pDir,  const WIN32_FIND_DATA* pFileData,
                 int depth)      // 0...n is directory depth, -n end-of nth diretory
@@ -826,6 +851,7 @@ int LLDir::Run(const char* cmdOpts, int argc, const char* pDirs[])
 {
     const char optOutSepErrMsg[] = "Set output field separators, -=<string>";
     const char invertEmptyMsg[] = "Invalid inverted list syntax. Use -V=<pattern>[,<pattern> with no spaces\n";
+    const char sortMemMsg[] = "Sort memory limit, syntax -M=<megabytes> or -Mt=<spillDir>\n";
 
     // Initialize run stats
     m_totalSize = 0;
@@ -843,6 +869,8 @@ int LLDir::Run(const char* cmdOpts, int argc, const char* pDirs[])
     }
 
     bool sortNeedAllData = m_showSize;
+    uint sortMemMB = 0;
+    std::string sortSpillDir;
     LLDir::sConfig.m_numDateTime = false;
     LLDir::sConfig.m_refDateTime = true;
     EnableCommaCout();
@@ -957,6 +985,13 @@ int LLDir::Run(const char* cmdOpts, int argc, const char* pDirs[])
             m_dirSort.SetSortData(sortNeedAllData);
             break;
 
+        case 'M':   // Sort memory limit, -M=<megabytes>, -Mt=<spillDir>
+            if (cmdOpts[1] == 't')
+                cmdOpts = LLSup::ParseString(cmdOpts+2, sortSpillDir, sortMemMsg);
+            else
+                cmdOpts = LLSup::ParseNum(cmdOpts+1, sortMemMB, sortMemMsg);
+            break;
+
         case 'S':   // Sort options
             {
             if (m_dirScan.m_recurse == true)
@@ -980,6 +1015,9 @@ int LLDir::Run(const char* cmdOpts, int argc, const char* pDirs[])
                 case '+':
                     sortInc = true;
                     break;
+                case 'd':   // digits by value, natural order
+                    m_dirSort.SetNatural(true);
+                    break;
 
                 case 'e':   // extension
                 case 'n':   // name
@@ -1108,6 +1146,10 @@ int LLDir::Run(const char* cmdOpts, int argc, const char* pDirs[])
             LLDir::sConfig.m_refDateTime = !LLDir::sConfig.m_refDateTime;
             break;
 
+        case 'K':   // -K or -K=<cacheDir>
+            ParseDirCache(cmdOpts);
+            break;
+
         case '?':
             Colorize(std::cout, sHelp);
             if (cmdOpts[1] == '?')
@@ -1122,9 +1164,29 @@ int LLDir::Run(const char* cmdOpts, int argc, const char* pDirs[])
         LLSup::AdvCmd(cmdOpts);
     }
 
+    // Chmod acts on the files, do not select them from a stale snapshot.
+    if (m_chmod != 0 && m_dirScan.m_dirCache != NULL)
+    {
+        ErrorMsg() << "\n-K directory cache is not valid with -c chmod\n";
+        return sError;
+    }
+
     m_dirSort.SetSortAttr(m_onlyAttr);
+    if (sortMemMB != 0)
+        m_dirSort.SetSpill((size_t)sortMemMB << 20, sortSpillDir.c_str());
+
+    // Sorted and limited, keep just the top -Q=n entries while scanning.
+    if (m_limitOut != 0 && m_dirScan.m_add_cb == LLDirSort::SortCb && !m_showUsage)
+    {
+        m_dirSort.SetLimit(m_limitOut);
+        m_dirScan.m_add_cb  = SortLimitCb;
+        m_dirScan.m_cb_data = this;
+    }
     m_dirScan.m_filesFirst = m_dirScan.m_recurse && !m_showUsage;
 
+    // Fetch link count and fileId in parallel batches while scanning, unless sorting.
+    m_dirScan.m_prefetchInfo = m_showLink && m_dirScan.m_add_cb == EntryCb;
+
     // If just showing path, remove leading space.
     if (m_showPath && !m_showSize && !m_showAttr && !m_showAtime  && !m_showCtime && !m_showMtime)
         LLDir::sConfig.m_dirFieldSep = "";
@@ -1177,7 +1239,17 @@ int LLDir::Run(const char* cmdOpts, int argc, const char* pDirs[])
     }
 
     if (m_dirScan.m_add_cb != EntryCb && m_dirScan.m_add_cb != InvertEntryCb)
+    {
+        // Rows kept by SortLimitCb were filtered and counted while scanning.
+        m_sortFiltered = (m_dirScan.m_add_cb == SortLimitCb);
         m_dirSort.ShowSorted(EntryCb, this);
+        m_sortFiltered = false;
+        Arena::Stats stats = m_dirSort.NameArena().GetStats();
+        VerboseMsg() << "[SortArena] allocs=" << stats.allocs
+            << " large=" << stats.largeAllocs
+            << " peakBytes=" << stats.peakBytes
+            << " reservedBytes=" << stats.reservedBytes << std::endl;
+    }
 
     if ( !m_quiet)
     {
@@ -1548,7 +1620,9 @@ int LLDir::ProcessEntry(
     //      m_timeOp        Time, -T[acm]<op><value>  ; Test Time a=access, c=creation, m=modified\n
     //
     //  If pass, populate m_srcPath
-    if ( !FilterDir(pDir, pFileData, depth))
+    if (m_sortFiltered)
+        SetEntry(pDir, pFileData);
+    else if ( !FilterDir(pDir, pFileData, depth))
         return sIgnore;
      
 #if 0
@@ -1813,44 +1887,58 @@ int LLDir::ProcessEntry(
             fileId.QuadPart = 0;
 
             BY_HANDLE_FILE_INFORMATION ByHandleFileInformation;
-            // sprintf_s(m_srcPath, sizeof(m_srcPath), "%s\\%s", pDir, pFileData->cFileName);
-            Handle fileHnd =
-                CreateFile(m_srcPath, FILE_READ_ATTRIBUTES, 7, 0, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, 0);
-            if (fileHnd.IsValid())
+            const DirectoryScan::FileInfo* pFileInfo = m_dirScan.m_fileInfo;
+            if (pFileInfo != NULL)
+            {
+                // Prefetched by directory scan.
+                if (pFileInfo->valid)
+                {
+                    nLinks = pFileInfo->info.nNumberOfLinks;
+                    fileId.LowPart  = pFileInfo->info.nFileIndexLow;
+                    fileId.HighPart = pFileInfo->info.nFileIndexHigh;
+                }
+            }
+            else
             {
-                if (GetFileInformationByHandle(fileHnd, &ByHandleFileInformation))
+                // sprintf_s(m_srcPath, sizeof(m_srcPath), "%s\\%s", pDir, pFileData->cFileName);
+                Handle fileHnd =
+                    CreateFile(m_srcPath, FILE_READ_ATTRIBUTES, 7, 0, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, 0);
+                if (fileHnd.IsValid())
                 {
-                    nLinks = ByHandleFileInformation.nNumberOfLinks;
-                    fileId.LowPart  = ByHandleFileInformation.nFileIndexLow;
-                    fileId.HighPart = ByHandleFileInformation.nFileIndexHigh;
+                    if (GetFileInformationByHandle(fileHnd, &ByHandleFileInformation))
+                    {
+                        nLinks = ByHandleFileInformation.nNumberOfLinks;
+                        fileId.LowPart  = ByHandleFileInformation.nFileIndexLow;
+                        fileId.HighPart = ByHandleFileInformation.nFileIndexHigh;
 
 #ifdef VISTA
-                    FILE_ID_DESCRIPTOR fileIdDes;
-                    fileIdDes.dwSize = sizeof(fileId);
-                    fileIdDes.Type = FileIdType;
-                    fileIdDes.FileId = fileId;
-
-                    Handle linkHnd = OpenFileById(
-                        fileHnd,
-                        &fileIdDes,
-                        GENERIC_READ,
-                        7,
-                        0,
-                        0);
-
-                    FILE_NAME_INFO fileNameInfo;
-                    if (linkHnd.IsValid())
-                    {
-                        if (GetFileInformationByHandleEx(linkHnd, FileNameInfo,
-                            &fileNameInfo, sizeof(fileNameInfo)) != 0)
+                        FILE_ID_DESCRIPTOR fileIdDes;
+                        fileIdDes.dwSize = sizeof(fileId);
+                        fileIdDes.Type = FileIdType;
+                        fileIdDes.FileId = fileId;
+
+                        Handle linkHnd = OpenFileById(
+                            fileHnd,
+                            &fileIdDes,
+                            GENERIC_READ,
+                            7,
+                            0,
+                            0);
+
+                        FILE_NAME_INFO fileNameInfo;
+                        if (linkHnd.IsValid())
                         {
-                            cout << "-H->" << fileNameInfo.FileName << " ";
+                            if (GetFileInformationByHandleEx(linkHnd, FileNameInfo,
+                                &fileNameInfo, sizeof(fileNameInfo)) != 0)
+                            {
+                                cout << "-H->" << fileNameInfo.FileName << " ";
+                            }
+                            // CloseHandle(linkHnd);
                         }
-                        // CloseHandle(linkHnd);
-                    }
 #endif
+                    }
+                    // CloseHandle(fileHnd);
                 }
-                // CloseHandle(fileHnd);
             }
 
             LLMsg::Out() << std::setw(3) << nLinks << LLDir::sConfig.m_dirFieldSep;
@@ -131,6 +131,7 @@ protected:
     bool        m_showStream;       // show alternate data stream;
     bool        m_setTime;       // touch file and set access & modify times.
     bool        m_showSecurity;
+    bool        m_sortFiltered;     // sorted rows passed FilterDir in SortLimitCb
 
     unsigned    m_showPath;         // show full file path
 
@@ -145,7 +146,7 @@ protected:
     FILETIME    m_setUtcTime;
 
 public:
-    LLSup::StringList   m_invertedList;      // -V=<pathPat>[,<pathPat>
+    LLSup::PatternList  m_invertedList;      // -V=<pathPat>[,<pathPat>
 
 private:
     void ShowHeader(const char* pDir, const WIN32_FIND_DATA* pFileData);
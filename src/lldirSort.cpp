@@ -30,373 +30,469 @@
 
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
 #include "lldirSort.h"
+#include "ParallelSort.h"
 #include "llsupport.h"
+#include "llmsg.h"
 
 
-LLPool<const char> LLString::m_pool;
-
-int (*CompareData)(const LLDirEntry* pDirLeft, const LLDirEntry* pDirRight) = 0;
 
 // ---------------------------------------------------------------------------
-void FillEntryName(LLDirEntry& dirEntry, const WIN32_FIND_DATA& findData, const LLDirSort& dirSort)
+inline FILETIME ToFileTime(ULONGLONG value)
 {
-    dirEntry.lvalue[0].ft = findData.ftCreationTime;
-    dirEntry.lvalue[1].ft = findData.ftLastAccessTime;
-    dirEntry.lvalue[2].ft = findData.ftLastWriteTime;
-    dirEntry.lvalue[3].li.HighPart = findData.nFileSizeHigh;
-    dirEntry.lvalue[3].li.LowPart = findData.nFileSizeLow;
+    FILETIME fileTime;
+    fileTime.dwLowDateTime  = (DWORD)value;
+    fileTime.dwHighDateTime = (DWORD)(value >> 32);
+    return fileTime;
 }
 
 // ---------------------------------------------------------------------------
-void FillFindDataName(WIN32_FIND_DATA& findData, const LLDirEntry& dirEntry, const LLDirSort& dirSort)
+// Names without an extension sort before names with one.
+static int CompareExt(const LLDirSort::SortKey& left, const LLDirSort::SortKey& right)
 {
-    findData.ftCreationTime   = dirEntry.lvalue[0].ft;
-    findData.ftLastAccessTime = dirEntry.lvalue[1].ft;
-    findData.ftLastWriteTime  = dirEntry.lvalue[2].ft;
-    findData.nFileSizeHigh    = dirEntry.lvalue[3].li.HighPart;
-    findData.nFileSizeLow     = dirEntry.lvalue[3].li.LowPart;
+    if (left.extOff == LLDirSort::sNoExt || right.extOff == LLDirSort::sNoExt)
+    {
+        if (left.extOff != right.extOff)
+            return (left.extOff == LLDirSort::sNoExt) ? -1 : 1;
+        return LLDirSort::CompareKeys(left, right);
+    }
+    int diffExt = strcmp(left.key + left.extOff, right.key + right.extOff);
+    return diffExt ? diffExt : LLDirSort::CompareKeys(left, right);
 }
 
 // ---------------------------------------------------------------------------
-int CompareDataExtInc(const LLDirEntry* pDirLeft, const LLDirEntry* pDirRight)
+// Increasing order of two entries for the comparison sorts, 0 if equal.
+static int CompareEntries(LLDirSort::SortBy sortBy,
+        const LLDirSort::SortKey& left, DWORD leftAttr, const LLDirSort::SortKey& right, DWORD rightAttr)
 {
-    const char* pLeftExt = strrchr(pDirLeft->filenameLStr, '.');
-    const char* pRightExt = strrchr(pDirRight->filenameLStr, '.');
-    if (pLeftExt == 0 || pRightExt == 0)
-        return (int)((size_t)pLeftExt & 0x8fff) - (int)((size_t)pRightExt & 0x8fff);
-    int diffExt = _stricmp(pLeftExt, pRightExt);
-    return diffExt ? diffExt : _stricmp(pDirLeft->filenameLStr, pDirRight->filenameLStr);
+    switch (sortBy)
+    {
+    case LLDirSort::eSortExt:
+        return CompareExt(left, right);
+    case LLDirSort::eSortType:
+        if (leftAttr != rightAttr)
+            return (leftAttr < rightAttr) ? -1 : 1;
+        break;
+    default:
+        break;
+    }
+    // Path sort compares the name, same as before the column store.
+    return LLDirSort::CompareKeys(left, right);
 }
 
 // ---------------------------------------------------------------------------
-int CompareDataExtDec(const LLDirEntry* pDirLeft, const LLDirEntry* pDirRight)
+// Increasing order of two rows for the comparison sorts.
+struct RowLess
 {
-    return -CompareDataExtInc(pDirLeft, pDirRight);
-}
+    RowLess(const LLDirSort& dirSort, LLDirSort::SortBy sortBy) :
+        m_dirSort(dirSort), m_sortBy(sortBy)
+    { }
+
+    bool operator()(unsigned left, unsigned right) const
+    {
+        return CompareEntries(m_sortBy,
+            m_dirSort.Key(left), m_dirSort.Attributes(left),
+            m_dirSort.Key(right), m_dirSort.Attributes(right)) < 0;
+    }
+
+    const LLDirSort&    m_dirSort;
+    LLDirSort::SortBy   m_sortBy;
+};
 
 // ---------------------------------------------------------------------------
-int CompareDataNameInc(const LLDirEntry* pDirLeft, const LLDirEntry* pDirRight)
+// Heap order for the limited rows, the top is the row shown last.
+struct HeapLess
 {
-    return _stricmp(pDirLeft->filenameLStr, pDirRight->filenameLStr);
-}
+    HeapLess(const LLDirSort& dirSort) : m_dirSort(dirSort)
+    { }
+
+    bool operator()(unsigned left, unsigned right) const
+    { return m_dirSort.RowBefore(left, right); }
+
+    const LLDirSort&    m_dirSort;
+};
 
 // ---------------------------------------------------------------------------
-int CompareDataNameDec(const LLDirEntry* pDirLeft, const LLDirEntry* pDirRight)
+// One entry of a spilled run, rows still in memory are copied to one to merge.
+//  Run file record:
+//      ULONGLONG seq, DWORD attributes, ULONGLONG values (kept ones only),
+//      WORD nameLen, DWORD dirLen, name, dir
+struct SortRecord
 {
-    return -CompareDataNameInc(pDirLeft, pDirRight);
-}
+    ULONGLONG   seq;        // scan order
+    DWORD       attributes;
+    ULONGLONG   values[LLDirSort::eValueCnt];
+    std::string name;
+    std::string dir;
+    std::string keyText;    // key built from a run file name
+    LLDirSort::SortKey key;
+};
 
 // ---------------------------------------------------------------------------
-int CompareDataPathInc(const LLDirEntry* pDirLeft, const LLDirEntry* pDirRight)
+// Heap order for the merge, the top is the record shown next.
+struct RecordAfter
 {
-    // int dirCmp = _stricmp(pDirLeft->szDir, pDirRight->szDir);
-    // return (dirCmp == 0) ? _stricmp(pDirLeft->filenameLStr, pDirRight->filenameLStr) : dirCmp;
-    return _stricmp(pDirLeft->filenameLStr, pDirRight->filenameLStr);
-}
+    RecordAfter(const LLDirSort& dirSort, const std::vector<SortRecord>& records) :
+        m_dirSort(dirSort), m_records(records)
+    { }
+
+    bool operator()(unsigned left, unsigned right) const
+    { return m_dirSort.RecordBefore(m_records[right], m_records[left]); }
+
+    const LLDirSort&                m_dirSort;
+    const std::vector<SortRecord>&  m_records;
+};
 
 // ---------------------------------------------------------------------------
-int CompareDataPathDec(const LLDirEntry* pDirLeft, const LLDirEntry* pDirRight)
+template <typename TT>
+static bool WriteValue(FILE* fout, const TT& value)
 {
-    return -CompareDataPathInc(pDirLeft, pDirRight);
+    return fwrite(&value, sizeof(value), 1, fout) == 1;
 }
 
 // ---------------------------------------------------------------------------
-int CompareDataTypeInc(const LLDirEntry* pDirLeft, const LLDirEntry* pDirRight)
+template <typename TT>
+static bool ReadValue(FILE* fin, TT& value)
 {
-    int attCmp = pDirLeft->dwFileAttributes - pDirRight->dwFileAttributes;
-    return (attCmp == 0) ? CompareDataNameInc(pDirLeft, pDirRight) : attCmp;
+    return fread(&value, sizeof(value), 1, fin) == 1;
 }
 
 // ---------------------------------------------------------------------------
-int CompareDataTypeDec(const LLDirEntry* pDirLeft, const LLDirEntry* pDirRight)
+LLDirSort::LLDirSort() :
+    m_count(0),
+    m_baseDirLen(0),
+    m_onlyAttr(DWORD(-1)),
+    m_sortBy(eSortName),
+    m_sortValue(eMtime),
+    m_sortIncreasing(true),
+    m_sorted(false),
+    m_natural(false),
+    m_limit(0),
+    m_nameBytes(0),
+    m_compactDirs(0),
+    m_spillLimit(0),
+    m_firstSeq(0),
+    m_nameMark(m_nameArena.GetMark()),
+    m_dirPathId(DirTable::sNoDir)
 {
-    return -CompareDataTypeInc(pDirLeft, pDirRight);
+    for (unsigned valIdx = 0; valIdx != eValueCnt; valIdx++)
+        m_keepValue[valIdx] = false;
 }
 
-
 // ---------------------------------------------------------------------------
-void FillEntryAtime(LLDirEntry& dirEntry, const WIN32_FIND_DATA& findData, const LLDirSort& dirSort)
+int LLDirSort::SortCb(
+        void* cbData,
+        const char* pDir,
+        const WIN32_FIND_DATA* pFileData,
+        int depth)
 {
-    // Sort on value[0], set to accessTime
-    dirEntry.lvalue[0].ft = findData.ftLastAccessTime;
+    LLDirSort* pDirSort = (LLDirSort*)cbData;
 
-    // Also copy non-sort fields
-    assert(dirSort.m_values == 0 || dirSort.m_values == 4);
-    if (dirSort.m_values == 4)
+    if (depth < 0)
+        return 0;     // ignore end-of-directory
+
+    if ((pFileData->dwFileAttributes & pDirSort->m_onlyAttr) != 0)
     {
-        dirEntry.lvalue[1].ft = findData.ftCreationTime;
-        dirEntry.lvalue[2].ft = findData.ftLastWriteTime;
-        dirEntry.lvalue[3].li.HighPart = findData.nFileSizeHigh;
-        dirEntry.lvalue[3].li.LowPart  = findData.nFileSizeLow;
+        FileEntry entry;
+        ToFileEntry(*pFileData, entry);
+        pDirSort->AddRow(pDir, entry);
     }
+
+    return 1;
 }
 
 // ---------------------------------------------------------------------------
-void FillFindDataAtime(WIN32_FIND_DATA& findData, const LLDirEntry& dirEntry, const LLDirSort& dirSort)
+void LLDirSort::AddRow(const char* pDir, const FileEntry& entry)
 {
-    findData.ftLastAccessTime = dirEntry.lvalue[0].ft;
-
-    assert(dirSort.m_values == 0 || dirSort.m_values == 4);
-    if (dirSort.m_values == 4)
+    // Consecutive entries of a directory share its dir id.
+    unsigned dirId = m_dirTable.Add(pDir);
+    if (m_dirRefs.empty() || m_dirRefs.back().dirId != dirId || m_dirRefs.back().baseDirLen != m_baseDirLen)
     {
-        findData.ftCreationTime   = dirEntry.lvalue[1].ft;
-        findData.ftLastWriteTime  = dirEntry.lvalue[2].ft;
-        findData.nFileSizeHigh    = dirEntry.lvalue[3].li.HighPart;
-        findData.nFileSizeLow     = dirEntry.lvalue[3].li.LowPart;
+        DirRef dirRef = { dirId, m_baseDirLen };
+        m_dirRefs.push_back(dirRef);
     }
+
+    m_nameMark = m_nameArena.GetMark();
+    SortKey sortKey;
+    m_namePtrs.push_back(AddName(entry.name, sortKey));
+    m_keys.push_back(sortKey);
+    m_dirIds.push_back((unsigned)m_dirRefs.size() - 1);
+    m_attributes.push_back(entry.attributes);
+
+    if (m_keepValue[eCtime])
+        m_values[eCtime].push_back(entry.ctime);
+    if (m_keepValue[eAtime])
+        m_values[eAtime].push_back(entry.atime);
+    if (m_keepValue[eMtime])
+        m_values[eMtime].push_back(entry.mtime);
+    if (m_keepValue[eSize])
+        m_values[eSize].push_back(entry.size);
+
+    if (m_limit != 0)
+        m_seqs.push_back(m_firstSeq++);
+
+    m_nameBytes += NameBytes((unsigned)m_count);
+    m_count++;
+    m_sorted = false;
+
+    if (m_limit != 0)
+        LimitRows();
+    else if (m_spillLimit != 0 && RowBytes() > m_spillLimit && !SpillRun())
+        m_spillLimit = 0;   // keep the rest in memory
 }
 
 // ---------------------------------------------------------------------------
-void FillEntryCtime(LLDirEntry& dirEntry, const WIN32_FIND_DATA& findData, const LLDirSort& dirSort)
+// Keep the first m_limit rows of the sorted order. The row just added
+// joins the heap, replaces the heap top or is dropped.
+void LLDirSort::LimitRows()
 {
-    // Sort on value[0], set to creationTime
-    dirEntry.lvalue[0].ft = findData.ftCreationTime;
-
-    // Also copy non-sort fields
-    assert(dirSort.m_values == 0 || dirSort.m_values == 4);
-    if (dirSort.m_values == 4)
+    unsigned newRow = (unsigned)m_count - 1;
+    if (m_count <= m_limit)
     {
-        dirEntry.lvalue[1].ft = findData.ftLastWriteTime;
-        dirEntry.lvalue[2].ft = findData.ftLastAccessTime;
-        dirEntry.lvalue[3].li.HighPart = findData.nFileSizeHigh;
-        dirEntry.lvalue[3].li.LowPart  = findData.nFileSizeLow;
+        m_heap.push_back(newRow);
+        std::push_heap(m_heap.begin(), m_heap.end(), HeapLess(*this));
+        return;
     }
-}
-
-// ---------------------------------------------------------------------------
-void FillFindDataCtime(WIN32_FIND_DATA& findData, const LLDirEntry& dirEntry, const LLDirSort& dirSort)
-{
-    findData.ftCreationTime = dirEntry.lvalue[0].ft;
 
-    assert(dirSort.m_values == 0 || dirSort.m_values == 4);
-    if (dirSort.m_values == 4)
+    unsigned lastRow = m_heap.front();
+    if (RowBefore(newRow, lastRow))
     {
-        findData.ftLastWriteTime  = dirEntry.lvalue[1].ft;
-        findData.ftLastAccessTime = dirEntry.lvalue[2].ft;
-        findData.nFileSizeHigh    = dirEntry.lvalue[3].li.HighPart;
-        findData.nFileSizeLow     = dirEntry.lvalue[3].li.LowPart;
+        std::pop_heap(m_heap.begin(), m_heap.end(), HeapLess(*this));
+        m_nameBytes -= NameBytes(lastRow);
+        MoveRow(lastRow, newRow);
+        std::push_heap(m_heap.begin(), m_heap.end(), HeapLess(*this));
     }
+    else
+    {
+        m_nameBytes -= NameBytes(newRow);
+        m_nameArena.Rewind(m_nameMark);
+    }
+    PopRow();
+
+    // Names of replaced rows and dirs no longer used are only freed here.
+    if (m_nameArena.GetStats().usedBytes > 2 * m_nameBytes + 64 * 1024 || m_dirRefs.size() > 2 * m_limit + 64
+        || m_dirTable.Size() > 2 * m_compactDirs + 256)
+        CompactRows();
 }
 
 // ---------------------------------------------------------------------------
-void FillEntryMtime(LLDirEntry& dirEntry, const WIN32_FIND_DATA& findData, const LLDirSort& dirSort)
+// Remove last row, its name is left in m_nameArena.
+void LLDirSort::PopRow()
 {
-    // Sort on value[0], set to writeTime
-    dirEntry.lvalue[0].ft = findData.ftLastWriteTime;
-
-    // Also copy non-sort fields
-    assert(dirSort.m_values == 0 || dirSort.m_values == 4);
-    if (dirSort.m_values == 4)
+    m_namePtrs.pop_back();
+    m_keys.pop_back();
+    m_dirIds.pop_back();
+    m_attributes.pop_back();
+    if ( !m_seqs.empty())
+        m_seqs.pop_back();
+    for (unsigned valIdx = 0; valIdx != eValueCnt; valIdx++)
     {
-        dirEntry.lvalue[1].ft = findData.ftCreationTime;
-        dirEntry.lvalue[2].ft = findData.ftLastAccessTime;
-        dirEntry.lvalue[3].li.HighPart = findData.nFileSizeHigh;
-        dirEntry.lvalue[3].li.LowPart = findData.nFileSizeLow;
+        if (m_keepValue[valIdx])
+            m_values[valIdx].pop_back();
     }
+    m_count--;
 }
 
 // ---------------------------------------------------------------------------
-void FillFindDataMtime(WIN32_FIND_DATA& findData, const LLDirEntry& dirEntry, const LLDirSort& dirSort)
+void LLDirSort::MoveRow(unsigned toRow, unsigned fromRow)
 {
-    findData.ftLastWriteTime = dirEntry.lvalue[0].ft;
-
-    assert(dirSort.m_values == 0 || dirSort.m_values == 4);
-    if (dirSort.m_values == 4)
+    m_namePtrs[toRow]   = m_namePtrs[fromRow];
+    m_keys[toRow]       = m_keys[fromRow];
+    m_dirIds[toRow]     = m_dirIds[fromRow];
+    m_attributes[toRow] = m_attributes[fromRow];
+    if ( !m_seqs.empty())
+        m_seqs[toRow] = m_seqs[fromRow];
+    for (unsigned valIdx = 0; valIdx != eValueCnt; valIdx++)
     {
-        findData.ftCreationTime   = dirEntry.lvalue[1].ft;
-        findData.ftLastAccessTime = dirEntry.lvalue[2].ft;
-        findData.nFileSizeHigh    = dirEntry.lvalue[3].li.HighPart;
-        findData.nFileSizeLow     = dirEntry.lvalue[3].li.LowPart;
+        if (m_keepValue[valIdx])
+            m_values[valIdx][toRow] = m_values[valIdx][fromRow];
     }
 }
 
 // ---------------------------------------------------------------------------
-int CompareDataFtimeInc(const LLDirEntry* pDirLeft, const LLDirEntry* pDirRight)
+// Copy name and its key to m_nameArena, return the name.
+const char* LLDirSort::AddName(const char* name, SortKey& sortKey)
 {
-    int tmDiff =  CompareFileTime(&pDirLeft->lvalue[0].ft, &pDirRight->lvalue[0].ft);
-    return (tmDiff == 0) ? CompareDataNameInc(pDirLeft, pDirRight) : tmDiff;
+    MakeSortKey(name, m_natural, m_keyText, sortKey);
+    sortKey.key = m_nameArena.StrDup(m_keyText.c_str(), m_keyText.length());
+    return m_nameArena.StrDup(name);
 }
 
 // ---------------------------------------------------------------------------
-int CompareDataFtimeDec(const LLDirEntry* pDirLeft, const LLDirEntry* pDirRight)
+// Bytes of m_nameArena used by the name and key of row.
+size_t LLDirSort::NameBytes(unsigned row) const
 {
-    return -CompareDataFtimeInc(pDirLeft, pDirRight);
+    return strlen(Name(row)) + strlen(m_keys[row].key) + 2;
 }
 
 // ---------------------------------------------------------------------------
-void FillEntrySize(LLDirEntry& dirEntry, const WIN32_FIND_DATA& findData, const LLDirSort& dirSort)
+void LLDirSort::MakeSortKey(const char* name, bool natural, std::string& keyText, SortKey& sortKey)
 {
-    // Sort on value[0], set to file size.
-    dirEntry.lvalue[0].li.HighPart = findData.nFileSizeHigh;
-    dirEntry.lvalue[0].li.LowPart = findData.nFileSizeLow;
-
-    // Also copy non-sort fields
-    assert(dirSort.m_values == 4);
-    if (dirSort.m_values == 4)
+    keyText.clear();
+    sortKey.extOff = sNoExt;
+    for (const char* pName = name; *pName != '\0'; )
     {
-        dirEntry.lvalue[1].ft = findData.ftCreationTime;
-        dirEntry.lvalue[2].ft = findData.ftLastAccessTime;
-        dirEntry.lvalue[3].ft = findData.ftLastWriteTime;
-    }
-}
+        char chr = *pName;
+        if (natural && chr >= '0' && chr <= '9')
+        {
+            while (*pName == '0' && pName[1] >= '0' && pName[1] <= '9')
+                pName++;    // leading zeros
+            size_t digitCnt = 0;
+            while (pName[digitCnt] >= '0' && pName[digitCnt] <= '9' && digitCnt != 255)
+                digitCnt++;
+            keyText += '0';
+            keyText += (char)digitCnt;
+            keyText.append(pName, digitCnt);
+            pName += digitCnt;
+            continue;
+        }
 
-// ---------------------------------------------------------------------------
-void FillFindDataSize(WIN32_FIND_DATA& findData, const LLDirEntry& dirEntry, const LLDirSort& dirSort)
-{
-    findData.nFileSizeHigh = dirEntry.lvalue[0].li.HighPart;
-    findData.nFileSizeLow = dirEntry.lvalue[0].li.LowPart;
+        if (chr == '.')
+            sortKey.extOff = (unsigned)keyText.length();
+        // Same folding as _stricmp in the "C" locale.
+        keyText += (chr >= 'A' && chr <= 'Z') ? (char)(chr - 'A' + 'a') : chr;
+        pName++;
+    }
 
-    assert(dirSort.m_values == 4);
-    if (dirSort.m_values == 4)
+    sortKey.key = keyText.c_str();
+    sortKey.prefix = 0;
+    for (size_t idx = 0; idx != sizeof(sortKey.prefix); idx++)
     {
-        findData.ftCreationTime   = dirEntry.lvalue[1].ft;
-        findData.ftLastAccessTime = dirEntry.lvalue[2].ft;
-        findData.ftLastWriteTime  = dirEntry.lvalue[3].ft;
+        BYTE keyByte = (idx < keyText.length()) ? (BYTE)keyText[idx] : 0;
+        sortKey.prefix = (sortKey.prefix << 8) | keyByte;
     }
 }
 
 // ---------------------------------------------------------------------------
-int CompareDataSizeInc(const LLDirEntry* pDirLeft, const LLDirEntry* pDirRight)
+int LLDirSort::CompareKeys(const SortKey& left, const SortKey& right)
 {
-    if (pDirLeft->lvalue[0].li.QuadPart >  pDirRight->lvalue[0].li.QuadPart)
-        return 1;
-    if (pDirLeft->lvalue[0].li.QuadPart ==  pDirRight->lvalue[0].li.QuadPart)
-        return CompareDataNameInc(pDirLeft, pDirRight);
-    return -1;
+    if (left.prefix != right.prefix)
+        return (left.prefix < right.prefix) ? -1 : 1;
+    if ((left.prefix & 0xff) == 0)
+        return 0;       // both keys end in the prefix
+    return strcmp(left.key + sizeof(left.prefix), right.key + sizeof(right.prefix));
 }
 
 // ---------------------------------------------------------------------------
-int CompareDataSizeDec(const LLDirEntry* pDirLeft, const LLDirEntry* pDirRight)
+// Rebuild m_nameArena, m_dirRefs and m_dirTable with only what the rows use. The
+// current (last) dir stays last so AddRow keeps sharing its dir ref.
+void LLDirSort::CompactRows()
 {
-    return -CompareDataSizeInc(pDirLeft, pDirRight);
-}
+    Arena names;
+    const unsigned sUnused = unsigned(-1);
+    std::vector<unsigned> refMap(m_dirRefs.size(), sUnused);
+    unsigned lastRef = (unsigned)m_dirRefs.size() - 1;
 
-// ---------------------------------------------------------------------------
-LLDirEntry::LLDirEntry(
-        const char* fileName,
-        const char* dir,
-        int baseDirLength,
-        const WIN32_FIND_DATA& findData,
-        FillEntryData_t fillEntryData,
-        LLDirSort& dirSort) :
-    pPrev(dirSort.m_pLast),
-    pNext(0),
-    filenameLStr(fileName),
-    szDir(dir),
-    baseDirLen(baseDirLength),
-    dwFileAttributes(findData.dwFileAttributes)
-{
-    if ((findData.dwFileAttributes & dirSort.m_onlyAttr) == 0)
-        return;
+    for (unsigned row = 0; row != m_count; row++)
+    {
+        m_namePtrs[row] = names.StrDup(Name(row));
+        m_keys[row].key = names.StrDup(m_keys[row].key);
+        refMap[m_dirIds[row]] = 0;
+    }
 
-        _CrtCheckMemory( );
-    fillEntryData(*this, findData, dirSort);
-        _CrtCheckMemory( );
+    refMap[lastRef] = sUnused;
+    std::vector<unsigned> keepRefs;
+    for (unsigned refIdx = 0; refIdx != lastRef; refIdx++)
+    {
+        if (refMap[refIdx] != sUnused)
+            keepRefs.push_back(refIdx);
+    }
+    keepRefs.push_back(lastRef);
 
-    if (dirSort.m_pFirst == NULL)
-        dirSort.m_pFirst = dirSort.m_pLast = this;
-    else
+    DirTable dirTable;
+    std::vector<DirRef> dirRefs;
+    std::string path;
+    for (unsigned keepIdx = 0; keepIdx != keepRefs.size(); keepIdx++)
     {
-        // Insertion sort
-        //   1. If less then first, replace first
-        //   2. If greater then last, replace last
-        //   3. Scan list using cloest starting point (first or last)
-        int dFirst = CompareData(this, dirSort.m_pFirst);
-        if (dFirst <= 0)
-        {
-            // Replace first
-            pNext = dirSort.m_pFirst;
-            dirSort.m_pFirst->pPrev = this;
-            dirSort.m_pFirst = this;
-            return;
-        }
+        DirRef dirRef = m_dirRefs[keepRefs[keepIdx]];
+        dirRef.dirId = dirTable.Add(m_dirTable.GetPath(dirRef.dirId, path));
+        refMap[keepRefs[keepIdx]] = keepIdx;
+        dirRefs.push_back(dirRef);
+    }
 
-        int dLast  = CompareData(dirSort.m_pLast, this);
-        if (dLast <= 0)
-        {
-            // Replace Last
-            pPrev = dirSort.m_pLast;
-            dirSort.m_pLast->pNext = this;
-            dirSort.m_pLast = this;
-            return;
-        }
+    for (unsigned row = 0; row != m_count; row++)
+        m_dirIds[row] = refMap[m_dirIds[row]];
 
-        if (dFirst < dLast)
-        {
-            LLDirEntry* pDirEntry = dirSort.m_pFirst;
-            while (pDirEntry->pNext)
-            {
-                pDirEntry = pDirEntry->pNext;
-                if (CompareData(pDirEntry, this) >= 0)
-                {
-                    pNext = pDirEntry;
-                    pPrev = pDirEntry->pPrev;
-                    pDirEntry->pPrev = this;
-                    if (pPrev)
-                        pPrev->pNext = this;
-                    return;
-                }
-            }
-        }
-        else
-        {
-            LLDirEntry* pDirEntry = dirSort.m_pLast;
-            while (pDirEntry->pPrev)
-            {
-                pDirEntry = pDirEntry->pPrev;
-                if (CompareData(pDirEntry, this) <= 0)
-                {
-                    pPrev = pDirEntry;
-                    pNext = pDirEntry->pNext;
-                    pDirEntry->pNext = this;
-                    if (pNext)
-                        pNext->pPrev = this;
-                    return;
-                }
-            }
-        }
-    }
+    m_nameArena.Swap(names);
+    m_nameMark = m_nameArena.GetMark();
+    m_dirRefs.swap(dirRefs);
+    m_dirTable.Swap(dirTable);
+    m_compactDirs = m_dirTable.Size();
+    m_dirPathId = DirTable::sNoDir;
 }
 
 // ---------------------------------------------------------------------------
-int LLDirSort::SortCb(
-        void* cbData,
-        const char* pDir,
-        const WIN32_FIND_DATA* pFileData,
-        int depth)
+bool LLDirSort::RowBefore(unsigned left, unsigned right) const
 {
-    static LLString commonDir(pDir);
-    LLDirSort* pDirSort = (LLDirSort*)cbData;
-
-    if (depth < 0)
-        return 0;     // ignore end-of-directory
+    int diff;
+    if (m_sortBy == eSortValue && m_values[m_sortValue][left] != m_values[m_sortValue][right])
+        diff = (m_values[m_sortValue][left] < m_values[m_sortValue][right]) ? -1 : 1;
+    else
+        diff = CompareEntries((m_sortBy == eSortValue) ? eSortName : m_sortBy,
+            m_keys[left], Attributes(left), m_keys[right], Attributes(right));
 
-    if (strcmp(pDir, commonDir) != 0)
+    // Equal entries keep their scan order, reversed when decreasing like Sort.
+    if (diff == 0)
     {
-        commonDir = LLString(pDir);
+        ULONGLONG leftSeq  = m_seqs.empty() ? left  : m_seqs[left];
+        ULONGLONG rightSeq = m_seqs.empty() ? right : m_seqs[right];
+        diff = (leftSeq < rightSeq) ? -1 : 1;
     }
+    return m_sortIncreasing ? (diff < 0) : (diff > 0);
+}
 
-    LLDirEntry* pDirEntry = NULL;
-    try
-    {
-		if ((pFileData->dwFileAttributes & pDirSort->m_onlyAttr) != 0)
-		{
-			_CrtCheckMemory( );
-			// Create dir entry (adds string to pool, and dir to link list.
-			pDirEntry = new (pDirSort->m_pool, pDirSort->m_ourSize)
-				LLDirEntry(pFileData->cFileName, commonDir, pDirSort->m_baseDirLen, *pFileData,
-				pDirSort->m_fillEntryData, *pDirSort);
-			pDirSort->m_count++;
-			_CrtCheckMemory( );
-		}
-    }
-    catch (...)
+// ---------------------------------------------------------------------------
+const char* LLDirSort::Dir(unsigned row) const
+{
+    unsigned dirId = DirId(row);
+    if (dirId != m_dirPathId)
     {
-        delete pDirEntry;
+        m_dirTable.GetPath(dirId, m_dirPath);
+        m_dirPathId = dirId;
     }
+    return m_dirPath.c_str();
+}
 
-    return 1;
+// ---------------------------------------------------------------------------
+void LLDirSort::GetFindData(unsigned row, WIN32_FIND_DATA& findData) const
+{
+    findData.dwFileAttributes = m_attributes[row];
+
+    ULONGLONG value = m_keepValue[eCtime] ? m_values[eCtime][row] : 0;
+    findData.ftCreationTime = ToFileTime(value);
+    value = m_keepValue[eAtime] ? m_values[eAtime][row] : 0;
+    findData.ftLastAccessTime = ToFileTime(value);
+    value = m_keepValue[eMtime] ? m_values[eMtime][row] : 0;
+    findData.ftLastWriteTime = ToFileTime(value);
+    value = m_keepValue[eSize] ? m_values[eSize][row] : 0;
+    findData.nFileSizeHigh = (DWORD)(value >> 32);
+    findData.nFileSizeLow  = (DWORD)value;
+}
+
+// ---------------------------------------------------------------------------
+// Fill entry of a row or run record, name is a view.
+static void SetEntry(const char* name, DWORD attributes, const ULONGLONG* values, FileEntry& entry)
+{
+    entry.name = name;
+    entry.nameLen = (uint16_t)strlen(name);
+    entry.type = (attributes & FILE_ATTRIBUTE_DIRECTORY) ? FileEntry::eDir : FileEntry::eFile;
+    entry.attributes = attributes;
+    entry.reparseTag = 0;
+    entry.ctime = values[LLDirSort::eCtime];
+    entry.atime = values[LLDirSort::eAtime];
+    entry.mtime = values[LLDirSort::eMtime];
+    entry.size  = values[LLDirSort::eSize];
+    entry.fileId = 0;
+}
+
+// ---------------------------------------------------------------------------
+void LLDirSort::GetEntry(unsigned row, FileEntry& entry) const
+{
+    ULONGLONG values[eValueCnt];
+    for (unsigned valIdx = 0; valIdx != eValueCnt; valIdx++)
+        values[valIdx] = m_keepValue[valIdx] ? m_values[valIdx][row] : 0;
+    SetEntry(Name(row), m_attributes[row], values, entry);
 }
 
 // ---------------------------------------------------------------------------
@@ -406,7 +502,8 @@ void LLDirSort::SetSort(
         bool needAllData,
         bool sortIncreasing)
 {
-    m_values = -1;
+    m_sortBy = eSortName;
+    m_sortIncreasing = sortIncreasing;
 
     for (; sortOpt && *sortOpt; sortOpt++)
     {
@@ -414,88 +511,61 @@ void LLDirSort::SetSort(
         {
         case 'a':
             // Sort access time
-            m_values = needAllData ? 4 : 1;
-            m_fillFindData  = FillFindDataAtime;
-            m_fillEntryData = FillEntryAtime;
-            CompareData     = sortIncreasing ? CompareDataFtimeInc : CompareDataFtimeDec;
+            m_sortBy = eSortValue;
+            m_sortValue = eAtime;
             break;
         case 'c':
             // Sort creation time
-            m_values = needAllData ? 4 : 1;
-            m_fillFindData  = FillFindDataCtime;
-            m_fillEntryData = FillEntryCtime;
-            CompareData     = sortIncreasing ? CompareDataFtimeInc : CompareDataFtimeDec;
+            m_sortBy = eSortValue;
+            m_sortValue = eCtime;
             break;
         case 'm':
             // Sort modify time
-            m_values = needAllData ? 4 : 1;
-            m_fillFindData  = FillFindDataMtime;
-            m_fillEntryData = FillEntryMtime;
-            CompareData     = sortIncreasing ? CompareDataFtimeInc : CompareDataFtimeDec;
+            m_sortBy = eSortValue;
+            m_sortValue = eMtime;
             break;
         case 's':
             // Sort size
-            m_values = needAllData ? 4 : 1;
-            m_fillFindData  = FillFindDataSize;
-            m_fillEntryData = FillEntrySize;
-            CompareData     = sortIncreasing ? CompareDataSizeInc : CompareDataSizeDec;
+            m_sortBy = eSortValue;
+            m_sortValue = eSize;
             break;
         case 'n':
         default:
             // Sort fileName
-            m_values = needAllData ? 4 : 0;
-            m_fillFindData  = FillFindDataMtime;
-            m_fillEntryData = FillEntryMtime;
-            CompareData     = sortIncreasing ? CompareDataNameInc : CompareDataNameDec;
+            m_sortBy = eSortName;
             break;
         case 'e':
             // Sort extension
-            m_values = needAllData ? 4 : 0;
-            m_fillFindData  = FillFindDataMtime;
-            m_fillEntryData = FillEntryMtime;
-            CompareData     = sortIncreasing ? CompareDataExtInc : CompareDataExtDec;
+            m_sortBy = eSortExt;
             break;
         case 'p':
             // Sort file path  (dir+name)
-            m_values = needAllData ? 4 : 0;
-            m_fillFindData  = FillFindDataMtime;
-            m_fillEntryData = FillEntryMtime;
-            CompareData     = sortIncreasing ? CompareDataPathInc : CompareDataPathDec;
+            m_sortBy = eSortPath;
             break;
         case 't':
             // Sort attributes, type (file, dir, etc)
-            m_values = needAllData ? 4 : 0;
-            m_fillFindData  = FillFindDataMtime;
-            m_fillEntryData = FillEntryMtime;
-            CompareData     = sortIncreasing ? CompareDataTypeInc : CompareDataTypeDec;
+            m_sortBy = eSortType;
             break;
         }
     }
 
-    assert(m_values != -1);
+    for (unsigned valIdx = 0; valIdx != eValueCnt; valIdx++)
+        m_keepValue[valIdx] = needAllData;
+    if (m_sortBy == eSortValue)
+        m_keepValue[m_sortValue] = true;
 
-    if (m_values != -1)
-    {
-        LLDirEntry* pDirEntry = NULL;
-        m_ourSize  = sizeof(LLDirEntry) - sizeof(pDirEntry->lvalue);
-        m_ourSize += sizeof(pDirEntry->lvalue[0]) * m_values;
-        dirScan.m_add_cb     = LLDirSort::SortCb;
-        dirScan.m_cb_data    = this;
-    }
+    dirScan.m_add_cb     = LLDirSort::SortCb;
+    dirScan.m_cb_data    = this;
 }
 
 // ---------------------------------------------------------------------------
 void LLDirSort::SetSortData(bool needAllData)
 {
-    // TODO - should decide size based on currently active sort field.
-    //      - need to save sort field id and use it in a switch statement.
-
-    if (needAllData)
+    // Columns can only be added before the first row.
+    if (needAllData && m_count == 0)
     {
-        m_values = 4;
-        LLDirEntry* pDirEntry = NULL;
-        m_ourSize  = sizeof(LLDirEntry) - sizeof(pDirEntry->lvalue);
-        m_ourSize += sizeof(pDirEntry->lvalue[0]) * m_values;
+        for (unsigned valIdx = 0; valIdx != eValueCnt; valIdx++)
+            m_keepValue[valIdx] = true;
     }
 }
 
@@ -513,37 +583,376 @@ void LLDirSort::SetSortAttr(DWORD showOnlyAttr)
 // ---------------------------------------------------------------------------
 void LLDirSort::Clear()
 {
-    LLDirEntry* pDirEntry = m_pFirst;
-    LLDirEntry* pTmpEntry = NULL;
+    ClearRows();
+    RemoveRuns();
+    m_firstSeq = 0;
+}
 
-    while (pDirEntry)
+// ---------------------------------------------------------------------------
+void LLDirSort::ClearRows()
+{
+    m_nameArena.Reset();   // blocks are reused after a spilled run
+    m_nameMark = m_nameArena.GetMark();
+    m_namePtrs.clear();
+    m_keys.clear();
+    m_dirIds.clear();
+    m_attributes.clear();
+    m_seqs.clear();
+    for (unsigned valIdx = 0; valIdx != eValueCnt; valIdx++)
+        m_values[valIdx].clear();
+    m_dirTable.Clear();
+    m_dirRefs.clear();
+    m_dirPathId = DirTable::sNoDir;
+    m_order.clear();
+    m_heap.clear();
+    m_count = 0;
+    m_nameBytes = 0;
+    m_compactDirs = 0;
+    m_sorted = false;
+}
+
+// ---------------------------------------------------------------------------
+void LLDirSort::Sort()
+{
+    if (m_sorted)
+        return;
+
+    if (m_limit != 0)
     {
-        pTmpEntry = pDirEntry;
-        pDirEntry = pDirEntry->pNext;
-        delete pTmpEntry;
+        // Kept rows are no longer in scan order, sort the heap instead.
+        m_order = m_heap;
+        std::sort_heap(m_order.begin(), m_order.end(), HeapLess(*this));
+        m_sorted = true;
+        return;
     }
+
+    m_order.resize(m_count);
+    for (unsigned row = 0; row != m_count; row++)
+        m_order[row] = row;
+
+    // Value sorts break ties by name, radix passes are stable so the
+    // name order is kept within equal values.
+    SortNames();
+    if (m_sortBy == eSortValue)
+        RadixSort(m_values[m_sortValue]);
+
+    if (!m_sortIncreasing)
+        std::reverse(m_order.begin(), m_order.end());
+    m_sorted = true;
 }
 
 // ---------------------------------------------------------------------------
-void LLDirSort::ShowSorted(DirCb dirCb, void* cbData)
+void LLDirSort::SortNames()
+{
+    SortBy sortBy = (m_sortBy == eSortValue) ? eSortName : m_sortBy;
+    ParallelSort(m_order, RowLess(*this, sortBy));
+}
+
+// ---------------------------------------------------------------------------
+// LSD radix sort of m_order on values, one byte per pass. All byte counts are
+// taken in one pass and bytes equal in every value (high bytes of sizes and
+// times) are skipped.
+void LLDirSort::RadixSort(const std::vector<ULONGLONG>& values)
 {
-    LLDirEntry* pDirEntry = m_pFirst;
+    const unsigned sDigits = sizeof(ULONGLONG);
+    const unsigned sBuckets = 256;
+    size_t count = m_order.size();
+    if (count < 2)
+        return;
 
-    //
-    //  Display data
-    //
-    WIN32_FIND_DATA findData;
-    ClearMemory(&findData, sizeof(findData));
+    std::vector<ULONGLONG> keys(count);
+    std::vector<size_t> counts(sDigits * sBuckets, 0);
+    for (size_t pos = 0; pos != count; pos++)
+    {
+        ULONGLONG key = keys[pos] = values[m_order[pos]];
+        for (unsigned digit = 0; digit != sDigits; digit++)
+            counts[digit * sBuckets + (unsigned)((key >> (digit * 8)) & 0xff)]++;
+    }
+
+    std::vector<ULONGLONG> tmpKeys(count);
+    std::vector<unsigned> tmpOrder(count);
+    for (unsigned digit = 0; digit != sDigits; digit++)
+    {
+        unsigned shift = digit * 8;
+        size_t* pCount = &counts[digit * sBuckets];
+        if (pCount[(keys[0] >> shift) & 0xff] == count)
+            continue;
+
+        size_t offset = 0;
+        for (unsigned bucket = 0; bucket != sBuckets; bucket++)
+        {
+            size_t bucketCnt = pCount[bucket];
+            pCount[bucket] = offset;
+            offset += bucketCnt;
+        }
+
+        for (size_t pos = 0; pos != count; pos++)
+        {
+            size_t dst = pCount[(keys[pos] >> shift) & 0xff]++;
+            tmpKeys[dst] = keys[pos];
+            tmpOrder[dst] = m_order[pos];
+        }
+        keys.swap(tmpKeys);
+        m_order.swap(tmpOrder);
+    }
+}
+
+// ---------------------------------------------------------------------------
+void LLDirSort::SetSpill(size_t memLimit, const char* spillDir)
+{
+    m_spillLimit = memLimit;
+    if (spillDir != NULL && *spillDir != '\0')
+    {
+        m_spillDir = spillDir;
+    }
+    else
+    {
+        char tempDir[MAX_PATH];
+        DWORD len = GetTempPath(ARRAYSIZE(tempDir), tempDir);
+        m_spillDir = (len != 0 && len < ARRAYSIZE(tempDir)) ? tempDir : ".";
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Approximate memory used by the rows, compared against m_spillLimit.
+size_t LLDirSort::RowBytes() const
+{
+    // name pointer, sort key, dir id, attributes and sort order
+    size_t perRow = sizeof(const char*) + sizeof(SortKey) + sizeof(unsigned) + sizeof(DWORD) + sizeof(unsigned);
+    for (unsigned valIdx = 0; valIdx != eValueCnt; valIdx++)
+    {
+        if (m_keepValue[valIdx])
+            perRow += sizeof(ULONGLONG);
+    }
+    return m_nameArena.GetStats().usedBytes + m_dirTable.Bytes() + m_dirRefs.size() * sizeof(DirRef) + m_count * perRow;
+}
+
+// ---------------------------------------------------------------------------
+// Sort rows and write them to a new run file, rows are cleared if written.
+bool LLDirSort::SpillRun()
+{
+    char runPath[MAX_PATH];
+    FILE* fout = NULL;
+    if (GetTempFileName(m_spillDir.c_str(), "lls", 0, runPath) == 0)
+    {
+        ErrorMsg() << "Unable to create sort run in " << m_spillDir << ", sorting in memory\n";
+        return false;
+    }
+    if (fopen_s(&fout, runPath, "wb") != 0 || fout == NULL)
+    {
+        DeleteFile(runPath);
+        ErrorMsg() << "Unable to write sort run " << runPath << ", sorting in memory\n";
+        return false;
+    }
+    setvbuf(fout, NULL, _IOFBF, 1 << 20);
+
+    Sort();
+    bool ok = true;
+    std::string dir;
+    for (size_t pos = 0; ok && pos != m_order.size(); pos++)
+    {
+        unsigned row = m_order[pos];
+        const char* name = Name(row);
+        Dir(row, dir);
+        WORD  nameLen = (WORD)strlen(name);
+        DWORD dirLen  = (DWORD)dir.length();
+
+        ok = WriteValue(fout, m_firstSeq + row) && WriteValue(fout, m_attributes[row]);
+        for (unsigned valIdx = 0; ok && valIdx != eValueCnt; valIdx++)
+        {
+            if (m_keepValue[valIdx])
+                ok = WriteValue(fout, m_values[valIdx][row]);
+        }
+        ok = ok && WriteValue(fout, nameLen) && WriteValue(fout, dirLen)
+            && (nameLen == 0 || fwrite(name, nameLen, 1, fout) == 1)
+            && (dirLen == 0 || fwrite(dir.c_str(), dirLen, 1, fout) == 1);
+    }
+    ok = (fclose(fout) == 0) && ok;
+
+    if (!ok)
+    {
+        DeleteFile(runPath);
+        ErrorMsg() << "Unable to write sort run " << runPath << ", sorting in memory\n";
+        return false;
+    }
+
+    m_runFiles.push_back(runPath);
+    m_firstSeq += m_count;
+    ClearRows();
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+void LLDirSort::RemoveRuns()
+{
+    for (unsigned runIdx = 0; runIdx != m_runFiles.size(); runIdx++)
+        DeleteFile(m_runFiles[runIdx].c_str());
+    m_runFiles.clear();
+}
+
+// ---------------------------------------------------------------------------
+void LLDirSort::GetRecord(unsigned row, SortRecord& record) const
+{
+    record.seq = m_firstSeq + row;
+    record.attributes = m_attributes[row];
+    for (unsigned valIdx = 0; valIdx != eValueCnt; valIdx++)
+        record.values[valIdx] = m_keepValue[valIdx] ? m_values[valIdx][row] : 0;
+    record.name = Name(row);
+    record.key = m_keys[row];
+    Dir(row, record.dir);
+}
+
+// ---------------------------------------------------------------------------
+bool LLDirSort::ReadRecord(FILE* fin, SortRecord& record) const
+{
+    if ( !ReadValue(fin, record.seq) || !ReadValue(fin, record.attributes))
+        return false;
+    for (unsigned valIdx = 0; valIdx != eValueCnt; valIdx++)
+    {
+        record.values[valIdx] = 0;
+        if (m_keepValue[valIdx] && !ReadValue(fin, record.values[valIdx]))
+            return false;
+    }
+
+    WORD  nameLen;
+    DWORD dirLen;
+    if ( !ReadValue(fin, nameLen) || !ReadValue(fin, dirLen))
+        return false;
+    record.name.resize(nameLen);
+    record.dir.resize(dirLen);
+    if ((nameLen != 0 && fread(&record.name[0], nameLen, 1, fin) != 1)
+        || (dirLen != 0 && fread(&record.dir[0], dirLen, 1, fin) != 1))
+        return false;
+    MakeSortKey(record.name.c_str(), m_natural, record.keyText, record.key);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Same order as Sort, equal entries keep their scan order (reversed when decreasing).
+bool LLDirSort::RecordBefore(const SortRecord& left, const SortRecord& right) const
+{
+    int diff;
+    if (m_sortBy == eSortValue && left.values[m_sortValue] != right.values[m_sortValue])
+        diff = (left.values[m_sortValue] < right.values[m_sortValue]) ? -1 : 1;
+    else
+        diff = CompareEntries((m_sortBy == eSortValue) ? eSortName : m_sortBy,
+            left.key, left.attributes, right.key, right.attributes);
+
+    if (diff == 0)
+        diff = (left.seq < right.seq) ? -1 : 1;
+    return m_sortIncreasing ? (diff < 0) : (diff > 0);
+}
+
+// ---------------------------------------------------------------------------
+// K-way merge of the spilled runs and the rows still in memory.
+void LLDirSort::ShowMerged(FileEntryCb entryCb, void* cbData)
+{
+    Sort();
+
+    size_t memIdx = m_runFiles.size();      // source index of rows in memory
+    size_t memPos = 0;
+    std::vector<FILE*> runs(memIdx, (FILE*)NULL);
+    std::vector<SortRecord> records(memIdx + 1);
+    std::vector<unsigned> heap;
+
+    for (unsigned runIdx = 0; runIdx != memIdx; runIdx++)
+    {
+        if (fopen_s(&runs[runIdx], m_runFiles[runIdx].c_str(), "rb") != 0 || runs[runIdx] == NULL)
+        {
+            runs[runIdx] = NULL;
+            ErrorMsg() << "Unable to read sort run " << m_runFiles[runIdx] << std::endl;
+            continue;
+        }
+        setvbuf(runs[runIdx], NULL, _IOFBF, 1 << 16);
+        if (ReadRecord(runs[runIdx], records[runIdx]))
+            heap.push_back(runIdx);
+    }
+    if (memPos != m_order.size())
+    {
+        GetRecord(m_order[memPos++], records[memIdx]);
+        heap.push_back((unsigned)memIdx);
+    }
+
+    RecordAfter recordAfter(*this, records);
+    std::make_heap(heap.begin(), heap.end(), recordAfter);
+
+    FileEntry entry;
+    while ( !heap.empty())
+    {
+        std::pop_heap(heap.begin(), heap.end(), recordAfter);
+        unsigned src = heap.back();
+        SortRecord& record = records[src];
+
+        SetEntry(record.name.c_str(), record.attributes, record.values, entry);
+        entryCb(cbData, record.dir.c_str(), entry, 0);
+
+        bool more;
+        if (src == memIdx)
+        {
+            more = (memPos != m_order.size());
+            if (more)
+                GetRecord(m_order[memPos++], record);
+        }
+        else
+        {
+            more = ReadRecord(runs[src], record);
+        }
 
-    while (pDirEntry)
+        if (more)
+            std::push_heap(heap.begin(), heap.end(), recordAfter);
+        else
+            heap.pop_back();
+    }
+
+    for (unsigned runIdx = 0; runIdx != runs.size(); runIdx++)
     {
-        // Copy sorted data in to findData structure
-        strncpy_s(findData.cFileName, ARRAYSIZE(findData.cFileName), pDirEntry->filenameLStr, _TRUNCATE);
-        findData.dwFileAttributes = pDirEntry->dwFileAttributes;
-        m_fillFindData(findData, *pDirEntry, *this);
+        if (runs[runIdx] != NULL)
+            fclose(runs[runIdx]);
+    }
+}
 
-        // Call standard display function.
-        dirCb(cbData, pDirEntry->szDir, &findData, 0);
-        pDirEntry = pDirEntry->pNext;
+// ---------------------------------------------------------------------------
+void LLDirSort::ShowSorted(FileEntryCb entryCb, void* cbData)
+{
+    if ( !m_runFiles.empty())
+    {
+        ShowMerged(entryCb, cbData);
+        return;
     }
+
+    Sort();
+
+    FileEntry entry;
+    for (size_t pos = 0; pos != m_order.size(); pos++)
+    {
+        unsigned row = m_order[pos];
+        GetEntry(row, entry);
+        entryCb(cbData, Dir(row), entry, 0);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ShowSorted target which passes entries on to a DirCb.
+struct DirCbAdapter
+{
+    DirCb           dirCb;
+    void*           cbData;
+    WIN32_FIND_DATA findData;
+
+    static int EntryCb(void* cbData, const char* pDir, const FileEntry& entry, int depth)
+    {
+        DirCbAdapter* pAdapter = (DirCbAdapter*)cbData;
+        ToFindData(entry, pAdapter->findData);
+        return pAdapter->dirCb(pAdapter->cbData, pDir, &pAdapter->findData, depth);
+    }
+};
+
+// ---------------------------------------------------------------------------
+void LLDirSort::ShowSorted(DirCb dirCb, void* cbData)
+{
+    DirCbAdapter adapter;
+    ClearMemory(&adapter, sizeof(adapter));
+    adapter.dirCb = dirCb;
+    adapter.cbData = cbData;
+    ShowSorted(DirCbAdapter::EntryCb, &adapter);
 }
@@ -28,63 +28,19 @@
 // CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //-----------------------------------------------------------------------------
 
-
 #pragma once
 
 #include <iostream>
 #include <iomanip>
+#include <vector>
+#include <stdio.h>
 #include "dirscan.h"
-
-#include "llstring.h"
-
-// Forward ref
-struct LLDirEntry;
-class LLDirSort;
-
-typedef void (*FillEntryData_t)(LLDirEntry& dirEntry, const WIN32_FIND_DATA& findData, const LLDirSort& dirSort);
-typedef void (*FillFindData_t)(WIN32_FIND_DATA& findData, const LLDirEntry& dirEntry, const LLDirSort& dirSort);
-
-typedef LLPool<LLDirEntry>  LLDirEntryPool;
+#include "DirTable.h"
+#include "Arena.h"
+#include "FileEntry.h"
 
 // Forward declaration
-class LLDirSort;
-
-// ---------------------------------------------------------------------------
-struct LLDirEntry
-{
-    LLDirEntry(const char* fileName, const char* dir, int baseDirLen,
-        const WIN32_FIND_DATA&, FillEntryData_t fillEntryData,
-        LLDirSort& dirSort);
-
-    ~LLDirEntry()
-    {}
-
-    LLDirEntry*     pPrev;
-    LLDirEntry*     pNext;
-    LLString        filenameLStr;
-    const char*     szDir;
-    int             baseDirLen;
-    DWORD           dwFileAttributes;
-    union
-    {
-        LARGE_INTEGER   li;
-        FILETIME        ft;
-    } lvalue[4];    // ctime, atime, mtime, size;
-
-    void *operator new(size_t /* size */, LLDirEntryPool& pool, size_t ourSize)
-    {
-        return (void*)pool.Add(0, ourSize);
-    }
-
-    void operator delete(void*)
-    {
-    }
-
-private:
-    LLDirEntry& operator=(const LLDirEntry&);
-    LLDirEntry(const LLDirEntry&);
-};
-
+struct SortRecord;
 
 typedef int (*DirCb)(
         void* cbData,
@@ -92,16 +48,39 @@ typedef int (*DirCb)(
         const WIN32_FIND_DATA* pFileData,
         int depth);
 
+typedef int (*FileEntryCb)(
+        void* cbData,
+        const char* pDir,
+        const FileEntry& entry,
+        int depth);
+
 
 // ---------------------------------------------------------------------------
+// Collect directory entries and present them sorted.
+//
+// Entries are stored as rows of contiguous columns (name, dir id,
+// attributes and the 64-bit size and time values), directories are kept once
+// in a DirTable and their paths built on request. Nothing is sorted while
+// the scan runs. Sort builds a permutation of the rows:
+//      size and time   LSD radix sort on the 64-bit value, ties by name
+//      name and others stable sort of the row index, in parallel (ParallelSort)
+//
+// Names are compared by a collation key built once per row as it is added
+// (SortKey): the case folded name, its extension offset and its first 8
+// bytes as an integer, so most comparisons are one integer compare.
+//
+// With a limit (SetLimit) only the first 'limit' rows of the sorted order
+// are kept, in a heap whose top is the last kept row. Rows which sort after
+// it are dropped as they arrive, so memory stays bounded by the limit.
+//
+// With a spill limit (SetSpill) rows are sorted and written to a temporary
+// run file each time they use more memory than the limit. ShowSorted then
+// merges the runs and the rows left in memory, in the same order as an
+// in-memory sort (equal entries keep their scan order).
 class LLDirSort
 {
 public:
-    LLDirSort() : m_ourSize(0), m_count(0), m_pool(),
-        m_pFirst(NULL), m_pLast(NULL),
-        m_onlyAttr(DWORD(-1)), m_values(0)
-    {}
-
+    LLDirSort();
     ~LLDirSort() { Clear(); }
 
     void Clear();
@@ -124,19 +103,150 @@ public:
     /// Set which Directory attributes we care about (reduce memory usage)
     void SetSortAttr(DWORD showOnlyAttr);
 
+    /// Keep only the first 'limit' sorted rows, 0=all. Set before the scan.
+    void SetLimit(size_t limit)
+    { m_limit = limit; }
+
+    /// Compare digit runs in names by value ("file9" before "file10"). Set before the scan.
+    void SetNatural(bool natural)
+    { m_natural = natural; }
+
+    /// Spill sorted runs once rows use more than memLimit bytes, 0=never.
+    /// NULL or "" spillDir uses %TEMP%. Set before the scan, not used with SetLimit.
+    void SetSpill(size_t memLimit, const char* spillDir);
+
     void SetColor(WORD& colorCfg, const char* colorOptStr);
+    // Pass sorted entries to entryCb, entry.name is valid during the call.
+    void ShowSorted(FileEntryCb entryCb, void* cbData);
+    // Same for callbacks which need a WIN32_FIND_DATA.
     void ShowSorted(DirCb dirCb, void* cbData);
 
+    // Sort rows, done once by ShowSorted. Row(pos) is the row at sorted position pos.
+    void Sort();
+    unsigned Row(size_t pos) const
+    { return m_order[pos]; }
+    std::vector<unsigned>& Order()
+    { return m_order; }
+
+    // Collation key of a name.
+    struct SortKey
+    {
+        ULONGLONG   prefix;     // first 8 bytes of key, big endian
+        const char* key;        // nul terminated
+        unsigned    extOff;     // extension (last '.') in key, sNoExt if none
+    };
+    static const unsigned sNoExt = unsigned(-1);
+
+    // Row columns
+    const char* Name(unsigned row) const
+    { return m_namePtrs[row]; }
+    // Directory of row, valid until the next Dir(row) call.
+    const char* Dir(unsigned row) const;
+    // Directory of row built in path.
+    const char* Dir(unsigned row, std::string& path) const
+    { return m_dirTable.GetPath(DirId(row), path); }
+    // Rows with the same DirId have the same directory.
+    unsigned DirId(unsigned row) const
+    { return m_dirRefs[m_dirIds[row]].dirId; }
+    int BaseDirLen(unsigned row) const
+    { return m_dirRefs[m_dirIds[row]].baseDirLen; }
+    DWORD Attributes(unsigned row) const
+    { return m_attributes[row]; }
+    const SortKey& Key(unsigned row) const
+    { return m_keys[row]; }
+
+    // Arena holding the row names.
+    const Arena& NameArena() const
+    { return m_nameArena; }
+
+    // Return true if left row is shown before right row.
+    bool RowBefore(unsigned left, unsigned right) const;
+
+    // Compare names of two rows in _stricmp order (natural if set), 0 if equal.
+    int CompareNames(unsigned left, unsigned right) const
+    { return CompareKeys(m_keys[left], m_keys[right]); }
+
+    // Set key of name built in keyText, valid while keyText is not changed.
+    // Keys compare with strcmp in _stricmp order of the names. With natural,
+    // digit runs are stored as '0', digit count and digits without leading
+    // zeros, so they compare by value.
+    static void MakeSortKey(const char* name, bool natural, std::string& keyText, SortKey& sortKey);
+    static int CompareKeys(const SortKey& left, const SortKey& right);
+
+    // Fill attributes, size and times kept for row, name is not set.
+    void GetFindData(unsigned row, WIN32_FIND_DATA& findData) const;
+    // Entry of row, values not kept are 0.
+    void GetEntry(unsigned row, FileEntry& entry) const;
+
+    enum Value { eCtime, eAtime, eMtime, eSize, eValueCnt };
+    // Value kept for row, 0 if the column is not kept.
+    ULONGLONG GetValue(unsigned row, Value column) const
+    { return m_keepValue[column] ? m_values[column][row] : 0; }
+    enum SortBy { eSortName, eSortExt, eSortPath, eSortType, eSortValue };
+
 public:
-    size_t             m_ourSize;
     size_t             m_count;
-    int                m_baseDirLen;
-    LLDirEntry*        m_pFirst;
-    LLDirEntry*        m_pLast;
-    LLDirEntryPool     m_pool;
+    int                m_baseDirLen;    // Set before scan, length of base dir to strip for relative path
     DWORD              m_onlyAttr;
-    FillEntryData_t    m_fillEntryData;
-    FillFindData_t     m_fillFindData;
-    int                m_values;
-};
 
+private:
+    LLDirSort(const LLDirSort&);
+    LLDirSort& operator=(const LLDirSort&);
+
+    void AddRow(const char* pDir, const FileEntry& entry);
+    void ClearRows();
+    void LimitRows();
+    void PopRow();
+    void MoveRow(unsigned toRow, unsigned fromRow);
+    void CompactRows();
+    void SortNames();
+    void RadixSort(const std::vector<ULONGLONG>& values);
+
+    const char* AddName(const char* name, SortKey& sortKey);
+    size_t NameBytes(unsigned row) const;
+    size_t RowBytes() const;
+    bool SpillRun();
+    void RemoveRuns();
+    void GetRecord(unsigned row, SortRecord& record) const;
+    bool ReadRecord(FILE* fin, SortRecord& record) const;
+    bool RecordBefore(const SortRecord& left, const SortRecord& right) const;
+    void ShowMerged(FileEntryCb entryCb, void* cbData);
+
+    friend struct RecordAfter;
+
+    SortBy             m_sortBy;
+    Value              m_sortValue;     // eSortValue column
+    bool               m_sortIncreasing;
+    bool               m_keepValue[eValueCnt];
+    bool               m_sorted;
+    bool               m_natural;
+    size_t             m_limit;         // 0=all, else max rows kept
+    size_t             m_nameBytes;     // bytes of m_nameArena used by rows
+    size_t             m_compactDirs;   // m_dirTable size after CompactRows
+    size_t             m_spillLimit;    // 0=never, else row bytes before a run is spilled
+    std::string        m_spillDir;
+    ULONGLONG          m_firstSeq;      // scan order of row 0 (next row if m_limit)
+
+    Arena                   m_nameArena;    // nul terminated names
+    Arena::Mark             m_nameMark;     // m_nameArena before the last name
+    std::vector<const char*> m_namePtrs;    // per row, name in m_nameArena
+    std::vector<SortKey>    m_keys;         // per row, key in m_nameArena
+    std::string             m_keyText;      // AddRow key buffer
+    std::vector<unsigned>   m_dirIds;       // per row, index in m_dirRefs
+    std::vector<DWORD>      m_attributes;   // per row
+    std::vector<ULONGLONG>  m_seqs;         // per row if m_limit, scan order
+    std::vector<ULONGLONG>  m_values[eValueCnt];    // per row if m_keepValue
+
+    struct DirRef
+    {
+        unsigned    dirId;          // in m_dirTable
+        int         baseDirLen;     // m_baseDirLen when added
+    };
+    DirTable                m_dirTable;
+    std::vector<DirRef>     m_dirRefs;      // directories in scan order
+    mutable std::string     m_dirPath;      // Dir(row) result
+    mutable unsigned        m_dirPathId;
+    std::vector<unsigned>   m_order;        // sorted rows
+    std::vector<unsigned>   m_heap;         // rows when m_limit, top sorts last
+    std::vector<std::string> m_runFiles;    // sorted runs spilled to disk
+};
@@ -102,6 +102,7 @@
 #include "ll_stdhdr.h"
 #include "dirscan.h"
 #include "llbase.h"
+#include "llbench.h"
 #include "llcmp.h"
 #include "llcopy.h"
 #include "lldir.h"
@@ -143,6 +144,7 @@ static const char sHelp[] =
 "    p    or printf     ; Print file names \n"
 "    lg   or llgrep     ; Grep find and replace \n"
 "    le   or llexec     ; Execute command on files \n"
+"    lb   or llbench    ; Benchmark pattern matching \n"
 "\n"   
 "  !0eExample:!0f\n"
 "    ld                 ; List Directory information \n"
@@ -153,10 +155,10 @@ static const char sHelp[] =
 
 
 // Possible commands (not all are implemented)
-enum Cmd { eNone, eCmp, eCopy, eDir, eDel, eExec, eFind, eMove, eWhere, ePrintf, eGrep, eInstall, eUninstall };
+enum Cmd { eNone, eCmp, eCopy, eDir, eDel, eExec, eFind, eMove, eWhere, ePrintf, eGrep, eBench, eInstall, eUninstall };
 char* CmdName[] = { 
     "None", "Compare", "Copy", "Dir", "Delete", "Execute", "Find", "Move", "Where",
-    "Printf", "Grep", "Install", "Uninstall" };
+    "Printf", "Grep", "Bench", "Install", "Uninstall" };
 
 //  Association between names and commands.
 struct CmdAlias
@@ -197,6 +199,9 @@ static CmdAlias sCmdAlias[] =
     {"lg",      eGrep},
  //   {"grep",    eGrep},
     {"g",       eGrep},
+    {"llbench", eBench},
+    {"lb",      eBench},
+    {"b",       eBench},
     {"llinstall",eInstall},
     {"i",       eInstall},
 	{"llunstall",eUninstall},
@@ -364,6 +369,9 @@ int main(int argc, const char* argv[])
         case eGrep:
             exitStatus = LLReplace::StaticRun(cmdOpts, passArgc, passArgv);
             break;
+        case eBench:
+            exitStatus = LLBench::StaticRun(cmdOpts, passArgc, passArgv);
+            break;
         case eInstall:
             {
                 char dir[_MAX_DIR];
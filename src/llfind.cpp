@@ -57,6 +57,8 @@ static const char sHelp[] =
 "   -G=<grepPattern>    ; Find only if file contains grepPattern \n"
 "   -g=<grepRange>      ;  default is search entire file, +n=first n lines \n"
 "   -I=<file>           ; Read list of files from this file\n"
+"   -K                  ; Cache directory snapshot, reuse unchanged dirs (-K=<cacheDir>)\n"
+"                       ;   file sizes/times may be stale\n"
 "   -p                  ; Short cut for -e=PATH, search path \n"
 "   -P=<srcPathPat>     ; Optional regular expression pattern on source files full path\n"
 "   -q                  ; Quiet, default is echo command\n"
@@ -221,6 +223,9 @@ int LLFind::Run(const char* cmdOpts, int argc, const char* pDirs[])
         case ',':
             DisableCommaCout();
             break;
+        case 'K':   // -K or -K=<cacheDir>
+            ParseDirCache(cmdOpts);
+            break;
 
         case '?':
             Colorize(std::cout, sHelp);
@@ -370,7 +375,7 @@ int LLFind::ProcessEntry(
 
     if (m_isDir)
     {
-        if (PatternMatch(m_dirScan.m_fileFilter, pFileData->cFileName) == false)
+        if (m_dirScan.m_fileMatch.Match(pFileData->cFileName) == false)
             return sIgnore;
 
 		if (m_onlyAttr == FILE_ATTRIBUTE_DIRECTORY &&
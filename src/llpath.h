@@ -84,6 +84,21 @@ public:
         return (attr != INVALID_FILE_ATTRIBUTES);
     }
 
+    // Return true if path is on a local fixed drive, not a network share or
+    // removable media. Relative paths use the current drive.
+    static bool IsLocalDrive(const char* path)
+    {
+        if (path[0] == sDirChr() && path[1] == sDirChr())
+            return false;   // UNC path, \\server\share
+        char root[] = "?:\\";
+        if (path[0] != '\0' && path[1] == ':')
+        {
+            root[0] = path[0];
+            return GetDriveType(root) == DRIVE_FIXED;
+        }
+        return GetDriveType(NULL) == DRIVE_FIXED;
+    }
+
     // Return true if attributes are not ReadOnly, not System and not Hidden.
     static bool IsWriteable(DWORD attr)
     {
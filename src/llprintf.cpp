@@ -1308,7 +1308,7 @@ int LLPrintf::ProcessEntry(
 
     if (m_isDir)
     {
-        if (PatternMatch(m_dirScan.m_fileFilter, pFileData->cFileName) == false)
+        if (m_dirScan.m_fileMatch.Match(pFileData->cFileName) == false)
             return sIgnore;
     }
 
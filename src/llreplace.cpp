@@ -177,6 +177,7 @@ static const char sHelp[] =
 "                       ;     U(i|b) update inline or backup \n"
 "   -i                  ; Ignore case, same as -g=I \n"
 "   -I=<file>           ; Read list of files from this file\n"
+"   -J                  ; Parallel directory scan (-J=<threads>), -Ju unordered, -Jb batched\n"
 "   -M=<file>           ; Match (and replace) list of patterns in file \n"
 "                       ;  First Line Seperator:<char> like , \n"
 "                       ;  Remainder <findPat><seperator><replacePat>[,<filePathPat>]  \n"
@@ -195,6 +196,10 @@ static const char sHelp[] =
 "   -X=<pathPat>,...    ; Exclude patterns  -X=*.lib,*.obj,*.exe\n"
 "                       ;  No space in patterns. Pattern applied against fullpath\n"
 "                       ;  So *\\ma will exclude a directory ma or file ma \n"
+"                       ;  Patterns ending in * also skip scanning below a matching directory\n"
+"   -Xp=<dirPat>,...    ; Prune, exclude and do not scan directories matching path pattern\n"
+"                       ;  ex -Xp=*\\.git,*\\node_modules \n"
+"   -Dp=<dirPat>,...    ; Prune, only scan directories whose name matches dirPat\n"
 "   -v                  ; Verbose \n"
 "   -V=<grepPattern>    ; Return inverse line matching grep matches \n"
 "   -w=<width>          ; Limit output to width characters per match \n"
@@ -82,7 +82,7 @@ public:
     long                m_width;
 
     LLSup::StringList   m_matchFiles;
-    LLSup::StringList   m_zipList;      // -z=[<filePat>][,<filePat>]
+    LLSup::PatternList  m_zipList;      // -z=[<filePat>][,<filePat>]
     bool                m_zipFile;      // -z
 
     static LLReplaceConfig sConfig;
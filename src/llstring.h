@@ -80,97 +80,3 @@ public:
             push_back(str.substr(lastPos, std::string::npos));
     }
 };
-
-
-///
-/// LLPool manages memory in buckets.
-// ---------------------------------------------------------------------------
-template <typename T>
-class LLPool
-{
-public:
-    LLPool() {}
-    ~LLPool() { Clear(); }
-
-    void Clear()
-    {
-        for (size_t i=0; i < m_buckets.size(); ++i)
-        {
-            delete m_buckets[i];
-            m_buckets[i] = NULL;
-        }
-
-        m_buckets.clear();
-    }
-
-    const T* Add(const T* pObj, size_t len)
-    {
-        assert(len < Bucket::sBucketSize);
-
-        // Make sure we have atleast one bucket.
-        if (m_buckets.size() == 0)
-            m_buckets.push_back(new Bucket());
-        Bucket* pBucket = m_buckets[m_buckets.size()-1];
-
-        if (pBucket->nextPtr + len >= pBucket->endPtr)
-        {
-        _CrtCheckMemory( );
-            // Need more room, add another bucket.
-            m_buckets.push_back(new Bucket());
-            pBucket = m_buckets[m_buckets.size()-1];
-        _CrtCheckMemory( );
-        }
-
-        if (pObj)
-        {
-            assert(pBucket->nextPtr + len < pBucket->endPtr);
-            memcpy(pBucket->nextPtr, pObj, len);
-        }
-        pObj = (const T*)pBucket->nextPtr;
-        pBucket->nextPtr += len;
-
-        return pObj;
-    }
-
-private:
-    struct Bucket
-    {
-        static const int sBucketSize = 4096*16;
-        Bucket() : topPtr(new char[sBucketSize]), nextPtr(topPtr), endPtr(topPtr+sBucketSize){}
-        ~Bucket() { delete [] topPtr; }
-        char* topPtr;
-        char* nextPtr;
-        char* endPtr;
-    };
-    std::vector<Bucket*> m_buckets;
-};
-
-// ---------------------------------------------------------------------------
-// Warning - Does not free memory so heavy use will consume a lot of memory.
-// Ideal for limited burst use.
-
-struct LLString
-{
-    LLString(const char* str) :
-        m_str(m_pool.Add(str, sizeof(char)*(strlen(str)+1)))
-    {}
-
-    operator const char*()
-    { return m_str; }
-
-    operator const char*() const
-    { return m_str; }
-
-    const char* c_str() const
-    { return m_str; }
-
-    const char* m_str;
-
-    static LLPool<const char> m_pool;
-};
-
-inline std::ostream & operator<<(std::ostream& out, const LLString& lstr)
-{
-    out << lstr.c_str();
-    return out;
-}
\ No newline at end of file
@@ -1201,6 +1201,28 @@ const char* ParseList(
     return cmdOpts;
 }
 
+// ---------------------------------------------------------------------------
+const char* ParseList(
+    const char* cmdOpts,
+    PatternList& patList,
+    const char* emptyMsg)
+{
+    StringList strList;
+    cmdOpts = ParseList(cmdOpts, strList, emptyMsg);
+    for (unsigned idx = 0; idx != strList.size(); idx++)
+        patList.push_back(strList[idx]);
+    return cmdOpts;
+}
+
+// ---------------------------------------------------------------------------
+bool PatternListMatches(const PatternList& patList, const char* fileName, bool emptyResult)
+{
+    if (patList.empty())
+        return emptyResult;
+
+    return patList.Matches(fileName);
+}
+
 // ---------------------------------------------------------------------------
 bool PatternListMatches(const StringList& patList, const char* fileName, bool emptyResult)
 {
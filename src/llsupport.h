@@ -38,6 +38,7 @@
 #include <list>
 #include <string>
 #include <Windows.h>
+#include "WildPattern.h"
 
 
 
@@ -197,12 +198,38 @@ int FileTimeDifference(const FILETIME& ft1, const FILETIME& ft2, const ULONGLONG
 
 typedef std::vector<std::string> StringList;
 
+// List of wildcard patterns, compiled into a set matcher as they are added.
+class PatternList
+{
+public:
+    bool empty() const
+    { return m_patterns.Empty(); }
+    size_t size() const
+    { return m_patterns.Size(); }
+    const std::string& operator[](size_t idx) const
+    { return m_patterns[idx].Pattern(); }
+
+    void push_back(const std::string& pattern)
+    { m_patterns.Add(pattern); }
+    void clear()
+    { m_patterns.Clear(); }
+
+    // Return true if str matches any pattern.
+    bool Matches(const char* str) const
+    { return m_patterns.Match(str); }
+
+private:
+    WildPatternSet m_patterns;
+};
+
 //  Parse -F or -X*.exe,*.lib;p???.dat,foo.bar
 const char* ParseList(const char* cmdOpts, StringList& strList, const char* emptyErrMsg /* = NULL */);
+const char* ParseList(const char* cmdOpts, PatternList& patList, const char* emptyErrMsg /* = NULL */);
 
 // Return true if file matches pattern in list.
 // Return emptyListResult if patList is empty.
 bool PatternListMatches(const StringList& patList, const char* fileName, bool emptyListResult = false);
+bool PatternListMatches(const PatternList& patList, const char* fileName, bool emptyListResult = false);
 
 // Parse:  -A[nrhs]     ; show only (n=normal r=readonly, h=hidden, s=system)\n"
 const char* ParseAttributes(const char* cmdOpts,  DWORD& attributes, const char* errMsg);